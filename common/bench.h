@@ -18,13 +18,211 @@
 #define __BENCH_H__
 
 #include <errno.h>    // error codes
+#include <math.h>     // sqrt()
 #include <stdarg.h>   // va_list, va_end(), va_start()
-#include <stdio.h>    // fclose(), fgets(), fopen(), printf(), vprintf()
-#include <stdlib.h>   // stdtoul()
+#include <stdio.h>    // fclose(), fgets(), fopen(), fprintf(), vsnprintf()
+#include <stdlib.h>   // getenv(), malloc(), qsort(), strtoul()
+#include <string.h>   // strcmp()
 #include <time.h>     // clock_gettime(), timespec
-#include <unistd.h>   // access()
+#include <unistd.h>   // access(), close(), read(), syscall()
 
-static struct timespec bench_ts_start, bench_ts_stop;
+#ifdef _OPENMP
+  #include <omp.h>    // omp_get_thread_num(), omp_in_parallel()
+#endif
+
+#if defined(__linux__) && !defined(BENCH_NO_PERF)
+  #define BENCH_HAVE_PERF
+  #include <linux/perf_event.h>   // perf_event_attr, PERF_*
+  #include <sys/syscall.h>        // SYS_perf_event_open
+#endif
+
+/*
+ * Benchmark harness
+ *
+ * A benchmark region is a named piece of code that is executed `warmup` times without being
+ * measured and then `reps` times with being measured.  At the end, the statistics over all measured
+ * repetitions are reported.  Regions are owned by the caller, so they can be nested and can overlap
+ * (also across threads).  The typical use is
+ *
+ *   bench_region_t r;
+ *   BENCH_REGION(r, "PULP: %s", variant) {
+ *     // code to be measured
+ *   }
+ *   // r.stats holds the statistics, r.perf the performance counters (if enabled)
+ *
+ * The defaults for the number of warmup iterations and repetitions as well as the output format
+ * are taken from the environment:
+ *
+ *   BENCH_WARMUP  number of unmeasured warmup iterations (default: 0)
+ *   BENCH_REPS    number of measured repetitions (default: 1)
+ *   BENCH_FORMAT  `text` (default), `csv`, or `json` (one JSON object per line)
+ *   BENCH_OUTPUT  file the `csv` and `json` records are appended to (default: stdout)
+ *   BENCH_PERF    `1` to capture hardware performance counters, `threads` to also report them per
+ *                 thread (default: `0`)
+ *
+ * Hardware performance counters (cycles, instructions, L1 data cache read misses, last-level cache
+ * misses, and branch misses) are captured with `perf_event_open()` on Linux.  The counters count
+ * per OS thread: they are read on every thread of a parallel region of the default size that is
+ * opened right before and after the measurement, and reported summed up over this team.  OpenMP
+ * runtimes run the parallel regions of the default size on these same, pooled threads, so the sum
+ * covers the kernel and the time the threads spend waiting in it; threads beyond the default team
+ * size (e.g., of nested regions) are not counted.  The per-thread values are indexed by OpenMP
+ * thread number.  A region started within a parallel region counts the calling thread only.
+ * Events the host does not support are reported as unavailable.  Define `BENCH_NO_PERF` to
+ * compile the support out.
+ *
+ * The single-shot `bench_start()` and `bench_stop()` are kept for simple measurements; they can be
+ * nested up to `BENCH_MAX_DEPTH` levels, but they are not thread-safe.
+ */
+
+#ifndef BENCH_NAME_LEN
+  #define BENCH_NAME_LEN 128
+#endif
+
+#ifndef BENCH_MAX_DEPTH
+  #define BENCH_MAX_DEPTH 8
+#endif
+
+#ifndef BENCH_MAX_THREADS
+  #define BENCH_MAX_THREADS 64
+#endif
+
+typedef enum {
+  BENCH_FORMAT_TEXT = 0,
+  BENCH_FORMAT_CSV,
+  BENCH_FORMAT_JSON,
+} bench_format_t;
+
+typedef enum {
+  BENCH_PERF_CYCLES = 0,
+  BENCH_PERF_INSTRUCTIONS,
+  BENCH_PERF_L1D_MISSES,
+  BENCH_PERF_LLC_MISSES,
+  BENCH_PERF_BRANCH_MISSES,
+  BENCH_PERF_N_EVENTS,
+} bench_perf_event_t;
+
+static const char* const bench_perf_event_names[BENCH_PERF_N_EVENTS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+};
+
+typedef struct {
+  unsigned long long value;
+  unsigned long long time_enabled;
+  unsigned long long time_running;
+} bench_perf_reading_t;
+
+typedef struct {
+  int                  valid[BENCH_PERF_N_EVENTS];
+  bench_perf_reading_t start[BENCH_PERF_N_EVENTS];
+  unsigned long long   count[BENCH_PERF_N_EVENTS];  // summed over all measured repetitions
+} bench_perf_thread_t;
+
+typedef struct {
+  unsigned             n_threads;                   // threads that have taken part
+  int                  valid[BENCH_PERF_N_EVENTS];  // event counted by at least one thread
+  double               count[BENCH_PERF_N_EVENTS];  // summed over the team, mean per repetition
+  bench_perf_thread_t* thread;                      // NULL if counters are disabled
+} bench_perf_t;
+
+typedef struct {
+  unsigned n_samples;
+  double   min_ms;
+  double   max_ms;
+  double   mean_ms;
+  double   median_ms;
+  double   p95_ms;
+  double   stddev_ms;
+} bench_stats_t;
+
+typedef struct {
+  char            name[BENCH_NAME_LEN];
+  unsigned        n_warmup;
+  unsigned        n_reps;
+  unsigned        iter;       // iterations started so far, including warmup
+  int             running;
+  double*         samples_ms;
+  double          sample_ms;  // storage for single-shot regions
+  struct timespec ts_start;
+  bench_stats_t   stats;
+  bench_perf_t    perf;
+} bench_region_t;
+
+static struct {
+  int            initialized;
+  unsigned       n_warmup;
+  unsigned       n_reps;
+  bench_format_t format;
+  FILE*          fp;
+  int            csv_header_printed;
+  int            host_clk_freq_mhz;
+  int            perf;        // 0: off, 1: team aggregate, 2: also per thread
+  int            perf_warned;
+} bench_config;
+
+#ifdef BENCH_HAVE_PERF
+static int __bench_perf_fds[BENCH_PERF_N_EVENTS];
+static int __bench_perf_opened;
+#ifdef _OPENMP
+#pragma omp threadprivate(__bench_perf_fds, __bench_perf_opened)
+#endif
+#endif
+
+static bench_region_t bench_stack[BENCH_MAX_DEPTH];
+static unsigned       bench_stack_depth;
+
+/**
+ * Execute the following statement as benchmark region `r`, named by a printf-style format string.
+ */
+#define BENCH_REGION(r, ...) \
+  for (bench_region_init(&(r), __VA_ARGS__); bench_region_next(&(r)); )
+
+/**
+ * Override the defaults for the number of warmup iterations and measured repetitions.
+ */
+static inline void bench_set_reps(unsigned n_warmup, unsigned n_reps);
+
+/**
+ * Override the output format.
+ */
+static inline void bench_set_format(bench_format_t format);
+
+/**
+ * Enable (1: team aggregate, 2: also per thread) or disable (0) hardware performance counters for
+ * regions initialized afterwards.
+ */
+static inline void bench_set_perf(int perf);
+
+/**
+ * Initialize a benchmark region with the default number of warmup iterations and repetitions.
+ */
+static inline void bench_region_init(bench_region_t* r, const char* const format, ...);
+
+/**
+ * Start a single iteration of a benchmark region.
+ */
+static inline void bench_region_start(bench_region_t* r);
+
+/**
+ * Stop a single iteration of a benchmark region.
+ *
+ * @return  Duration of the iteration, in milliseconds.
+ */
+static inline double bench_region_stop(bench_region_t* r);
+
+/**
+ * Advance a benchmark region: stop the running iteration (if any) and start the next one.
+ *
+ * After the last repetition, the statistics are computed and reported.
+ *
+ * @return  Nonzero if another iteration has been started; zero if the region is complete.
+ */
+static inline int bench_region_next(bench_region_t* r);
+
+/**
+ * Compute the statistics of a benchmark region, report them, and release its samples.
+ */
+static inline void bench_region_finish(bench_region_t* r);
 
 /**
  * Start benchmark measurement: print label and capture start time.
@@ -46,29 +244,533 @@ static inline double bench_stop();
  */
 static int get_host_clk_freq_mhz();
 
-void bench_start(const char* const format, ...)
+static inline unsigned __bench_env_uint(const char* const name, const unsigned def)
+{
+  const char* const str = getenv(name);
+  if (str == NULL || *str == '\0')
+    return def;
+  return strtoul(str, NULL, 0);
+}
+
+static inline void __bench_init()
+{
+  if (bench_config.initialized)
+    return;
+  bench_config.initialized = 1;
+
+  bench_config.n_warmup = __bench_env_uint("BENCH_WARMUP", 0);
+  bench_config.n_reps   = __bench_env_uint("BENCH_REPS", 1);
+  if (bench_config.n_reps == 0)
+    bench_config.n_reps = 1;
+
+  const char* const format = getenv("BENCH_FORMAT");
+  bench_config.format = BENCH_FORMAT_TEXT;
+  if (format != NULL) {
+    if (strcmp(format, "csv") == 0)
+      bench_config.format = BENCH_FORMAT_CSV;
+    else if (strcmp(format, "json") == 0)
+      bench_config.format = BENCH_FORMAT_JSON;
+    else if (strcmp(format, "text") != 0)
+      printf("WARNING: Unknown BENCH_FORMAT '%s', falling back to 'text'.\n", format);
+  }
+
+  bench_config.fp = stdout;
+  const char* const output = getenv("BENCH_OUTPUT");
+  if (output != NULL && *output != '\0') {
+    bench_config.fp = fopen(output, "a");
+    if (bench_config.fp == NULL) {
+      printf("WARNING: Could not open '%s', writing benchmark records to stdout.\n", output);
+      bench_config.fp = stdout;
+    }
+  }
+
+  const char* const perf = getenv("BENCH_PERF");
+  bench_config.perf = 0;
+  if (perf != NULL && *perf != '\0') {
+    if (strcmp(perf, "threads") == 0)
+      bench_config.perf = 2;
+    else
+      bench_config.perf = strtoul(perf, NULL, 0) > 0;
+  }
+
+  // The clock frequency is only used for the cycle estimate of the text output; read it once.
+  bench_config.host_clk_freq_mhz = -EAGAIN;
+}
+
+/*
+ * Hardware performance counters
+ */
+
+#ifdef BENCH_HAVE_PERF
+static inline void __bench_perf_open()
+{
+  static const struct {
+    unsigned           type;
+    unsigned long long config;
+  } events[BENCH_PERF_N_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+
+  if (__bench_perf_opened)
+    return;
+  __bench_perf_opened = 1;
+
+  for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+    struct perf_event_attr attr;
+    memset((void*)&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = events[e].type;
+    attr.config         = events[e].config;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    // Count the calling thread on any CPU.
+    __bench_perf_fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  }
+}
+
+static inline int __bench_perf_read(const int fd, bench_perf_reading_t* const reading)
+{
+  if (fd < 0)
+    return -EBADF;
+  if (read(fd, (void*)reading, sizeof(*reading)) != sizeof(*reading))
+    return -EIO;
+  return 0;
+}
+#endif
+
+static inline void __bench_perf_thread_start(bench_perf_t* const perf, const unsigned tid)
+{
+#ifdef BENCH_HAVE_PERF
+  if (tid >= BENCH_MAX_THREADS)
+    return;
+
+  __bench_perf_open();
+  bench_perf_thread_t* const t = &perf->thread[tid];
+  for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++)
+    t->valid[e] = __bench_perf_read(__bench_perf_fds[e], &t->start[e]) == 0;
+#endif
+}
+
+static inline void __bench_perf_thread_stop(bench_perf_t* const perf, const unsigned tid,
+    const int record)
+{
+#ifdef BENCH_HAVE_PERF
+  if (tid >= BENCH_MAX_THREADS)
+    return;
+
+  bench_perf_thread_t* const t = &perf->thread[tid];
+  for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+    bench_perf_reading_t stop;
+    if (!t->valid[e] || __bench_perf_read(__bench_perf_fds[e], &stop) != 0) {
+      t->valid[e] = 0;
+      continue;
+    }
+    if (!record)
+      continue;
+
+    // Scale the count if the kernel had to multiplex the counters.
+    const unsigned long long value   = stop.value        - t->start[e].value;
+    const unsigned long long enabled = stop.time_enabled - t->start[e].time_enabled;
+    const unsigned long long running = stop.time_running - t->start[e].time_running;
+    if (running > 0 && running < enabled)
+      t->count[e] += (unsigned long long)((double)value * enabled / running);
+    else
+      t->count[e] += value;
+  }
+#endif
+}
+
+static inline void __bench_perf_start(bench_perf_t* const perf)
+{
+  if (perf->thread == NULL)
+    return;
+
+#ifdef _OPENMP
+  // A nested team would not run on the threads of the enclosing one.
+  if (!omp_in_parallel()) {
+    #pragma omp parallel
+    {
+      __bench_perf_thread_start(perf, omp_get_thread_num());
+
+      #pragma omp master
+      if (perf->n_threads < (unsigned)omp_get_num_threads())
+        perf->n_threads = omp_get_num_threads();
+    }
+    return;
+  }
+#endif
+  __bench_perf_thread_start(perf, 0);
+  if (perf->n_threads < 1)
+    perf->n_threads = 1;
+}
+
+static inline void __bench_perf_stop(bench_perf_t* const perf, const int record)
+{
+  if (perf->thread == NULL)
+    return;
+
+#ifdef _OPENMP
+  if (!omp_in_parallel()) {
+    #pragma omp parallel
+    __bench_perf_thread_stop(perf, omp_get_thread_num(), record);
+    return;
+  }
+#endif
+  __bench_perf_thread_stop(perf, 0, record);
+}
+
+static inline void __bench_perf_finish(bench_perf_t* const perf, const unsigned n_samples)
+{
+  if (perf->thread == NULL)
+    return;
+
+  const unsigned n_threads = perf->n_threads < BENCH_MAX_THREADS ?
+    perf->n_threads : BENCH_MAX_THREADS;
+  for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+    double sum = 0;
+    perf->valid[e] = 0;
+    for (unsigned t = 0; t < n_threads; t++) {
+      perf->valid[e] |= perf->thread[t].valid[e];
+      sum += perf->thread[t].count[e];
+    }
+    perf->count[e] = n_samples > 0 ? sum / n_samples : 0;
+  }
+
+  if (!perf->valid[BENCH_PERF_CYCLES] && !bench_config.perf_warned) {
+    printf("WARNING: Hardware performance counters are not available on this host.\n");
+    bench_config.perf_warned = 1;
+  }
+}
+
+static inline void __bench_fprint_perf_value(FILE* const fp, const bench_perf_t* const perf,
+    const unsigned e, const char* const unavailable)
+{
+  if (perf->valid[e])
+    fprintf(fp, "%.0f", perf->count[e]);
+  else
+    fprintf(fp, "%s", unavailable);
+}
+
+static inline unsigned long long __ts_to_nsec(const struct timespec* const ts)
+{
+  return (unsigned long long)ts->tv_sec * 1000000000 + (unsigned long long)ts->tv_nsec;
+}
+
+static inline int __bench_cmp_double(const void* a, const void* b)
+{
+  const double x = *(const double*)a;
+  const double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static inline void __bench_fprint_json_str(FILE* const fp, const char* str)
 {
+  fputc('"', fp);
+  for (; *str != '\0'; str++) {
+    if (*str == '"' || *str == '\\')
+      fputc('\\', fp);
+    if ((unsigned char)*str >= 0x20)
+      fputc(*str, fp);
+  }
+  fputc('"', fp);
+}
+
+static inline void __bench_print_perf_counts(const char* const label, const int* const valid,
+    const double* const count)
+{
+  printf("%s:", label);
+  for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+    if (valid[e])
+      printf(" %s = %.0f", bench_perf_event_names[e], count[e]);
+    else
+      printf(" %s = n/a", bench_perf_event_names[e]);
+    printf(e < BENCH_PERF_N_EVENTS-1 ? "," : "");
+  }
+  // IPC and misses per kilo-instruction tell compute-bound from memory-bound code.
+  if (valid[BENCH_PERF_INSTRUCTIONS] && count[BENCH_PERF_INSTRUCTIONS] > 0) {
+    const double kinstr = count[BENCH_PERF_INSTRUCTIONS] / 1000;
+    if (valid[BENCH_PERF_CYCLES] && count[BENCH_PERF_CYCLES] > 0)
+      printf(" (IPC = %.2f", count[BENCH_PERF_INSTRUCTIONS] / count[BENCH_PERF_CYCLES]);
+    else
+      printf(" (IPC = n/a");
+    if (valid[BENCH_PERF_L1D_MISSES])
+      printf(", L1D MPKI = %.2f", count[BENCH_PERF_L1D_MISSES] / kinstr);
+    if (valid[BENCH_PERF_LLC_MISSES])
+      printf(", LLC MPKI = %.2f", count[BENCH_PERF_LLC_MISSES] / kinstr);
+    printf(")");
+  }
   printf("\n");
+}
+
+static inline void __bench_print_perf(const bench_region_t* const r)
+{
+  char label[64];
+  snprintf(label, sizeof(label), "Perf counters per rep (%u threads)", r->perf.n_threads);
+  __bench_print_perf_counts(label, r->perf.valid, r->perf.count);
+
+  if (bench_config.perf < 2)
+    return;
+  const unsigned n_samples = r->stats.n_samples > 0 ? r->stats.n_samples : 1;
+  for (unsigned t = 0; t < r->perf.n_threads && t < BENCH_MAX_THREADS; t++) {
+    double count[BENCH_PERF_N_EVENTS];
+    for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++)
+      count[e] = (double)r->perf.thread[t].count[e] / n_samples;
+    snprintf(label, sizeof(label), "  thread %u", t);
+    __bench_print_perf_counts(label, r->perf.thread[t].valid, count);
+  }
+}
+
+static inline void __bench_report(const bench_region_t* const r)
+{
+  const bench_stats_t* const s = &r->stats;
+  FILE* const fp = bench_config.fp;
+
+  flockfile(fp);
+  switch (bench_config.format) {
+    case BENCH_FORMAT_CSV:
+      if (!bench_config.csv_header_printed) {
+        fprintf(fp, "name,warmup,reps,min_ms,median_ms,p95_ms,max_ms,mean_ms,stddev_ms");
+        if (bench_config.perf) {
+          fprintf(fp, ",threads");
+          for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++)
+            fprintf(fp, ",%s", bench_perf_event_names[e]);
+        }
+        fprintf(fp, "\n");
+        bench_config.csv_header_printed = 1;
+      }
+      fputc('"', fp);
+      for (const char* c = r->name; *c != '\0'; c++) {
+        if (*c == '"')
+          fputc('"', fp);
+        fputc(*c, fp);
+      }
+      fprintf(fp, "\",%u,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f", r->n_warmup, s->n_samples,
+        s->min_ms, s->median_ms, s->p95_ms, s->max_ms, s->mean_ms, s->stddev_ms);
+      if (bench_config.perf) {
+        fprintf(fp, ",%u", r->perf.n_threads);
+        for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+          fputc(',', fp);
+          __bench_fprint_perf_value(fp, &r->perf, e, "");
+        }
+      }
+      fprintf(fp, "\n");
+      break;
+
+    case BENCH_FORMAT_JSON:
+      fprintf(fp, "{\"name\": ");
+      __bench_fprint_json_str(fp, r->name);
+      fprintf(fp, ", \"warmup\": %u, \"reps\": %u, \"min_ms\": %.6f, \"median_ms\": %.6f, "
+        "\"p95_ms\": %.6f, \"max_ms\": %.6f, \"mean_ms\": %.6f, \"stddev_ms\": %.6f",
+        r->n_warmup, s->n_samples, s->min_ms, s->median_ms, s->p95_ms, s->max_ms, s->mean_ms,
+        s->stddev_ms);
+      if (r->perf.thread != NULL) {
+        fprintf(fp, ", \"threads\": %u", r->perf.n_threads);
+        for (unsigned e = 0; e < BENCH_PERF_N_EVENTS; e++) {
+          fprintf(fp, ", \"%s\": ", bench_perf_event_names[e]);
+          __bench_fprint_perf_value(fp, &r->perf, e, "null");
+        }
+      }
+      fprintf(fp, "}\n");
+      break;
+
+    default:
+      if (s->n_samples == 1) {
+        if (bench_config.host_clk_freq_mhz == -EAGAIN && r->perf.thread == NULL)
+          bench_config.host_clk_freq_mhz = get_host_clk_freq_mhz();
+        if (r->perf.thread != NULL && r->perf.valid[BENCH_PERF_CYCLES]) {
+          printf("Execution time = %.3f ms (%.0f host cycles summed over %u threads)\n",
+            s->min_ms, r->perf.count[BENCH_PERF_CYCLES], r->perf.n_threads);
+        }
+        else if (bench_config.host_clk_freq_mhz > 0) {
+          // Only an estimate: the frequency may change during the measurement.
+          const unsigned long long host_cycles =
+            (unsigned long long)(s->min_ms * 1000) * bench_config.host_clk_freq_mhz;
+          printf("Execution time [host cycles, est. at %d MHz] = %llu (%.3f ms)\n",
+            bench_config.host_clk_freq_mhz, host_cycles, s->min_ms);
+        }
+        else {
+          printf("Execution time = %.3f ms\n", s->min_ms);
+        }
+      }
+      else {
+        printf("Execution time [ms] over %u reps (%u warmup): min = %.3f, median = %.3f, "
+          "p95 = %.3f, max = %.3f, mean = %.3f, stddev = %.3f\n", s->n_samples, r->n_warmup,
+          s->min_ms, s->median_ms, s->p95_ms, s->max_ms, s->mean_ms, s->stddev_ms);
+      }
+      if (r->perf.thread != NULL)
+        __bench_print_perf(r);
+      break;
+  }
+  fflush(fp);
+  funlockfile(fp);
+}
+
+static inline void bench_set_reps(const unsigned n_warmup, const unsigned n_reps)
+{
+  __bench_init();
+  bench_config.n_warmup = n_warmup;
+  bench_config.n_reps   = n_reps > 0 ? n_reps : 1;
+}
+
+static inline void bench_set_format(const bench_format_t format)
+{
+  __bench_init();
+  bench_config.format = format;
+}
+
+static inline void bench_set_perf(const int perf)
+{
+  __bench_init();
+  bench_config.perf = perf;
+}
+
+static inline void __bench_region_vinit(bench_region_t* const r, const char* const format,
+    va_list arg_ptr)
+{
+  __bench_init();
+  vsnprintf(r->name, BENCH_NAME_LEN, format, arg_ptr);
+  r->n_warmup   = bench_config.n_warmup;
+  r->n_reps     = bench_config.n_reps;
+  r->iter       = 0;
+  r->running    = 0;
+  r->samples_ms = &r->sample_ms;
+  memset((void*)&r->stats, 0, sizeof(r->stats));
+  memset((void*)&r->perf, 0, sizeof(r->perf));
+  if (bench_config.perf)
+    r->perf.thread = (bench_perf_thread_t*)calloc(BENCH_MAX_THREADS, sizeof(bench_perf_thread_t));
+  if (r->n_reps > 1) {
+    r->samples_ms = (double*)malloc(r->n_reps * sizeof(double));
+    if (r->samples_ms == NULL) {
+      printf("WARNING: Could not allocate samples for '%s', measuring once.\n", r->name);
+      r->samples_ms = &r->sample_ms;
+      r->n_reps     = 1;
+    }
+  }
+
+  if (bench_config.format == BENCH_FORMAT_TEXT)
+    printf("\n%s\n", r->name);
+}
+
+static inline void bench_region_init(bench_region_t* const r, const char* const format, ...)
+{
   va_list arg_ptr;
   va_start(arg_ptr, format);
-  vprintf(format, arg_ptr);
+  __bench_region_vinit(r, format, arg_ptr);
   va_end(arg_ptr);
-  printf("\n");
-  clock_gettime(CLOCK_MONOTONIC_RAW, &bench_ts_start);
 }
 
-static inline unsigned long long __ts_to_nsec(const struct timespec* const ts)
+static inline void bench_region_start(bench_region_t* const r)
 {
-  return (unsigned long long)ts->tv_sec * 1000000000 + (unsigned long long)ts->tv_nsec;
+  r->iter++;
+  r->running = 1;
+  __bench_perf_start(&r->perf);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &r->ts_start);
+}
+
+static inline double bench_region_stop(bench_region_t* const r)
+{
+  struct timespec ts_stop;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts_stop);
+  const double ms = (__ts_to_nsec(&ts_stop) - __ts_to_nsec(&r->ts_start)) / 1e6;
+  r->running = 0;
+
+  const int record = r->iter > r->n_warmup && r->stats.n_samples < r->n_reps;
+  __bench_perf_stop(&r->perf, record);
+  if (record)
+    r->samples_ms[r->stats.n_samples++] = ms;
+
+  return ms;
+}
+
+static inline int bench_region_next(bench_region_t* const r)
+{
+  if (r->running)
+    bench_region_stop(r);
+
+  if (r->iter < r->n_warmup + r->n_reps) {
+    bench_region_start(r);
+    return 1;
+  }
+
+  bench_region_finish(r);
+  return 0;
+}
+
+static inline void bench_region_finish(bench_region_t* const r)
+{
+  bench_stats_t* const s = &r->stats;
+  const unsigned n = s->n_samples;
+
+  if (n > 0) {
+    qsort(r->samples_ms, n, sizeof(double), __bench_cmp_double);
+
+    double sum = 0;
+    for (unsigned i = 0; i < n; i++)
+      sum += r->samples_ms[i];
+    const double mean = sum / n;
+
+    double sq_sum = 0;
+    for (unsigned i = 0; i < n; i++)
+      sq_sum += (r->samples_ms[i] - mean) * (r->samples_ms[i] - mean);
+
+    s->min_ms    = r->samples_ms[0];
+    s->max_ms    = r->samples_ms[n-1];
+    s->mean_ms   = mean;
+    s->median_ms = n % 2 ? r->samples_ms[n/2] : (r->samples_ms[n/2-1] + r->samples_ms[n/2]) / 2;
+    s->p95_ms    = r->samples_ms[(95*n + 99) / 100 - 1];
+    s->stddev_ms = n > 1 ? sqrt(sq_sum / (n-1)) : 0;
+  }
+
+  if (r->samples_ms != &r->sample_ms)
+    free(r->samples_ms);
+  r->samples_ms = NULL;
+
+  __bench_perf_finish(&r->perf, n);
+  __bench_report(r);
+
+  free(r->perf.thread);
+  r->perf.thread = NULL;
+}
+
+void bench_start(const char* const format, ...)
+{
+  if (bench_stack_depth >= BENCH_MAX_DEPTH) {
+    printf("ERROR: bench_start() nested deeper than %u levels!\n", BENCH_MAX_DEPTH);
+    return;
+  }
+  bench_region_t* const r = &bench_stack[bench_stack_depth++];
+
+  va_list arg_ptr;
+  va_start(arg_ptr, format);
+  __bench_init();
+  const unsigned n_warmup = bench_config.n_warmup;
+  const unsigned n_reps   = bench_config.n_reps;
+  bench_config.n_warmup = 0;
+  bench_config.n_reps   = 1;
+  __bench_region_vinit(r, format, arg_ptr);
+  bench_config.n_warmup = n_warmup;
+  bench_config.n_reps   = n_reps;
+  va_end(arg_ptr);
+
+  bench_region_start(r);
 }
 
 static inline double bench_stop()
 {
-  clock_gettime(CLOCK_MONOTONIC_RAW, &bench_ts_stop);
-  const unsigned long long ns = __ts_to_nsec(&bench_ts_stop) - __ts_to_nsec(&bench_ts_start);
-  const double ms = ns / 1e6;
-  const unsigned long long host_cycles = (ns / 1000) * get_host_clk_freq_mhz();
-  printf("Execution time [host cycles] = %llu (%.3f ms)\n", host_cycles, ms);
+  if (bench_stack_depth == 0) {
+    printf("ERROR: bench_stop() without matching bench_start()!\n");
+    return -1;
+  }
+  bench_region_t* const r = &bench_stack[--bench_stack_depth];
+
+  const double ms = bench_region_stop(r);
+  bench_region_finish(r);
   return ms;
 }
 
@@ -77,8 +779,7 @@ static int get_host_clk_freq_mhz()
   const char sysfs_path[] = "/sys/devices/system/cpu/cpufreq/policy0/cpuinfo_cur_freq";
   int ret = access(sysfs_path, F_OK);
   if (ret != 0) {
-    printf("ERROR: Could not access '%s'!\n", sysfs_path);
-    return ret;
+    return -ENOENT;
   }
 
   FILE* const fp = fopen(sysfs_path, "r");
@@ -90,6 +791,7 @@ static int get_host_clk_freq_mhz()
   char host_clk_freq_khz_str[20];
   if (fgets(host_clk_freq_khz_str, 20, fp) == NULL) {
     printf("ERROR: Could not read '%s'!\n", sysfs_path);
+    fclose(fp);
     return -EIO;
   }
   const unsigned host_clk_freq_mhz = (strtoul(host_clk_freq_khz_str, NULL, 10) + 1) / 1000;
@@ -1,6 +1,9 @@
+############## Host emulation (`make HERO_EMU=1 ...`, see common/libhero-target-emu)
+ifndef HERO_EMU
 ifndef PULP_SDK_HOME
 $(error PULP_SDK_HOME is not set)
 endif
+endif
 
 ifndef_any_of = $(filter undefined,$(foreach v,$(1),$(origin $(v))))
 
@@ -19,11 +22,31 @@ OBJDUMP = $(CROSS_COMPILE)objdump
 OPT     =-O3 -g3 -fopenmp
 #
 ############## Includes
+ifdef HERO_EMU
+HERO_EMU_DIR   = ../common/libhero-target-emu
+HERO_EMU_LIB   = $(HERO_EMU_DIR)/lib/libhero-target-emu.a
+HERO_EMU_CORES = 8
+CC             = gcc
+# offloaded code falls back to the host
+CFLAGS        := $(filter-out -foffload%,$(CFLAGS)) -foffload=disable
+INCDIR        += -I. -I../common -I$(HERO_EMU_DIR)/inc
+LDFLAGS       += -L$(HERO_EMU_DIR)/lib -lhero-target-emu -pthread -lm
+else
 INCDIR        += -I. -I../common -I${HERO_SDK_DIR}/libhero-target/inc
+LDFLAGS       += -L${HERO_SDK_DIR}/libhero-target/lib -lhero-target -lm
+endif
 COMMON_CFLAGS += ${INCDIR}
 CFLAGS        += $(OPT) -Wall $(COMMON_CFLAGS) ${EXT_DEF}
 ASFLAGS       += $(OPT) $(COMMON_CFLAGS)
-LDFLAGS       += -L${HERO_SDK_DIR}/libhero-target/lib -lhero-target
+
+############## Element type of the matrix examples (`make MM_TYPE=int8 ...`, see mm-types.h)
+ifdef MM_TYPE
+CFLAGS        += -DMM_TYPE=MM_$(shell echo $(MM_TYPE) | tr a-z A-Z)
+endif
+
+############## Benchmark settings forwarded to the target (see bench.h, mm-large, verify.h)
+BENCH_VARS = BENCH_WARMUP BENCH_REPS BENCH_FORMAT BENCH_OUTPUT BENCH_PERF MM_SPLIT_FILE VERIFY_MODE
+BENCH_ENV  = $(foreach v,$(BENCH_VARS),$(if $($(v)),export $(v)=$($(v));))
 
 ############################ OBJECTS ###################################
 COBJS  = $(CSRCS:.c=.o)
@@ -32,13 +55,24 @@ OBJS = $(COBJS) $(ASOBJS)
 
 all: $(EXE)
 
-$(EXE): $(OBJS)
+$(EXE): $(OBJS) $(HERO_EMU_LIB)
 	$(CC) $(CFLAGS) $(OBJS) $(LDFLAGS) -o $@
 
-.PHONY: clean prepare run
+.PHONY: clean prepare run FORCE
 clean::
 	rm -rf *.o *~ $(EXE) $(OBJS) offload.bin offload.so
 
+ifdef HERO_EMU
+$(HERO_EMU_LIB): FORCE
+	$(MAKE) -C $(HERO_EMU_DIR)
+
+prepare:: $(EXE)
+
+# The emulated cluster runs one OpenMP thread per PULP core.
+run:: prepare $(EXE)
+	$(BENCH_ENV) export OMP_NUM_THREADS=$(HERO_EMU_CORES); ./$(EXE) $(RUN_ARGS)
+else
+
 init-target-host:
 ifndef HERO_TARGET_HOST
 $(error HERO_TARGET_HOST is not set)
@@ -56,7 +90,8 @@ endif
 
 run:: prepare $(EXE)
 ifeq ($(call ifndef_any_of,HERO_TARGET_HOST HERO_TARGET_PATH_APPS HERO_TARGET_PATH_LIB),)
-	ssh -t $(HERO_TARGET_HOST) 'export LD_LIBRARY_PATH='"'$(HERO_TARGET_PATH_LIB)'"'; cd ${HERO_TARGET_PATH_APPS}; ./$(EXE) $(RUN_ARGS)'
+	ssh -t $(HERO_TARGET_HOST) 'export LD_LIBRARY_PATH='"'$(HERO_TARGET_PATH_LIB)'"'; $(BENCH_ENV) cd ${HERO_TARGET_PATH_APPS}; ./$(EXE) $(RUN_ARGS)'
 else
 $(error HERO_TARGET_HOST and/or HERO_TARGET_PATH_APPS is not set)
 endif
+endif
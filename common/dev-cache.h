@@ -0,0 +1,194 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DEV_CACHE_H__
+#define __DEV_CACHE_H__
+
+#include <errno.h>    // error codes
+#include <stddef.h>   // size_t
+#include <stdint.h>   // uint8_t
+#include <stdio.h>    // printf()
+
+/*
+ * Cache of device-resident input buffers
+ *
+ * Every `#pragma omp target` with a `map(to: ...)` clause copies its inputs to the device, also if
+ * the previous target region worked on the very same, unchanged data.  The cache keeps inputs in
+ * the device data environment (`target enter data`) across target regions instead.  Its entries
+ * are keyed by device and host pointer and carry a version that the caller increments whenever it
+ * modifies the host copy:
+ *
+ *   dev_cache_t cache;
+ *   dev_cache_init(&cache);
+ *   ...
+ *   dev_cache_map_to(&cache, BIGPULP_MEMCPY, a, a_size_b, a_version);
+ *   #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:a_size])
+ *   ...
+ *   dev_cache_print(&cache, "Device cache");
+ *   dev_cache_release_all(&cache);
+ *
+ * As the buffer is present in the device data environment, the `map(to: ...)` clause of the target
+ * region does not copy it again; it stays correct if the buffer is not cached (e.g., because the
+ * cache is full).  An entry is copied on its first use and whenever its version or size changes;
+ * every other use counts as a hit, and its size as bytes saved.
+ *
+ * The cache is owned by the caller and is not thread-safe.
+ */
+
+#ifndef DEV_CACHE_MAX_ENTRIES
+  #define DEV_CACHE_MAX_ENTRIES 16
+#endif
+
+typedef struct {
+  int       device;
+  uint8_t*  host;
+  size_t    size_b;
+  unsigned  version;
+} dev_cache_entry_t;
+
+typedef struct {
+  dev_cache_entry_t  entries[DEV_CACHE_MAX_ENTRIES];
+  unsigned           n_entries;
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long bytes_copied;   // copied to the device on misses
+  unsigned long long bytes_saved;    // not copied thanks to hits
+} dev_cache_t;
+
+/**
+ * Initialize an empty cache.
+ */
+static inline void dev_cache_init(dev_cache_t* cache);
+
+/**
+ * Make the `size_b` bytes at `host` present on `device` in version `version`, copying them only if
+ * the device holds no or an outdated copy.
+ *
+ * @return  1 on a hit; 0 if the buffer has been copied; -ENOMEM if the cache is full (the buffer
+ *          is then left to the map clauses of the target regions).
+ */
+static inline int dev_cache_map_to(dev_cache_t* cache, int device, const void* host, size_t size_b,
+    unsigned version);
+
+/**
+ * Remove a buffer from `device`.  Does nothing if it is not cached.
+ */
+static inline void dev_cache_release(dev_cache_t* cache, int device, const void* host);
+
+/**
+ * Remove all buffers from their devices.
+ */
+static inline void dev_cache_release_all(dev_cache_t* cache);
+
+/**
+ * Print the hits, misses, copied and saved bytes, prefixed by a label.
+ */
+static inline void dev_cache_print(const dev_cache_t* cache, const char* label);
+
+static inline void __dev_cache_enter(const int device, uint8_t* const host, const size_t size_b)
+{
+  #pragma omp target enter data device(device) map(to: host[0:size_b])
+}
+
+static inline void __dev_cache_update(const int device, uint8_t* const host, const size_t size_b)
+{
+  #pragma omp target update device(device) to(host[0:size_b])
+}
+
+static inline void __dev_cache_exit(const int device, uint8_t* const host, const size_t size_b)
+{
+  #pragma omp target exit data device(device) map(release: host[0:size_b])
+}
+
+static inline void dev_cache_init(dev_cache_t* const cache)
+{
+  cache->n_entries    = 0;
+  cache->hits         = 0;
+  cache->misses       = 0;
+  cache->bytes_copied = 0;
+  cache->bytes_saved  = 0;
+}
+
+static inline int dev_cache_map_to(dev_cache_t* const cache, const int device,
+    const void* const host, const size_t size_b, const unsigned version)
+{
+  dev_cache_entry_t* e = NULL;
+  for (unsigned i=0; i<cache->n_entries; i++) {
+    if ( (cache->entries[i].device == device) && (cache->entries[i].host == host) ) {
+      e = &cache->entries[i];
+      break;
+    }
+  }
+
+  if ( (e != NULL) && (e->size_b == size_b) && (e->version == version) ) {
+    cache->hits++;
+    cache->bytes_saved += size_b;
+    return 1;
+  }
+
+  if ( (e != NULL) && (e->size_b == size_b) ) {
+    // outdated copy
+    __dev_cache_update(device, e->host, size_b);
+  }
+  else {
+    if (e != NULL) {
+      // the buffer has been resized
+      __dev_cache_exit(e->device, e->host, e->size_b);
+    }
+    else if (cache->n_entries == DEV_CACHE_MAX_ENTRIES) {
+      return -ENOMEM;
+    }
+    else {
+      e = &cache->entries[cache->n_entries++];
+    }
+    e->device = device;
+    e->host   = (uint8_t*)host;
+    e->size_b = size_b;
+    __dev_cache_enter(device, e->host, size_b);
+  }
+  e->version = version;
+
+  cache->misses++;
+  cache->bytes_copied += size_b;
+  return 0;
+}
+
+static inline void dev_cache_release(dev_cache_t* const cache, const int device,
+    const void* const host)
+{
+  for (unsigned i=0; i<cache->n_entries; i++) {
+    if ( (cache->entries[i].device == device) && (cache->entries[i].host == host) ) {
+      __dev_cache_exit(device, cache->entries[i].host, cache->entries[i].size_b);
+      cache->entries[i] = cache->entries[--cache->n_entries];
+      return;
+    }
+  }
+}
+
+static inline void dev_cache_release_all(dev_cache_t* const cache)
+{
+  for (unsigned i=0; i<cache->n_entries; i++)
+    __dev_cache_exit(cache->entries[i].device, cache->entries[i].host, cache->entries[i].size_b);
+  cache->n_entries = 0;
+}
+
+static inline void dev_cache_print(const dev_cache_t* const cache, const char* const label)
+{
+  printf("%s: %llu hits, %llu misses, %.2f KiB copied, %.2f KiB saved\n", label, cache->hits,
+    cache->misses, (double)cache->bytes_copied/1024, (double)cache->bytes_saved/1024);
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * HERO Target API - Host Emulation
+ *
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HERO_TARGET_H__
+#define __HERO_TARGET_H__
+
+#include <stdint.h>
+
+/*
+ * Drop-in replacement for the `hero-target.h` of `libhero-target` that runs on any Linux host.
+ * Offloaded code falls back to the host, the L1 and L2 scratchpads are bounded arenas of the real
+ * capacity, and the DMA engine is a background thread that copies with a configurable bandwidth
+ * and latency.  See `README.md` for the environment variables.
+ */
+#define HERO_EMU 1
+
+#define BIGPULP_SVM     (0)
+#define BIGPULP_MEMCPY  (1)
+#define HOST            (2)
+
+#define ALIGNED(x) __attribute__((aligned(x)))
+
+typedef uint32_t hero_dma_job_t;
+
+#pragma omp declare target
+
+/**
+ * Start an asynchronous DMA transfer.
+ *
+ * @return  Job identifier to be passed to `hero_dma_wait()`.
+ */
+hero_dma_job_t hero_dma_memcpy_async(void* dst, void* src, int size);
+
+/**
+ * Perform a DMA transfer and wait for it to complete.
+ */
+void hero_dma_memcpy(void* dst, void* src, int size);
+
+/**
+ * Wait for a DMA transfer (and all transfers started before it) to complete.
+ */
+void hero_dma_wait(hero_dma_job_t id);
+
+#define memcpy_to_dram(dst, src, size)    hero_dma_memcpy(dst, src, size)
+#define memcpy_from_dram(dst, src, size)  hero_dma_memcpy(dst, src, size)
+
+/**
+ * Allocate memory in the L1 or L2 scratchpad.
+ *
+ * @return  Pointer to the allocated memory; NULL if the scratchpad is exhausted.
+ */
+void* hero_l1malloc(int size);
+void* hero_l2malloc(int size);
+
+/**
+ * Free memory allocated in the L1 or L2 scratchpad.
+ */
+void hero_l1free(void* a);
+void hero_l2free(void* a);
+
+int  hero_rt_core_id(void);
+int  hero_get_clk_counter(void);
+void hero_reset_clk_counter(void);
+
+/**
+ * Read from or write to shared virtual memory.
+ */
+unsigned int hero_tryread(const unsigned int* const addr);
+int          hero_tryread_prefetch(const unsigned int* const addr);
+void         hero_trywrite(unsigned int* const addr, const unsigned int val);
+int          hero_trywrite_prefetch(unsigned int* const addr);
+int          hero_handle_rab_misses(void);
+
+#pragma omp end declare target
+
+/*
+ * Emulation-only API
+ */
+
+typedef struct {
+  unsigned long long dma_jobs;
+  unsigned long long dma_bytes_in;      // into an L1 or L2 arena
+  unsigned long long dma_bytes_out;     // out of an L1 or L2 arena
+  unsigned long long dma_bytes_other;   // between two external buffers
+  unsigned long long dma_waits;
+  unsigned long long dma_wait_ns;       // time spent in `hero_dma_wait()`, summed over all cores
+  unsigned long long l1_peak_b;
+  unsigned long long l1_alloc_failures;
+  unsigned long long tryreads;
+  unsigned long long trywrites;
+} hero_emu_stats_t;
+
+/**
+ * Get the emulation counters accumulated since the start or the last `hero_emu_reset_stats()`.
+ */
+void hero_emu_get_stats(hero_emu_stats_t* stats);
+
+/**
+ * Reset the emulation counters.
+ */
+void hero_emu_reset_stats(void);
+
+/**
+ * Print the emulation counters, prefixed by a label.
+ */
+void hero_emu_print_stats(const char* label);
+
+/**
+ * Get the capacity of the emulated L1 scratchpad, in bytes.
+ */
+unsigned hero_emu_l1_size(void);
+
+#endif
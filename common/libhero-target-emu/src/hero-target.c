@@ -0,0 +1,485 @@
+/*
+ * HERO Target API - Host Emulation
+ *
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <omp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hero-target.h"
+
+#define L1_SIZE_B_DEFAULT   (256*1024)
+#define L2_SIZE_B_DEFAULT   (64*1024)
+#define ARENA_ALIGN_B       8
+#define DMA_QUEUE_LEN       16          // outstanding transfers before `*_async()` blocks
+#define SPIN_THRESHOLD_NS   20000       // sleep shorter than this by spinning
+
+static unsigned long env_ulong(const char* const name, const unsigned long def)
+{
+  const char* const str = getenv(name);
+  if (str == NULL || *str == '\0')
+    return def;
+  return strtoul(str, NULL, 0);
+}
+
+static unsigned long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void wait_until_ns(const unsigned long long t_ns)
+{
+  unsigned long long t_now = now_ns();
+  if (t_now >= t_ns)
+    return;
+
+  if (t_ns - t_now > SPIN_THRESHOLD_NS) {
+    const unsigned long long t_sleep = t_ns - SPIN_THRESHOLD_NS / 2;
+    struct timespec ts = { .tv_sec = t_sleep / 1000000000, .tv_nsec = t_sleep % 1000000000 };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+  while (now_ns() < t_ns)
+    ;
+}
+
+static hero_emu_stats_t stats;
+
+#define STATS_ADD(field, val) __atomic_fetch_add(&stats.field, (val), __ATOMIC_RELAXED)
+
+/*
+ * Scratchpad arenas
+ *
+ * First-fit allocators over a fixed-size buffer.  The block descriptors are kept outside of the
+ * buffer, so the full capacity is available to the application.
+ */
+
+typedef struct arena_block arena_block_t;
+
+struct arena_block {
+  size_t         offset;
+  size_t         size;
+  int            free;
+  arena_block_t* prev;
+  arena_block_t* next;
+};
+
+typedef struct {
+  const char*     name;
+  const char*     env;
+  size_t          size_default;
+  pthread_mutex_t lock;
+  unsigned char*  base;
+  size_t          size;
+  size_t          used;
+  size_t          peak;
+  arena_block_t*  head;
+} arena_t;
+
+static arena_t l1 = { "L1", "HERO_EMU_L1_SIZE", L1_SIZE_B_DEFAULT, PTHREAD_MUTEX_INITIALIZER };
+static arena_t l2 = { "L2", "HERO_EMU_L2_SIZE", L2_SIZE_B_DEFAULT, PTHREAD_MUTEX_INITIALIZER };
+
+// Must be called with the arena locked.
+static int arena_init(arena_t* const a)
+{
+  if (a->base != NULL)
+    return 0;
+
+  a->size = env_ulong(a->env, a->size_default);
+  a->base = (unsigned char*)aligned_alloc(64, (a->size + 63) & ~(size_t)63);
+  a->head = (arena_block_t*)calloc(1, sizeof(arena_block_t));
+  if (a->base == NULL || a->head == NULL) {
+    printf("ERROR: Could not allocate the emulated %s memory!\n", a->name);
+    return -1;
+  }
+  a->head->size = a->size;
+  a->head->free = 1;
+  return 0;
+}
+
+static int arena_contains(const arena_t* const a, const void* const ptr)
+{
+  return a->base != NULL && (const unsigned char*)ptr >= a->base
+    && (const unsigned char*)ptr < a->base + a->size;
+}
+
+static void* arena_malloc(arena_t* const a, const int size)
+{
+  void* ptr = NULL;
+  if (size <= 0)
+    return NULL;
+  const size_t size_b = ((size_t)size + ARENA_ALIGN_B - 1) & ~(size_t)(ARENA_ALIGN_B - 1);
+
+  pthread_mutex_lock(&a->lock);
+  if (arena_init(a) != 0)
+    goto unlock;
+
+  for (arena_block_t* b = a->head; b != NULL; b = b->next) {
+    if (!b->free || b->size < size_b)
+      continue;
+
+    if (b->size > size_b) {
+      arena_block_t* const rest = (arena_block_t*)malloc(sizeof(arena_block_t));
+      if (rest == NULL)
+        goto unlock;
+      rest->offset = b->offset + size_b;
+      rest->size   = b->size - size_b;
+      rest->free   = 1;
+      rest->prev   = b;
+      rest->next   = b->next;
+      if (b->next != NULL)
+        b->next->prev = rest;
+      b->next = rest;
+      b->size = size_b;
+    }
+    b->free = 0;
+    a->used += size_b;
+    if (a->used > a->peak)
+      a->peak = a->used;
+    ptr = a->base + b->offset;
+    break;
+  }
+
+unlock:
+  pthread_mutex_unlock(&a->lock);
+  return ptr;
+}
+
+static void arena_free(arena_t* const a, void* const ptr)
+{
+  if (ptr == NULL)
+    return;
+
+  pthread_mutex_lock(&a->lock);
+  arena_block_t* b = a->head;
+  while (b != NULL && (b->free || a->base + b->offset != (unsigned char*)ptr))
+    b = b->next;
+  if (b == NULL) {
+    printf("ERROR: Invalid free of %p in the emulated %s memory!\n", ptr, a->name);
+    pthread_mutex_unlock(&a->lock);
+    return;
+  }
+
+  b->free = 1;
+  a->used -= b->size;
+
+  // coalesce with free neighbors
+  if (b->next != NULL && b->next->free) {
+    arena_block_t* const next = b->next;
+    b->size += next->size;
+    b->next  = next->next;
+    if (next->next != NULL)
+      next->next->prev = b;
+    free(next);
+  }
+  if (b->prev != NULL && b->prev->free) {
+    arena_block_t* const prev = b->prev;
+    prev->size += b->size;
+    prev->next  = b->next;
+    if (b->next != NULL)
+      b->next->prev = prev;
+    free(b);
+  }
+  pthread_mutex_unlock(&a->lock);
+}
+
+void* hero_l1malloc(int size)
+{
+  void* const ptr = arena_malloc(&l1, size);
+  if (ptr == NULL)
+    STATS_ADD(l1_alloc_failures, 1);
+  return ptr;
+}
+
+void* hero_l2malloc(int size)
+{
+  return arena_malloc(&l2, size);
+}
+
+void hero_l1free(void* a)
+{
+  arena_free(&l1, a);
+}
+
+void hero_l2free(void* a)
+{
+  arena_free(&l2, a);
+}
+
+unsigned hero_emu_l1_size(void)
+{
+  pthread_mutex_lock(&l1.lock);
+  arena_init(&l1);
+  pthread_mutex_unlock(&l1.lock);
+  return l1.size;
+}
+
+/*
+ * DMA engine
+ *
+ * Transfers are processed in order by a single background thread.  Each transfer occupies the
+ * engine for `size / bandwidth` and completes `latency` later, so the latency of back-to-back
+ * transfers overlaps like on the real engine: the engine copies the data, records the completion
+ * time, and moves on to the next transfer, while `hero_dma_wait()` waits for the completion time.
+ * A transfer stays outstanding until it has completed.
+ */
+
+typedef struct {
+  void*       dst;
+  const void* src;
+  size_t      size;
+} dma_req_t;
+
+static struct {
+  pthread_once_t     once;
+  pthread_mutex_t    lock;
+  pthread_cond_t     cond_submit;
+  pthread_cond_t     cond_done;
+  dma_req_t          queue[DMA_QUEUE_LEN];
+  unsigned long long t_done_ns[DMA_QUEUE_LEN];   // completion time of the copied transfers
+  unsigned long long n_submitted;
+  unsigned long long n_copied;
+  double             ns_per_b;
+  unsigned long long latency_ns;
+  unsigned long long t_free_ns;   // when the engine has finished the last transfer
+} dma = {
+  .once        = PTHREAD_ONCE_INIT,
+  .lock        = PTHREAD_MUTEX_INITIALIZER,
+  .cond_submit = PTHREAD_COND_INITIALIZER,
+  .cond_done   = PTHREAD_COND_INITIALIZER,
+};
+
+static void* dma_engine(void* arg)
+{
+  (void)arg;
+  for (;;) {
+    pthread_mutex_lock(&dma.lock);
+    while (dma.n_copied == dma.n_submitted)
+      pthread_cond_wait(&dma.cond_submit, &dma.lock);
+    const dma_req_t req = dma.queue[dma.n_copied % DMA_QUEUE_LEN];
+    pthread_mutex_unlock(&dma.lock);
+
+    unsigned long long t_done_ns = 0;
+    if (dma.ns_per_b > 0 || dma.latency_ns > 0) {
+      const unsigned long long t_now_ns = now_ns();
+      const unsigned long long t_start_ns = dma.t_free_ns > t_now_ns ? dma.t_free_ns : t_now_ns;
+      dma.t_free_ns = t_start_ns + (unsigned long long)(req.size * dma.ns_per_b);
+      t_done_ns     = dma.t_free_ns + dma.latency_ns;
+    }
+
+    memmove(req.dst, req.src, req.size);
+    wait_until_ns(dma.t_free_ns);
+
+    pthread_mutex_lock(&dma.lock);
+    dma.t_done_ns[dma.n_copied % DMA_QUEUE_LEN] = t_done_ns;
+    dma.n_copied++;
+    pthread_cond_broadcast(&dma.cond_done);
+    pthread_mutex_unlock(&dma.lock);
+  }
+  return NULL;
+}
+
+static void hero_emu_print_stats_at_exit(void)
+{
+  hero_emu_print_stats("HERO emulation");
+}
+
+static void dma_init(void)
+{
+  // bandwidth in MB/s (0: unlimited), latency in ns
+  const unsigned long bw_mbps = env_ulong("HERO_EMU_DMA_BW", 0);
+  dma.ns_per_b   = bw_mbps > 0 ? 1e3 / bw_mbps : 0;
+  dma.latency_ns = env_ulong("HERO_EMU_DMA_LATENCY", 0);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, dma_engine, NULL) != 0) {
+    printf("ERROR: Could not start the emulated DMA engine!\n");
+    exit(-1);
+  }
+  pthread_detach(thread);
+
+  if (env_ulong("HERO_EMU_STATS", 0))
+    atexit(hero_emu_print_stats_at_exit);
+}
+
+hero_dma_job_t hero_dma_memcpy_async(void* dst, void* src, int size)
+{
+  pthread_once(&dma.once, dma_init);
+
+  if (arena_contains(&l1, dst) || arena_contains(&l2, dst))
+    STATS_ADD(dma_bytes_in, size);
+  else if (arena_contains(&l1, src) || arena_contains(&l2, src))
+    STATS_ADD(dma_bytes_out, size);
+  else
+    STATS_ADD(dma_bytes_other, size);
+  STATS_ADD(dma_jobs, 1);
+
+  pthread_mutex_lock(&dma.lock);
+  // The slot is free once the transfer DMA_QUEUE_LEN before has been copied and has completed.
+  for (;;) {
+    while (dma.n_submitted - dma.n_copied >= DMA_QUEUE_LEN)
+      pthread_cond_wait(&dma.cond_done, &dma.lock);
+    if (dma.n_submitted < DMA_QUEUE_LEN)
+      break;
+    const unsigned long long t_done_ns = dma.t_done_ns[dma.n_submitted % DMA_QUEUE_LEN];
+    if (now_ns() >= t_done_ns)
+      break;
+    pthread_mutex_unlock(&dma.lock);
+    wait_until_ns(t_done_ns);
+    pthread_mutex_lock(&dma.lock);
+  }
+  const hero_dma_job_t id = (hero_dma_job_t)dma.n_submitted;
+  dma.queue[dma.n_submitted % DMA_QUEUE_LEN] = (dma_req_t){ dst, src, size > 0 ? size : 0 };
+  dma.n_submitted++;
+  pthread_cond_signal(&dma.cond_submit);
+  pthread_mutex_unlock(&dma.lock);
+
+  return id;
+}
+
+void hero_dma_wait(hero_dma_job_t id)
+{
+  pthread_once(&dma.once, dma_init);
+
+  const unsigned long long t_start_ns = now_ns();
+  pthread_mutex_lock(&dma.lock);
+  // Job identifiers wrap around; the job has been copied once the copy counter has passed it.
+  while ((int32_t)((hero_dma_job_t)dma.n_copied - id) <= 0)
+    pthread_cond_wait(&dma.cond_done, &dma.lock);
+  // Completion times grow monotonically, so a slot reused by a later job only waits longer.
+  const unsigned long long t_done_ns = dma.t_done_ns[id % DMA_QUEUE_LEN];
+  pthread_mutex_unlock(&dma.lock);
+  wait_until_ns(t_done_ns);
+
+  STATS_ADD(dma_waits, 1);
+  STATS_ADD(dma_wait_ns, now_ns() - t_start_ns);
+}
+
+void hero_dma_memcpy(void* dst, void* src, int size)
+{
+  hero_dma_wait(hero_dma_memcpy_async(dst, src, size));
+}
+
+/*
+ * Runtime
+ */
+
+static unsigned long long clk_reset_ns;
+
+int hero_rt_core_id(void)
+{
+  return omp_get_thread_num();
+}
+
+int hero_get_clk_counter(void)
+{
+  // nominal cluster clock in MHz
+  const unsigned long clk_mhz = env_ulong("HERO_EMU_CLK_MHZ", 50);
+  return (int)((now_ns() - clk_reset_ns) * clk_mhz / 1000);
+}
+
+void hero_reset_clk_counter(void)
+{
+  clk_reset_ns = now_ns();
+}
+
+/*
+ * Shared virtual memory
+ */
+
+static pthread_once_t     svm_once = PTHREAD_ONCE_INIT;
+static unsigned long long svm_latency_ns;
+
+static void svm_init(void)
+{
+  svm_latency_ns = env_ulong("HERO_EMU_SVM_LATENCY", 0);
+}
+
+/*
+ * Stall for the latency of an access to shared virtual memory.
+ */
+static inline void svm_stall(void)
+{
+  pthread_once(&svm_once, svm_init);
+  if (svm_latency_ns > 0)
+    wait_until_ns(now_ns() + svm_latency_ns);
+}
+
+unsigned int hero_tryread(const unsigned int* const addr)
+{
+  STATS_ADD(tryreads, 1);
+  svm_stall();
+  return *(const volatile unsigned int*)addr;
+}
+
+int hero_tryread_prefetch(const unsigned int* const addr)
+{
+  (void)addr;
+  return 0;
+}
+
+void hero_trywrite(unsigned int* const addr, const unsigned int val)
+{
+  STATS_ADD(trywrites, 1);
+  svm_stall();
+  *(volatile unsigned int*)addr = val;
+}
+
+int hero_trywrite_prefetch(unsigned int* const addr)
+{
+  (void)addr;
+  return 0;
+}
+
+int hero_handle_rab_misses(void)
+{
+  return 0;
+}
+
+/*
+ * Statistics
+ */
+
+void hero_emu_get_stats(hero_emu_stats_t* const s)
+{
+  memcpy((void*)s, (const void*)&stats, sizeof(*s));
+  pthread_mutex_lock(&l1.lock);
+  s->l1_peak_b = l1.peak;
+  pthread_mutex_unlock(&l1.lock);
+}
+
+void hero_emu_reset_stats(void)
+{
+  memset((void*)&stats, 0, sizeof(stats));
+  pthread_mutex_lock(&l1.lock);
+  l1.peak = l1.used;
+  pthread_mutex_unlock(&l1.lock);
+}
+
+void hero_emu_print_stats(const char* const label)
+{
+  hero_emu_stats_t s;
+  hero_emu_get_stats(&s);
+  printf("%s: DMA: %llu jobs, %.2f KiB in, %.2f KiB out, %.2f KiB ext-to-ext, "
+    "%llu waits (%.3f ms); L1: %.2f KiB peak, %llu failed allocations; SVM: %llu reads, "
+    "%llu writes\n", label, s.dma_jobs, s.dma_bytes_in / 1024., s.dma_bytes_out / 1024.,
+    s.dma_bytes_other / 1024., s.dma_waits, s.dma_wait_ns / 1e6, s.l1_peak_b / 1024.,
+    s.l1_alloc_failures, s.tryreads, s.trywrites);
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MM_HOST_H__
+#define __MM_HOST_H__
+
+#include <errno.h>    // error codes
+#include <stdlib.h>   // malloc(), free()
+#include "mm-kernel.h"
+#include "mm-types.h"
+
+/*
+ * Parallel, cache-oblivious matrix multiplication on the host
+ *
+ * `mm_host()` computes C = A * B with the operand layout of `mm-kernel.h` (A row-major, B given as
+ * its transpose).  The problem is split recursively along its largest dimension until a block
+ * needs at most MM_HOST_LEAF_OPS multiply-adds, which the register-tiled micro-kernel computes.
+ * As every split halves the working set, the blocks fit into every cache level at some depth of
+ * the recursion without knowing the cache sizes.  Splits of M and N create two independent OpenMP
+ * tasks; the halves of a K split accumulate into the same block of C and run one after the other.
+ *
+ * Optionally, sub-problems whose three dimensions are even and at least `strassen_min` are split
+ * with one step of Strassen's algorithm instead, i.e., 7 instead of 8 half-size products (computed
+ * as parallel tasks) at the price of temporary buffers and additions.  Strassen's algorithm adds
+ * and subtracts operands, so it is only available if elements and accumulators have the same type
+ * (MM_HOST_STRASSEN); the operand sums of the narrow types would overflow.  If the temporary
+ * buffers cannot be allocated, the sub-problem is split like without Strassen.
+ */
+
+#ifndef MM_HOST_LEAF_OPS
+  #define MM_HOST_LEAF_OPS (64*64*64)  // largest block computed by the micro-kernel
+#endif
+#ifndef MM_HOST_STRASSEN_MIN
+  #define MM_HOST_STRASSEN_MIN 128     // default `strassen_min` of the examples
+#endif
+
+#if (MM_TYPE == MM_INT32) || (MM_TYPE == MM_FLOAT)
+  #define MM_HOST_STRASSEN 1
+#else
+  #define MM_HOST_STRASSEN 0
+#endif
+
+/**
+ * Compute C = A * B (m x n x k) with all threads of a new parallel region.  Overwritten elements of
+ * C are complete and passed through mm_output().
+ *
+ * @param accumulate    Add the sums of products to C instead of overwriting it.
+ * @param strassen_min  Smallest dimension that Strassen's algorithm is applied to; 0 disables it.
+ *                      Ignored unless MM_HOST_STRASSEN.
+ */
+static inline void mm_host(unsigned m, unsigned n, unsigned k, const mm_elem_t* a, unsigned lda,
+    const mm_elem_t* bt, unsigned ldb, mm_acc_t* c, unsigned ldc, int accumulate,
+    unsigned strassen_min);
+
+/**
+ * Compute C = A * B (m x n x k) recursively, leaving the sums of products in C.  Must be called
+ * from within a parallel region; the sub-problems are distributed over the team as tasks.
+ */
+static inline void mm_host_rec(unsigned m, unsigned n, unsigned k, const mm_elem_t* a,
+    unsigned lda, const mm_elem_t* bt, unsigned ldb, mm_acc_t* c, unsigned ldc, int accumulate,
+    unsigned strassen_min);
+
+/*
+ * Split point of a dimension: about half of it, rounded up to full micro-kernel blocks.
+ */
+static inline unsigned __mm_host_half(const unsigned dim)
+{
+  const unsigned half = (dim/2 + MM_KERNEL_MR-1) / MM_KERNEL_MR * MM_KERNEL_MR;
+  return half < dim ? half : dim/2;
+}
+
+#if MM_HOST_STRASSEN
+
+/*
+ * out = x + sign * y for rows x cols blocks; y is not read if sign is 0.
+ */
+static inline void __mm_host_add(const unsigned rows, const unsigned cols,
+    const mm_elem_t* const x, const unsigned ldx, const mm_elem_t* const y, const unsigned ldy,
+    const int sign, mm_elem_t* const out, const unsigned ldo)
+{
+  for (unsigned i=0; i<rows; i++) {
+    for (unsigned j=0; j<cols; j++) {
+      if (sign > 0)
+        out[i*ldo+j] = x[i*ldx+j] + y[i*ldy+j];
+      else if (sign < 0)
+        out[i*ldo+j] = x[i*ldx+j] - y[i*ldy+j];
+      else
+        out[i*ldo+j] = x[i*ldx+j];
+    }
+  }
+}
+
+/*
+ * One Strassen step.  With the blocks of B^T, B11^T = BT11, B12^T = BT21, B21^T = BT12 and
+ * B22^T = BT22, the seven products are
+ *
+ *   M1 = (A11 + A22) (B11 + B22)    M5 = (A11 + A12) B22
+ *   M2 = (A21 + A22) B11            M6 = (A21 - A11) (B11 + B12)
+ *   M3 = A11 (B12 - B22)            M7 = (A12 - A22) (B21 + B22)
+ *   M4 = A22 (B21 - B11)
+ *
+ * and C11 = M1 + M4 - M5 + M7, C12 = M3 + M5, C21 = M2 + M4, C22 = M1 - M2 + M3 + M6.
+ *
+ * @return  0 on success; -ENOMEM if the temporary buffers cannot be allocated.
+ */
+static inline int __mm_host_strassen(const unsigned m, const unsigned n, const unsigned k,
+    const mm_elem_t* const a, const unsigned lda, const mm_elem_t* const bt, const unsigned ldb,
+    mm_acc_t* const c, const unsigned ldc, const int accumulate, const unsigned strassen_min)
+{
+  const unsigned hm = m/2, hn = n/2, hk = k/2;
+  const size_t   s_size = (size_t)hm*hk, t_size = (size_t)hn*hk, p_size = (size_t)hm*hn;
+
+  mm_elem_t* const st = (mm_elem_t*)malloc(7*(s_size + t_size)*sizeof(mm_elem_t));
+  mm_acc_t* const  p  = (mm_acc_t*)malloc(7*p_size*sizeof(mm_acc_t));
+  if ( (st == NULL) || (p == NULL) ) {
+    free(st);
+    free(p);
+    return -ENOMEM;
+  }
+
+  const mm_elem_t* const a11 = a;
+  const mm_elem_t* const a12 = a + hk;
+  const mm_elem_t* const a21 = a + hm*lda;
+  const mm_elem_t* const a22 = a + hm*lda + hk;
+  const mm_elem_t* const bt11 = bt;
+  const mm_elem_t* const bt12 = bt + hk;
+  const mm_elem_t* const bt21 = bt + hn*ldb;
+  const mm_elem_t* const bt22 = bt + hn*ldb + hk;
+
+  const mm_elem_t* const s_x[7]    = { a11,  a21,  a11,  a22,  a11,  a21,  a12  };
+  const mm_elem_t* const s_y[7]    = { a22,  a22,  NULL, NULL, a12,  a11,  a22  };
+  const int              s_sign[7] = { 1,    1,    0,    0,    1,    -1,   -1   };
+  const mm_elem_t* const t_x[7]    = { bt11, bt11, bt21, bt12, bt22, bt11, bt12 };
+  const mm_elem_t* const t_y[7]    = { bt22, NULL, bt22, bt11, NULL, bt21, bt22 };
+  const int              t_sign[7] = { 1,    0,    -1,   -1,   0,    1,    1    };
+
+  for (unsigned i=0; i<7; i++) {
+    #pragma omp task
+    {
+      // operands without a sum are used in place
+      mm_elem_t* const s = st + i*(s_size + t_size);
+      mm_elem_t* const t = s + s_size;
+      if (s_sign[i] != 0)
+        __mm_host_add(hm, hk, s_x[i], lda, s_y[i], lda, s_sign[i], s, hk);
+      if (t_sign[i] != 0)
+        __mm_host_add(hn, hk, t_x[i], ldb, t_y[i], ldb, t_sign[i], t, hk);
+      mm_host_rec(hm, hn, hk, s_sign[i] != 0 ? s : s_x[i], s_sign[i] != 0 ? hk : lda,
+        t_sign[i] != 0 ? t : t_x[i], t_sign[i] != 0 ? hk : ldb, p + i*p_size, hn, 0,
+        strassen_min);
+    }
+  }
+  #pragma omp taskwait
+
+  const mm_acc_t* const p1 = p;
+  const mm_acc_t* const p2 = p + p_size;
+  const mm_acc_t* const p3 = p + 2*p_size;
+  const mm_acc_t* const p4 = p + 3*p_size;
+  const mm_acc_t* const p5 = p + 4*p_size;
+  const mm_acc_t* const p6 = p + 5*p_size;
+  const mm_acc_t* const p7 = p + 6*p_size;
+
+  #pragma omp taskloop
+  for (unsigned i=0; i<hm; i++) {
+    mm_acc_t* const c1 = c + i*ldc;
+    mm_acc_t* const c2 = c + (hm+i)*ldc;
+    for (unsigned j=0; j<hn; j++) {
+      const unsigned ij = i*hn+j;
+      const mm_acc_t c11 = p1[ij] + p4[ij] - p5[ij] + p7[ij];
+      const mm_acc_t c12 = p3[ij] + p5[ij];
+      const mm_acc_t c21 = p2[ij] + p4[ij];
+      const mm_acc_t c22 = p1[ij] - p2[ij] + p3[ij] + p6[ij];
+      c1[j]    = accumulate ? c1[j]    + c11 : c11;
+      c1[hn+j] = accumulate ? c1[hn+j] + c12 : c12;
+      c2[j]    = accumulate ? c2[j]    + c21 : c21;
+      c2[hn+j] = accumulate ? c2[hn+j] + c22 : c22;
+    }
+  }
+
+  free(st);
+  free(p);
+
+  return 0;
+}
+
+#endif // MM_HOST_STRASSEN
+
+static inline void mm_host_rec(const unsigned m, const unsigned n, const unsigned k,
+    const mm_elem_t* const a, const unsigned lda, const mm_elem_t* const bt, const unsigned ldb,
+    mm_acc_t* const c, const unsigned ldc, const int accumulate, const unsigned strassen_min)
+{
+  if ( (m == 0) || (n == 0) )
+    return;
+  if ( (unsigned long long)m*n*k <= MM_HOST_LEAF_OPS ) {
+    mm_kernel(m, n, k, a, lda, bt, ldb, c, ldc, accumulate);
+    return;
+  }
+
+#if MM_HOST_STRASSEN
+  if ( (strassen_min > 0) && (m >= strassen_min) && (n >= strassen_min) && (k >= strassen_min) &&
+       (m % 2 == 0) && (n % 2 == 0) && (k % 2 == 0) ) {
+    if (__mm_host_strassen(m, n, k, a, lda, bt, ldb, c, ldc, accumulate, strassen_min) == 0)
+      return;
+  }
+#endif
+
+  if ( (m >= n) && (m >= k) ) {
+    const unsigned h = __mm_host_half(m);
+    #pragma omp task
+    mm_host_rec(h, n, k, a, lda, bt, ldb, c, ldc, accumulate, strassen_min);
+    mm_host_rec(m-h, n, k, a + h*lda, lda, bt, ldb, c + h*ldc, ldc, accumulate, strassen_min);
+    #pragma omp taskwait
+  }
+  else if (n >= k) {
+    const unsigned h = __mm_host_half(n);
+    #pragma omp task
+    mm_host_rec(m, h, k, a, lda, bt, ldb, c, ldc, accumulate, strassen_min);
+    mm_host_rec(m, n-h, k, a, lda, bt + h*ldb, ldb, c + h, ldc, accumulate, strassen_min);
+    #pragma omp taskwait
+  }
+  else {
+    const unsigned h = __mm_host_half(k);
+    mm_host_rec(m, n, h, a, lda, bt, ldb, c, ldc, accumulate, strassen_min);
+    mm_host_rec(m, n, k-h, a + h, lda, bt + h, ldb, c, ldc, 1, strassen_min);
+  }
+}
+
+static inline void mm_host(const unsigned m, const unsigned n, const unsigned k,
+    const mm_elem_t* const a, const unsigned lda, const mm_elem_t* const bt, const unsigned ldb,
+    mm_acc_t* const c, const unsigned ldc, const int accumulate, const unsigned strassen_min)
+{
+  #pragma omp parallel
+  {
+    #pragma omp single
+    mm_host_rec(m, n, k, a, lda, bt, ldb, c, ldc, accumulate, strassen_min);
+
+    // the barrier of the single construct completes all tasks
+    if (!accumulate) {
+      #pragma omp for
+      for (unsigned i=0; i<m; i++)
+        mm_output_block(1, n, &c[i*ldc], ldc);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MM_KERNEL_H__
+#define __MM_KERNEL_H__
+
+#include "mm-types.h"
+
+/*
+ * Register-tiled matrix multiplication kernels
+ *
+ * The kernels compute C = A * B for a row-major A (m x k) and C (m x n), with B given as its
+ * transpose (n x k, row-major), so both operands are read with unit stride.  A and B hold
+ * `mm_elem_t` elements, which are widened to `mm_acc_t` before they are multiplied (see
+ * `mm-types.h`).  The micro-kernel keeps an MM_KERNEL_MR x MM_KERNEL_NR block of C in scalar
+ * accumulators: every element loaded from A and B is used four times, and the compiler vectorizes
+ * the k loop with one vector accumulator per output on hosts with SIMD units.  With 4x4, the 16
+ * accumulators and 8 operands fit the register file of both the host and the RISC-V PULP cores.
+ *
+ * The kernels are serial; callers distribute the blocks of C over the OpenMP team, e.g.
+ *
+ *   #pragma omp for collapse(2)
+ *   for (unsigned i=0; i<m; i+=MM_KERNEL_MR)
+ *     for (unsigned j=0; j<n; j+=MM_KERNEL_NR)
+ *       mm_kernel_block(m-i, n-j, k, &a[i*lda], lda, &bt[j*ldb], ldb, &c[i*ldc+j], ldc, 0);
+ */
+
+#define MM_KERNEL_MR 4
+#define MM_KERNEL_NR 4
+
+#pragma omp declare target
+
+/**
+ * Compute a full MM_KERNEL_MR x MM_KERNEL_NR block of C.
+ *
+ * @param accumulate  Add to C instead of overwriting it.
+ */
+static inline void mm_kernel_4x4(unsigned k, const mm_elem_t* __restrict__ a, unsigned lda,
+    const mm_elem_t* __restrict__ bt, unsigned ldb, mm_acc_t* __restrict__ c, unsigned ldc,
+    int accumulate);
+
+/**
+ * Compute a block of at most MM_KERNEL_MR x MM_KERNEL_NR elements of C.
+ *
+ * @param m  Number of rows of C left from this block on; at most MM_KERNEL_MR are computed.
+ * @param n  Number of columns of C left from this block on; at most MM_KERNEL_NR are computed.
+ */
+static inline void mm_kernel_block(unsigned m, unsigned n, unsigned k,
+    const mm_elem_t* __restrict__ a, unsigned lda, const mm_elem_t* __restrict__ bt, unsigned ldb,
+    mm_acc_t* __restrict__ c, unsigned ldc, int accumulate);
+
+/**
+ * Compute an m x n block of C with a single thread.
+ */
+static inline void mm_kernel(unsigned m, unsigned n, unsigned k, const mm_elem_t* __restrict__ a,
+    unsigned lda, const mm_elem_t* __restrict__ bt, unsigned ldb, mm_acc_t* __restrict__ c,
+    unsigned ldc, int accumulate);
+
+static inline void mm_kernel_4x4(const unsigned k, const mm_elem_t* __restrict__ a,
+    const unsigned lda, const mm_elem_t* __restrict__ bt, const unsigned ldb,
+    mm_acc_t* __restrict__ c, const unsigned ldc, const int accumulate)
+{
+  const mm_elem_t* const a0 = a;
+  const mm_elem_t* const a1 = a + lda;
+  const mm_elem_t* const a2 = a + 2*lda;
+  const mm_elem_t* const a3 = a + 3*lda;
+  const mm_elem_t* const b0 = bt;
+  const mm_elem_t* const b1 = bt + ldb;
+  const mm_elem_t* const b2 = bt + 2*ldb;
+  const mm_elem_t* const b3 = bt + 3*ldb;
+
+  mm_acc_t c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+  mm_acc_t c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+  mm_acc_t c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+  mm_acc_t c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+
+  #pragma omp simd reduction(+: c00, c01, c02, c03, c10, c11, c12, c13) \
+    reduction(+: c20, c21, c22, c23, c30, c31, c32, c33)
+  for (unsigned kk=0; kk<k; kk++) {
+    const mm_acc_t x0 = a0[kk], x1 = a1[kk], x2 = a2[kk], x3 = a3[kk];
+    const mm_acc_t y0 = b0[kk], y1 = b1[kk], y2 = b2[kk], y3 = b3[kk];
+    c00 += x0*y0; c01 += x0*y1; c02 += x0*y2; c03 += x0*y3;
+    c10 += x1*y0; c11 += x1*y1; c12 += x1*y2; c13 += x1*y3;
+    c20 += x2*y0; c21 += x2*y1; c22 += x2*y2; c23 += x2*y3;
+    c30 += x3*y0; c31 += x3*y1; c32 += x3*y2; c33 += x3*y3;
+  }
+
+  mm_acc_t* const r0 = c;
+  mm_acc_t* const r1 = c + ldc;
+  mm_acc_t* const r2 = c + 2*ldc;
+  mm_acc_t* const r3 = c + 3*ldc;
+  if (accumulate) {
+    r0[0] += c00; r0[1] += c01; r0[2] += c02; r0[3] += c03;
+    r1[0] += c10; r1[1] += c11; r1[2] += c12; r1[3] += c13;
+    r2[0] += c20; r2[1] += c21; r2[2] += c22; r2[3] += c23;
+    r3[0] += c30; r3[1] += c31; r3[2] += c32; r3[3] += c33;
+  }
+  else {
+    r0[0] = c00; r0[1] = c01; r0[2] = c02; r0[3] = c03;
+    r1[0] = c10; r1[1] = c11; r1[2] = c12; r1[3] = c13;
+    r2[0] = c20; r2[1] = c21; r2[2] = c22; r2[3] = c23;
+    r3[0] = c30; r3[1] = c31; r3[2] = c32; r3[3] = c33;
+  }
+}
+
+static inline void mm_kernel_block(unsigned m, unsigned n, const unsigned k,
+    const mm_elem_t* __restrict__ a, const unsigned lda, const mm_elem_t* __restrict__ bt,
+    const unsigned ldb, mm_acc_t* __restrict__ c, const unsigned ldc, const int accumulate)
+{
+  if (m >= MM_KERNEL_MR && n >= MM_KERNEL_NR) {
+    mm_kernel_4x4(k, a, lda, bt, ldb, c, ldc, accumulate);
+    return;
+  }
+
+  // ragged edge of C
+  m = m < MM_KERNEL_MR ? m : MM_KERNEL_MR;
+  n = n < MM_KERNEL_NR ? n : MM_KERNEL_NR;
+  for (unsigned i=0; i<m; i++) {
+    for (unsigned j=0; j<n; j++) {
+      mm_acc_t sum = 0;
+      #pragma omp simd reduction(+: sum)
+      for (unsigned kk=0; kk<k; kk++)
+        sum += (mm_acc_t)a[i*lda+kk] * bt[j*ldb+kk];
+      c[i*ldc+j] = accumulate ? c[i*ldc+j] + sum : sum;
+    }
+  }
+}
+
+static inline void mm_kernel(const unsigned m, const unsigned n, const unsigned k,
+    const mm_elem_t* __restrict__ a, const unsigned lda, const mm_elem_t* __restrict__ bt,
+    const unsigned ldb, mm_acc_t* __restrict__ c, const unsigned ldc, const int accumulate)
+{
+  for (unsigned i=0; i<m; i+=MM_KERNEL_MR) {
+    for (unsigned j=0; j<n; j+=MM_KERNEL_NR) {
+      mm_kernel_block(m-i, n-j, k, &a[i*lda], lda, &bt[j*ldb], ldb, &c[i*ldc+j], ldc,
+        accumulate);
+    }
+  }
+}
+
+#pragma omp end declare target
+
+#endif
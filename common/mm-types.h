@@ -0,0 +1,153 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MM_TYPES_H__
+#define __MM_TYPES_H__
+
+#include <stdint.h>   // int8_t, int16_t, int32_t, uint32_t, INT16_MIN, INT16_MAX
+
+/*
+ * Element types of the matrix multiplication examples
+ *
+ * The type is selected at compile time with `-DMM_TYPE=...` (`make MM_TYPE=int8 ...`).  A and B
+ * hold `mm_elem_t` elements; the products are accumulated in the wider `mm_acc_t`, which is also
+ * the element type of C:
+ *
+ *   MM_TYPE    mm_elem_t  mm_acc_t
+ *   MM_INT8    int8_t     int32_t
+ *   MM_INT16   int16_t    int32_t
+ *   MM_INT32   uint32_t   uint32_t   (default; wraps around like two's complement int32)
+ *   MM_FLOAT   float      float
+ *   MM_FIXED   int16_t    int32_t    (Q8.8 operands, Q16.16 sums, Q8.8 results)
+ *
+ * Tile sizes and DMA transfers are derived from `sizeof(mm_elem_t)` and `sizeof(mm_acc_t)`, so
+ * narrower types fit more elements into the same L1 budget.  `mm_verify()` is the function of
+ * `common/verify.h` that checks results of type `mm_acc_t`.
+ *
+ * The kernels leave the sums of products in C.  Whoever completes an element of C, i.e., adds the
+ * last partial sum, passes it through `mm_output()`, which turns the Q16.16 sums of MM_FIXED into
+ * Q8.8 values, rounded to nearest and saturated to the range of int16_t, and keeps the sums of all
+ * other types.  The Q8.8 results stay in `mm_acc_t` elements, so all types share one C layout.
+ */
+
+#define MM_INT8  0
+#define MM_INT16 1
+#define MM_INT32 2
+#define MM_FLOAT 3
+#define MM_FIXED 4
+
+#ifndef MM_TYPE
+  #define MM_TYPE MM_INT32
+#endif
+
+#if MM_TYPE == MM_INT8
+  typedef int8_t   mm_elem_t;
+  typedef int32_t  mm_acc_t;
+  #define MM_TYPE_NAME "int8"
+  #define mm_verify    verify_check_i32
+#elif MM_TYPE == MM_INT16
+  typedef int16_t  mm_elem_t;
+  typedef int32_t  mm_acc_t;
+  #define MM_TYPE_NAME "int16"
+  #define mm_verify    verify_check_i32
+#elif MM_TYPE == MM_INT32
+  typedef uint32_t mm_elem_t;
+  typedef uint32_t mm_acc_t;
+  #define MM_TYPE_NAME "int32"
+  #define mm_verify    verify_check_u32
+#elif MM_TYPE == MM_FLOAT
+  typedef float    mm_elem_t;
+  typedef float    mm_acc_t;
+  #define MM_TYPE_NAME "float"
+  #define mm_verify    verify_check_f32
+#elif MM_TYPE == MM_FIXED
+  typedef int16_t  mm_elem_t;
+  typedef int32_t  mm_acc_t;
+  #define MM_TYPE_NAME "fixed"
+  #define mm_verify    verify_check_i32
+  #define MM_FIXED_FRAC_BITS 8
+#else
+  #error "Unknown MM_TYPE"
+#endif
+
+/*
+ * Suffix for benchmark region names, empty for the default type
+ */
+#if MM_TYPE == MM_INT32
+  #define MM_TYPE_TAG ""
+#else
+  #define MM_TYPE_TAG " [" MM_TYPE_NAME "]"
+#endif
+
+/*
+ * Test value for index `x`.  The narrower types and float get small values (-4 to 4) that cannot
+ * overflow the accumulators and keep the float sums exact, so the results of all types can be
+ * compared bit by bit regardless of the summation order.  MM_FIXED gets the same pattern scaled to
+ * fractional Q8.8 values.
+ */
+#if MM_TYPE == MM_INT32
+  #define MM_TEST_VALUE(x) ((mm_elem_t)(x))
+#elif MM_TYPE == MM_FIXED
+  // -0.58 to 0.58 in steps of 37/256, so rounding matters
+  #define MM_TEST_VALUE(x) ((mm_elem_t)(((int)((x) % 9) - 4) * 37))
+#else
+  #define MM_TEST_VALUE(x) ((mm_elem_t)((int)((x) % 9) - 4))
+#endif
+
+#pragma omp declare target
+
+/**
+ * Convert a complete sum of products to the result format of C.
+ *
+ * @return  The sum in Q8.8, rounded to nearest and saturated, for MM_FIXED; the sum otherwise.
+ */
+static inline mm_acc_t mm_output(mm_acc_t sum);
+
+/**
+ * Convert a rows x cols block of complete sums in C with mm_output().  Does nothing unless
+ * MM_FIXED.
+ */
+static inline void mm_output_block(unsigned rows, unsigned cols, mm_acc_t* c, unsigned ldc);
+
+static inline mm_acc_t mm_output(const mm_acc_t sum)
+{
+#if MM_TYPE == MM_FIXED
+  // add half an LSB of the result and shift arithmetically, i.e., round halves up
+  const int64_t q = ((int64_t)sum + (1 << (MM_FIXED_FRAC_BITS-1))) >> MM_FIXED_FRAC_BITS;
+  return (mm_acc_t)(q > INT16_MAX ? INT16_MAX : q < INT16_MIN ? INT16_MIN : q);
+#else
+  return sum;
+#endif
+}
+
+static inline void mm_output_block(const unsigned rows, const unsigned cols, mm_acc_t* const c,
+    const unsigned ldc)
+{
+#if MM_TYPE == MM_FIXED
+  for (unsigned i=0; i<rows; i++)
+    for (unsigned j=0; j<cols; j++)
+      c[i*ldc+j] = mm_output(c[i*ldc+j]);
+#else
+  (void)rows;
+  (void)cols;
+  (void)c;
+  (void)ldc;
+#endif
+}
+
+#pragma omp end declare target
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TILE_STREAM_H__
+#define __TILE_STREAM_H__
+
+#include <stdint.h>       // uint8_t
+#include <errno.h>        // for error codes
+#include <hero-target.h>
+
+/*
+ * Tile streaming between external memory and the L1 memory
+ *
+ * A stream moves a sequence of tiles of a 2D array in external memory into (TS_IN) or out of
+ * (TS_OUT) `depth` rotating L1 buffers with the DMA engine.  It takes care of the buffer rotation,
+ * of prefetching up to `depth` tiles ahead, of ragged tiles at the right and bottom edges, and of
+ * transferring multi-row tiles with a single DMA transfer where the rows are contiguous.  Input
+ * tiles can carry `halo` rows above and below for stencils; halo rows outside the array are not
+ * transferred.
+ *
+ * The sequence visits the tile grid in row-major order, or in column-major order (see
+ * `ts_set_order()`).  Every grid row (column) can be repeated `row_reps` times and the whole grid
+ * `grid_reps` times (see `ts_set_reps()`), which covers the operand orders of blocked kernels: for
+ * C = A * B^T with the k blocks innermost, A is streamed with `row_reps` = number of column tiles
+ * of C, and B^T with `grid_reps` = number of row tiles of C; a row-major B is streamed in
+ * column-major order with `grid_reps` = number of row tiles of C.
+ *
+ * A stream is driven by one thread at a time.  The simple interface for a single consumer is
+ *
+ *   ts_in_next(&in, &tile);    // release the previous tile, prefetch, wait for the next one
+ *   ts_out_next(&out, &tile);  // get a free buffer for the next output tile
+ *   ...compute...
+ *   ts_out_put(&out);          // start its write back
+ *   ...
+ *   ts_out_flush(&out);        // wait for all write backs
+ *
+ * Pipelines that synchronize several threads themselves use the underlying `ts_issue()`,
+ * `ts_wait()` and `ts_release()`.
+ */
+
+#define TS_IN  0
+#define TS_OUT 1
+
+#define TS_ROW_MAJOR 0
+#define TS_COL_MAJOR 1
+
+#define TS_DEPTH_MAX    4   // maximum number of buffers per stream
+#define TS_DMA_MAX_JOBS 8   // DMA transfers kept in flight per tile
+
+#pragma omp declare target
+
+/*
+ * DMA transfers of 2D blocks
+ */
+typedef struct {
+  hero_dma_job_t ids[TS_DMA_MAX_JOBS];
+  unsigned       n;
+} ts_dma_jobs_t;
+
+typedef struct {
+  uint8_t *     ext;            // external array
+  unsigned      ext_stride_b;   // row stride of the external array
+  unsigned      elem_b;         // element size
+  unsigned      rows;           // size of the external array, in elements
+  unsigned      cols;
+  unsigned      tile_rows;      // size of the tiles, without halo
+  unsigned      tile_cols;
+  unsigned      halo;           // rows above and below every input tile
+  unsigned      dir;            // TS_IN or TS_OUT
+  unsigned      depth;          // number of buffers
+  unsigned      order;          // TS_ROW_MAJOR or TS_COL_MAJOR
+  unsigned      grid_rows;      // tiles per column and row of the array
+  unsigned      grid_cols;
+  unsigned      row_reps;       // repetitions of every grid row (column)
+  unsigned      grid_reps;      // repetitions of the whole grid
+  unsigned      n_tiles;        // length of the sequence
+  uint8_t *     bufs[TS_DEPTH_MAX];
+  ts_dma_jobs_t dma[TS_DEPTH_MAX];
+  unsigned      issued;         // tiles whose transfer has been started
+  unsigned      completed;      // tiles whose transfer has completed
+  unsigned      released;       // tiles whose buffer may be reused
+  unsigned      next;           // tiles handed out by `ts_in_next()` or `ts_out_next()`
+  uint64_t      bytes;          // bytes transferred by the started transfers, including halos
+} ts_stream_t;
+
+typedef struct {
+  void *   buf;         // first element of the tile (without halo) in L1
+  unsigned stride_b;    // row stride of the buffer
+  unsigned row;         // position of the first element in the array
+  unsigned col;
+  unsigned rows;        // size of the tile, smaller than the tile size at the edges
+  unsigned cols;
+  unsigned halo_above;  // valid halo rows at buf - k*stride_b, k = 1..halo_above
+  unsigned halo_below;  // valid halo rows after the last row of the tile
+} ts_tile_t;
+
+/**
+ * Start the transfer of `n_rows` rows of `row_b` bytes, keeping at most TS_DMA_MAX_JOBS transfers
+ * in flight.  The rows are transferred at once if they are contiguous in both memories.
+ */
+static inline void ts_dma_memcpy_2d_async(ts_dma_jobs_t* jobs, void* dst, unsigned dst_stride_b,
+    void* src, unsigned src_stride_b, unsigned row_b, unsigned n_rows);
+
+/**
+ * Wait for all transfers started with `ts_dma_memcpy_2d_async()` on `jobs`.
+ */
+static inline void ts_dma_wait_all(ts_dma_jobs_t* jobs);
+
+/**
+ * Initialize a stream over the `rows` x `cols` array `ext` with elements of `elem_b` bytes and a
+ * row stride of `ext_stride_b` bytes, and allocate its `depth` buffers in L1.
+ *
+ * @return  0 on success; -EINVAL for an invalid depth or tile size; -ENOMEM if the buffers cannot
+ *          be allocated.
+ */
+static inline int ts_init(ts_stream_t* ts, unsigned dir, void* ext, unsigned elem_b,
+    unsigned rows, unsigned cols, unsigned ext_stride_b, unsigned tile_rows, unsigned tile_cols,
+    unsigned halo, unsigned depth);
+
+/**
+ * Repeat every grid row (column, in column-major order) `row_reps` times and the whole grid
+ * `grid_reps` times, and rewind the stream.
+ */
+static inline void ts_set_reps(ts_stream_t* ts, unsigned row_reps, unsigned grid_reps);
+
+/**
+ * Visit the tile grid in TS_ROW_MAJOR (default) or TS_COL_MAJOR order, and rewind the stream.
+ */
+static inline void ts_set_order(ts_stream_t* ts, unsigned order);
+
+/**
+ * Free the buffers of a stream.  All transfers must have completed.
+ */
+static inline void ts_free(ts_stream_t* ts);
+
+/**
+ * Describe tile `i` of the sequence and its buffer.
+ */
+static inline void ts_tile(const ts_stream_t* ts, unsigned i, ts_tile_t* tile);
+
+/**
+ * @return  First element of tile `i` (without halo) in its buffer.
+ */
+static inline void* ts_buf(const ts_stream_t* ts, unsigned i);
+
+/**
+ * Start the transfer of the next tile of the sequence.  For input streams, its buffer must have
+ * been released (see `ts_can_issue()`); for output streams, the tile must have been computed.
+ */
+static inline void ts_issue(ts_stream_t* ts);
+
+/**
+ * @return  Nonzero if the next input tile exists and its buffer has been released.
+ */
+static inline int ts_can_issue(const ts_stream_t* ts);
+
+/**
+ * Wait for the transfers of all started tiles up to tile `i`.
+ *
+ * @return  Number of completed tiles.
+ */
+static inline unsigned ts_wait(ts_stream_t* ts, unsigned i);
+
+/**
+ * Mark the buffers of the first `n` tiles as free for reuse.
+ */
+static inline void ts_release(ts_stream_t* ts, unsigned n);
+
+/**
+ * Release the previous input tile, prefetch as far as the buffers allow, and wait for the next
+ * tile.
+ *
+ * @return  0 on success; -1 at the end of the sequence.
+ */
+static inline int ts_in_next(ts_stream_t* ts, ts_tile_t* tile);
+
+/**
+ * Get the buffer of the next output tile, waiting for the write back of the tile that used it
+ * before.
+ *
+ * @return  0 on success; -1 at the end of the sequence.
+ */
+static inline int ts_out_next(ts_stream_t* ts, ts_tile_t* tile);
+
+/**
+ * Start the write back of the oldest output tile returned by `ts_out_next()` and not yet put.
+ */
+static inline void ts_out_put(ts_stream_t* ts);
+
+/**
+ * Wait for the write back of all put output tiles.
+ */
+static inline void ts_out_flush(ts_stream_t* ts);
+
+static inline void ts_dma_memcpy_2d_async(ts_dma_jobs_t* const jobs, void* const dst,
+    const unsigned dst_stride_b, void* const src, const unsigned src_stride_b, unsigned row_b,
+    unsigned n_rows)
+{
+  if ( (row_b == dst_stride_b) && (row_b == src_stride_b) ) {
+    row_b  = row_b * n_rows;
+    n_rows = n_rows > 0;
+  }
+
+  jobs->n = 0;
+  for (unsigned r=0; r<n_rows; r++) {
+    const unsigned slot = jobs->n % TS_DMA_MAX_JOBS;
+    if (jobs->n >= TS_DMA_MAX_JOBS)
+      hero_dma_wait(jobs->ids[slot]);
+    jobs->ids[slot] = hero_dma_memcpy_async((void *)((uint8_t *)dst + r*dst_stride_b),
+      (void *)((uint8_t *)src + r*src_stride_b), row_b);
+    jobs->n++;
+  }
+}
+
+static inline void ts_dma_wait_all(ts_dma_jobs_t* const jobs)
+{
+  const unsigned n = jobs->n < TS_DMA_MAX_JOBS ? jobs->n : TS_DMA_MAX_JOBS;
+  for (unsigned i=0; i<n; i++)
+    hero_dma_wait(jobs->ids[i]);
+  jobs->n = 0;
+}
+
+static inline int ts_init(ts_stream_t* const ts, const unsigned dir, void* const ext,
+    const unsigned elem_b, const unsigned rows, const unsigned cols, const unsigned ext_stride_b,
+    const unsigned tile_rows, const unsigned tile_cols, const unsigned halo, const unsigned depth)
+{
+  if ( (depth < 1) || (depth > TS_DEPTH_MAX) || (tile_rows == 0) || (tile_cols == 0) ||
+       ((dir == TS_OUT) && (halo > 0)) )
+    return -EINVAL;
+
+  ts->ext          = (uint8_t *)ext;
+  ts->ext_stride_b = ext_stride_b;
+  ts->elem_b       = elem_b;
+  ts->rows         = rows;
+  ts->cols         = cols;
+  ts->tile_rows    = tile_rows;
+  ts->tile_cols    = tile_cols;
+  ts->halo         = halo;
+  ts->dir          = dir;
+  ts->depth        = depth;
+  ts->order        = TS_ROW_MAJOR;
+  ts->grid_rows    = (rows + tile_rows - 1) / tile_rows;
+  ts->grid_cols    = (cols + tile_cols - 1) / tile_cols;
+  ts_set_reps(ts, 1, 1);
+
+  const unsigned size_b = (tile_rows + 2*halo) * tile_cols * elem_b;
+  int err = 0;
+  for (unsigned i=0; i<depth; i++) {
+    ts->bufs[i] = (uint8_t *)hero_l1malloc(size_b);
+    if (ts->bufs[i] == NULL)
+      err = -ENOMEM;
+  }
+  if (err) {
+    ts_free(ts);
+    return err;
+  }
+
+  return 0;
+}
+
+static inline void ts_set_reps(ts_stream_t* const ts, const unsigned row_reps,
+    const unsigned grid_reps)
+{
+  ts->row_reps  = row_reps;
+  ts->grid_reps = grid_reps;
+  ts->n_tiles   = ts->grid_rows * row_reps * ts->grid_cols * grid_reps;
+  ts->issued    = 0;
+  ts->completed = 0;
+  ts->released  = 0;
+  ts->next      = 0;
+  ts->bytes     = 0;
+}
+
+static inline void ts_set_order(ts_stream_t* const ts, const unsigned order)
+{
+  ts->order = order;
+  ts_set_reps(ts, ts->row_reps, ts->grid_reps);
+}
+
+static inline void ts_free(ts_stream_t* const ts)
+{
+  for (unsigned i=0; i<ts->depth; i++) {
+    if (ts->bufs[i] != NULL)
+      hero_l1free(ts->bufs[i]);
+    ts->bufs[i] = NULL;
+  }
+}
+
+static inline void ts_tile(const ts_stream_t* const ts, const unsigned i, ts_tile_t* const tile)
+{
+  const unsigned pos = i % (ts->grid_rows * ts->row_reps * ts->grid_cols);
+  unsigned grid_row, grid_col;
+  if (ts->order == TS_ROW_MAJOR) {
+    grid_row = pos / (ts->row_reps * ts->grid_cols);
+    grid_col = pos % ts->grid_cols;
+  }
+  else {
+    grid_col = pos / (ts->row_reps * ts->grid_rows);
+    grid_row = pos % ts->grid_rows;
+  }
+
+  tile->stride_b   = ts->tile_cols * ts->elem_b;
+  tile->buf        = ts_buf(ts, i);
+  tile->row        = grid_row * ts->tile_rows;
+  tile->col        = grid_col * ts->tile_cols;
+  tile->rows       = ts->rows - tile->row < ts->tile_rows ? ts->rows - tile->row : ts->tile_rows;
+  tile->cols       = ts->cols - tile->col < ts->tile_cols ? ts->cols - tile->col : ts->tile_cols;
+  tile->halo_above = tile->row < ts->halo ? tile->row : ts->halo;
+  tile->halo_below = ts->rows - tile->row - tile->rows < ts->halo ?
+    ts->rows - tile->row - tile->rows : ts->halo;
+}
+
+static inline void* ts_buf(const ts_stream_t* const ts, const unsigned i)
+{
+  return (void *)(ts->bufs[i % ts->depth] + ts->halo * ts->tile_cols * ts->elem_b);
+}
+
+static inline void ts_issue(ts_stream_t* const ts)
+{
+  const unsigned i = ts->issued++;
+  ts_tile_t tile;
+  ts_tile(ts, i, &tile);
+
+  uint8_t * const local = (uint8_t *)tile.buf;
+  uint8_t * const ext   = ts->ext + tile.row * ts->ext_stride_b + tile.col * ts->elem_b;
+
+  if (ts->dir == TS_IN) {
+    ts->bytes += (uint64_t)(tile.halo_above + tile.rows + tile.halo_below) * tile.cols
+      * ts->elem_b;
+    ts_dma_memcpy_2d_async(&ts->dma[i % ts->depth],
+      (void *)(local - tile.halo_above * tile.stride_b), tile.stride_b,
+      (void *)(ext - tile.halo_above * ts->ext_stride_b), ts->ext_stride_b,
+      tile.cols * ts->elem_b, tile.halo_above + tile.rows + tile.halo_below);
+  }
+  else {
+    ts->bytes += (uint64_t)tile.rows * tile.cols * ts->elem_b;
+    ts_dma_memcpy_2d_async(&ts->dma[i % ts->depth], (void *)ext, ts->ext_stride_b,
+      (void *)local, tile.stride_b, tile.cols * ts->elem_b, tile.rows);
+  }
+}
+
+static inline int ts_can_issue(const ts_stream_t* const ts)
+{
+  return (ts->issued < ts->n_tiles) && (ts->issued < ts->released + ts->depth);
+}
+
+static inline unsigned ts_wait(ts_stream_t* const ts, const unsigned i)
+{
+  while ( (ts->completed <= i) && (ts->completed < ts->issued) ) {
+    ts_dma_wait_all(&ts->dma[ts->completed % ts->depth]);
+    ts->completed++;
+  }
+  return ts->completed;
+}
+
+static inline void ts_release(ts_stream_t* const ts, const unsigned n)
+{
+  if (n > ts->released)
+    ts->released = n;
+}
+
+static inline int ts_in_next(ts_stream_t* const ts, ts_tile_t* const tile)
+{
+  // the consumer is done with all tiles handed out before
+  const unsigned i = ts->next;
+  ts_release(ts, i);
+  if (i >= ts->n_tiles)
+    return -1;
+
+  while (ts_can_issue(ts))
+    ts_issue(ts);
+  ts_wait(ts, i);
+  ts_tile(ts, i, tile);
+  ts->next++;
+
+  return 0;
+}
+
+static inline int ts_out_next(ts_stream_t* const ts, ts_tile_t* const tile)
+{
+  const unsigned i = ts->next;
+  if (i >= ts->n_tiles)
+    return -1;
+
+  if (i >= ts->depth)
+    ts_wait(ts, i - ts->depth);
+  ts_tile(ts, i, tile);
+  ts->next++;
+
+  return 0;
+}
+
+static inline void ts_out_put(ts_stream_t* const ts)
+{
+  if (ts->issued < ts->next)
+    ts_issue(ts);
+}
+
+static inline void ts_out_flush(ts_stream_t* const ts)
+{
+  if (ts->issued > 0)
+    ts_wait(ts, ts->issued - 1);
+}
+
+#pragma omp end declare target
+
+#endif
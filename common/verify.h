@@ -0,0 +1,344 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <math.h>     // fabs()
+#include <stddef.h>   // size_t
+#include <stdint.h>   // int32_t, uint8_t, uint32_t, uint64_t
+#include <stdio.h>    // printf()
+#include <stdlib.h>   // getenv()
+#include <string.h>   // memcpy(), strcmp()
+
+/*
+ * Parallel result verification
+ *
+ * The functions compare a result with a reference element by element, with the rows distributed
+ * over the threads of an OpenMP team and the columns vectorized.  Rows without mismatches take the
+ * fast path, which only counts the differing elements; the rare rows with mismatches are scanned
+ * again for the error statistics.  There are three modes:
+ *
+ *   VERIFY_FULL      compare all elements and report the number of mismatches, the largest error
+ *                    and the first VERIFY_MAX_LOCATIONS mismatches (default)
+ *   VERIFY_EARLY     stop at the first row with a mismatch (in any thread); the statistics then
+ *                    only cover the rows compared so far, and the locations need not be the first
+ *   VERIFY_CHECKSUM  compare a position-dependent checksum of the result with the one of the
+ *                    reference, which is computed only once per reference buffer and content, so
+ *                    the reference is not read again; only on a mismatch, the elements are
+ *                    compared to locate the errors
+ *
+ * `verify_check_<T>()` takes the mode from the environment variable VERIFY_MODE (`full`, `early`,
+ * or `checksum`) and prints a report if the result is wrong.  The functions exist for the element
+ * types u8 (uint8_t), i32 (int32_t), u32 (uint32_t) and f32 (float); others can be added with
+ * VERIFY_DEFINE().  Floats are compared exactly.
+ */
+
+#ifndef VERIFY_MAX_LOCATIONS
+  #define VERIFY_MAX_LOCATIONS 8       // mismatches recorded per report
+#endif
+#ifndef VERIFY_PARALLEL_MIN
+  #define VERIFY_PARALLEL_MIN  16384   // fewer elements are compared by a single thread
+#endif
+
+typedef enum {
+  VERIFY_FULL,
+  VERIFY_EARLY,
+  VERIFY_CHECKSUM,
+} verify_mode_t;
+
+typedef struct {
+  size_t row;
+  size_t col;
+  double result;
+  double ref;
+} verify_location_t;
+
+typedef struct {
+  size_t            n_checked;      // elements compared
+  size_t            n_mismatches;
+  double            max_err;        // largest absolute error
+  size_t            max_err_row;
+  size_t            max_err_col;
+  unsigned          n_locations;
+  verify_location_t locations[VERIFY_MAX_LOCATIONS];  // sorted by row and column
+} verify_report_t;
+
+/**
+ * Read the verification mode from the environment variable VERIFY_MODE.
+ */
+static inline verify_mode_t verify_mode_from_env(void);
+
+/**
+ * Print the statistics and recorded mismatches of a report, prefixed by a label.
+ */
+static inline void verify_report_print(const verify_report_t* report, const char* label);
+
+/**
+ * Declare that a reference has been rewritten in place, so that the cached checksums of all
+ * references are computed again in mode VERIFY_CHECKSUM.
+ */
+static inline void verify_ref_modified(void);
+
+/*
+ * Generation of the references, incremented by `verify_ref_modified()`.
+ */
+static inline unsigned* __verify_ref_generation(void)
+{
+  static unsigned generation = 0;
+  return &generation;
+}
+
+/*
+ * Initialize an empty report.
+ */
+static inline void __verify_report_init(verify_report_t* const report)
+{
+  report->n_checked    = 0;
+  report->n_mismatches = 0;
+  report->max_err      = 0;
+  report->max_err_row  = 0;
+  report->max_err_col  = 0;
+  report->n_locations  = 0;
+}
+
+/*
+ * Whether location (row_x, col_x) comes before (row_y, col_y) in row-major order.
+ */
+static inline int __verify_before(const size_t row_x, const size_t col_x, const size_t row_y,
+    const size_t col_y)
+{
+  return (row_x < row_y) || ( (row_x == row_y) && (col_x < col_y) );
+}
+
+/*
+ * Merge the report of one thread into the combined one, keeping the first locations.
+ */
+static inline void __verify_report_merge(verify_report_t* const dst,
+    const verify_report_t* const src)
+{
+  if (src->n_mismatches > 0) {
+    // on ties, the first location wins
+    const int src_first = __verify_before(src->max_err_row, src->max_err_col, dst->max_err_row,
+      dst->max_err_col);
+    if ( (dst->n_mismatches == 0) || (src->max_err > dst->max_err) ||
+         ( (src->max_err == dst->max_err) && src_first ) ) {
+      dst->max_err     = src->max_err;
+      dst->max_err_row = src->max_err_row;
+      dst->max_err_col = src->max_err_col;
+    }
+  }
+  dst->n_checked    += src->n_checked;
+  dst->n_mismatches += src->n_mismatches;
+
+  for (unsigned l=0; l<src->n_locations; l++) {
+    const verify_location_t* const loc = &src->locations[l];
+    unsigned pos = dst->n_locations;
+    while ( (pos > 0) && __verify_before(loc->row, loc->col, dst->locations[pos-1].row,
+            dst->locations[pos-1].col) )
+      pos--;
+    if (pos == VERIFY_MAX_LOCATIONS)
+      continue;
+    const unsigned n_moved = dst->n_locations - pos - (dst->n_locations == VERIFY_MAX_LOCATIONS);
+    memmove(&dst->locations[pos+1], &dst->locations[pos], n_moved*sizeof(verify_location_t));
+    dst->locations[pos] = *loc;
+    if (dst->n_locations < VERIFY_MAX_LOCATIONS)
+      dst->n_locations++;
+  }
+}
+
+/*
+ * Record a mismatch in the report of a thread.
+ */
+static inline void __verify_report_add(verify_report_t* const report, const size_t row,
+    const size_t col, const double result, const double ref)
+{
+  const double err = fabs(result - ref);
+  if ( (report->n_mismatches == 0) || (err > report->max_err) ) {
+    report->max_err     = err;
+    report->max_err_row = row;
+    report->max_err_col = col;
+  }
+  report->n_mismatches++;
+  if (report->n_locations < VERIFY_MAX_LOCATIONS) {
+    verify_location_t* const loc = &report->locations[report->n_locations++];
+    loc->row    = row;
+    loc->col    = col;
+    loc->result = result;
+    loc->ref    = ref;
+  }
+}
+
+/*
+ * Weight of the element with index `index` in the weighted half of the checksum.  The weights are
+ * odd, i.e., invertible modulo 2^32, so the checksum changes with every single wrong element, and
+ * they differ between neighbors, so it also changes if elements are swapped.  The checksum works
+ * on 32-bit lanes, which vectorize on all hosts; elements must not be wider than 32 bits.
+ */
+static inline uint32_t __verify_weight(const size_t index)
+{
+  return 2*(uint32_t)index + 1;
+}
+
+/**
+ * Define the functions for element type `type`, suffixed with `suffix`:
+ *
+ *   size_t   verify_<suffix>(const type* result, const type* ref, size_t rows, size_t cols,
+ *                            verify_mode_t mode, verify_report_t* report);
+ *   uint64_t verify_checksum_<suffix>(const type* x, size_t n);
+ *   size_t   verify_check_<suffix>(const type* result, const type* ref, size_t rows, size_t cols,
+ *                                  const char* label);
+ *
+ * `verify_<suffix>()` compares in mode VERIFY_FULL or VERIFY_EARLY and returns the number of
+ * mismatches found.  `verify_check_<suffix>()` compares in the mode given by VERIFY_MODE, prints a
+ * report on mismatches, and returns the number of mismatches.  The checksum of the reference is
+ * cached by address, size and generation, so a reference rewritten in place must be announced
+ * with `verify_ref_modified()` before it is used again.
+ */
+#define VERIFY_DEFINE(suffix, type) \
+  static inline size_t verify_##suffix(const type* const result, const type* const ref, \
+      const size_t rows, const size_t cols, const verify_mode_t mode, \
+      verify_report_t* const report) \
+  { \
+    __verify_report_init(report); \
+    int found = 0; \
+    \
+    _Pragma("omp parallel if(rows*cols >= VERIFY_PARALLEL_MIN) shared(found)") \
+    { \
+      verify_report_t part; \
+      __verify_report_init(&part); \
+      \
+      _Pragma("omp for schedule(static)") \
+      for (size_t i=0; i<rows; i++) { \
+        if (mode == VERIFY_EARLY) { \
+          int stop; \
+          _Pragma("omp atomic read") \
+          stop = found; \
+          if (stop) \
+            continue; \
+        } \
+        const type* const r = &result[i*cols]; \
+        const type* const e = &ref[i*cols]; \
+        size_t n_diff = 0; \
+        _Pragma("omp simd reduction(+: n_diff)") \
+        for (size_t j=0; j<cols; j++) \
+          n_diff += r[j] != e[j]; \
+        part.n_checked += cols; \
+        if (n_diff == 0) \
+          continue; \
+        \
+        for (size_t j=0; j<cols; j++) { \
+          if (r[j] != e[j]) \
+            __verify_report_add(&part, i, j, (double)r[j], (double)e[j]); \
+        } \
+        if (mode == VERIFY_EARLY) { \
+          _Pragma("omp atomic write") \
+          found = 1; \
+        } \
+      } \
+      \
+      _Pragma("omp critical(verify)") \
+      __verify_report_merge(report, &part); \
+    } \
+    \
+    return report->n_mismatches; \
+  } \
+  \
+  static inline uint64_t verify_checksum_##suffix(const type* const x, const size_t n) \
+  { \
+    uint32_t sum = 0, weighted = 0; \
+    _Pragma("omp parallel for simd if(n >= VERIFY_PARALLEL_MIN) reduction(+: sum, weighted)") \
+    for (size_t i=0; i<n; i++) { \
+      uint32_t bits = 0; \
+      memcpy(&bits, &x[i], sizeof(type)); \
+      sum      += bits; \
+      weighted += bits * __verify_weight(i); \
+    } \
+    return ((uint64_t)weighted << 32) | sum; \
+  } \
+  \
+  static inline size_t verify_check_##suffix(const type* const result, const type* const ref, \
+      const size_t rows, const size_t cols, const char* const label) \
+  { \
+    static const type* ref_cached = NULL; \
+    static size_t      ref_n      = 0; \
+    static unsigned    ref_gen    = 0; \
+    static uint64_t    ref_sum    = 0; \
+    \
+    const verify_mode_t mode = verify_mode_from_env(); \
+    if (mode == VERIFY_CHECKSUM) { \
+      const unsigned gen = *__verify_ref_generation(); \
+      if ( (ref != ref_cached) || (rows*cols != ref_n) || (gen != ref_gen) ) { \
+        ref_cached = ref; \
+        ref_n      = rows*cols; \
+        ref_gen    = gen; \
+        ref_sum    = verify_checksum_##suffix(ref, rows*cols); \
+      } \
+      if (verify_checksum_##suffix(result, rows*cols) == ref_sum) \
+        return 0; \
+    } \
+    \
+    /* locate the mismatches */ \
+    verify_report_t report; \
+    const size_t n_mismatches = verify_##suffix(result, ref, rows, cols, \
+      mode == VERIFY_EARLY ? VERIFY_EARLY : VERIFY_FULL, &report); \
+    if (n_mismatches > 0) \
+      verify_report_print(&report, label); \
+    else if (mode == VERIFY_CHECKSUM) \
+      /* the reference has been modified without verify_ref_modified() */ \
+      ref_sum = verify_checksum_##suffix(ref, rows*cols); \
+    return n_mismatches; \
+  }
+
+VERIFY_DEFINE(u8,  uint8_t)
+VERIFY_DEFINE(i32, int32_t)
+VERIFY_DEFINE(u32, uint32_t)
+VERIFY_DEFINE(f32, float)
+
+static inline verify_mode_t verify_mode_from_env(void)
+{
+  const char* const mode = getenv("VERIFY_MODE");
+  if ( (mode != NULL) && (strcmp(mode, "early") == 0) )
+    return VERIFY_EARLY;
+  if ( (mode != NULL) && (strcmp(mode, "checksum") == 0) )
+    return VERIFY_CHECKSUM;
+  return VERIFY_FULL;
+}
+
+static inline void verify_ref_modified(void)
+{
+  (*__verify_ref_generation())++;
+}
+
+static inline void verify_report_print(const verify_report_t* const report,
+    const char* const label)
+{
+  if (report->n_mismatches == 0) {
+    printf("%s: %zu elements correct\n", label, report->n_checked);
+    return;
+  }
+
+  printf("ERROR: %s: %zu of %zu compared elements mismatch, max. error = %.10g in Row %zu, "
+    "Column %zu!\n", label, report->n_mismatches, report->n_checked, report->max_err,
+    report->max_err_row, report->max_err_col);
+  for (unsigned l=0; l<report->n_locations; l++) {
+    const verify_location_t* const loc = &report->locations[l];
+    printf("ERROR: Row %zu, Column %zu: %.10g instead of %.10g\n", loc->row, loc->col, loc->result,
+      loc->ref);
+  }
+}
+
+#endif
@@ -0,0 +1,490 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANALYTICS_H__
+#define __ANALYTICS_H__
+
+#include <limits.h>       // UINT_MAX
+#include <stdlib.h>       // free(), malloc()
+#include <omp.h>          // omp_get_max_threads(), omp_get_thread_num()
+#include "graph.h"
+#include "vertex.h"
+
+/*
+ * Graph analytics on the linked list
+ *
+ * The kernels work on the `vertex` structure and follow its successor (and, for the pull-based
+ * steps, predecessor) pointers.  Each one opens its own parallel region and runs unchanged on the
+ * host (`svm` = 0) and inside a target region on PULP (`svm` = 1), where the vertices, the
+ * predecessor arrays and the per-vertex results are accessed in shared virtual memory (see the
+ * list_*() accessors of `vertex.h`).  None of them needs atomic read-modify-write operations on
+ * shared memory, which PULP cannot issue through SVM; threads only race on words they all set to
+ * the same or to an equally valid value.
+ *
+ *   bfs()            level-synchronous breadth-first search; with predecessor arrays, it switches
+ *                    between top-down and bottom-up steps (direction-optimizing BFS)
+ *   cc_propagate()   weakly connected components by label propagation
+ *   pagerank()       pull-based PageRank with a fixed number of iterations
+ *   triangles()      number of edge pairs u->v, v->w closed by an edge u->w
+ *
+ * The host additionally computes the components by union-find with compare-and-swap, and serial
+ * references on the CSR layout cross-validate all kernels.
+ */
+
+#define BFS_UNVISITED UINT_MAX
+
+#ifndef BFS_ALPHA
+  #define BFS_ALPHA 14      // switch to bottom-up if the frontier has > 1/ALPHA unvisited edges
+#endif
+#ifndef BFS_BETA
+  #define BFS_BETA  24      // switch back to top-down if the frontier has < 1/BETA of vertices
+#endif
+#ifndef BFS_SOURCE
+  #define BFS_SOURCE 0      // source of the BFS in the benchmark
+#endif
+#ifndef PR_DAMPING
+  #define PR_DAMPING 0.85f
+#endif
+#ifndef PR_ITERATIONS
+  #define PR_ITERATIONS 20  // PageRank iterations in the benchmark
+#endif
+#ifndef PR_TOLERANCE
+  #define PR_TOLERANCE 1e-4f  // relative deviation of the ranks from the reference
+#endif
+#ifndef ANALYTICS_L1_BUDGET_B
+  #define ANALYTICS_L1_BUDGET_B (192*1024)  // L1 memory available for the marks of triangles()
+#endif
+
+#pragma omp declare target
+
+/**
+ * Breadth-first search from `source`.  `levels[v]` is set to the distance of v from the source or
+ * BFS_UNVISITED.  Without predecessor arrays (`preds` = NULL), all steps are top-down.
+ *
+ * @return  Number of levels, i.e., the largest distance + 1.
+ */
+static inline unsigned bfs(vertex* vertices, const vertex_preds* preds, unsigned n_vertices,
+    unsigned source, unsigned* levels, int svm);
+
+/**
+ * Label every vertex with the smallest vertex ID of its weakly connected component.
+ *
+ * @return  Number of propagation sweeps.
+ */
+static inline unsigned cc_propagate(vertex* vertices, unsigned n_vertices, unsigned* labels,
+    int svm);
+
+/**
+ * Compute `n_iterations` PageRank iterations into `ranks`, using `ranks_tmp` as second buffer.
+ * The ranks of vertices without successors are distributed over all vertices.
+ */
+static inline void pagerank(vertex* vertices, const vertex_preds* preds, unsigned n_vertices,
+    unsigned n_iterations, float* ranks, float* ranks_tmp, int svm);
+
+/**
+ * Count the pairs of edges u->v, v->w for which an edge u->w exists.  `marks` provides
+ * omp_get_max_threads() x `n_vertices` bytes of scratch memory; without it (NULL), the edges u->w
+ * are searched for in the successors of u.
+ */
+static inline unsigned long long triangles(vertex* vertices, unsigned n_vertices,
+    unsigned char* marks, int svm);
+
+static inline unsigned bfs(vertex* const vertices, const vertex_preds* const preds,
+    const unsigned n_vertices, const unsigned source, unsigned* const levels, const int svm)
+{
+  unsigned long long m_unvisited = 0;   // edges out of unvisited vertices
+  #pragma omp parallel for reduction(+: m_unvisited)
+  for (unsigned v=0; v<n_vertices; v++) {
+    list_write(&levels[v], v == source ? 0 : BFS_UNVISITED, svm);
+    m_unvisited += list_n_successors(&vertices[v], svm);
+  }
+
+  int      bottom_up = 0;
+  unsigned depth     = 0;
+  for (;;) {
+    // size of the frontier, in vertices and in edges
+    unsigned           n_frontier = 0;
+    unsigned long long m_frontier = 0;
+    #pragma omp parallel for reduction(+: n_frontier, m_frontier)
+    for (unsigned v=0; v<n_vertices; v++) {
+      if (list_read(&levels[v], svm) == depth) {
+        n_frontier++;
+        m_frontier += list_n_successors(&vertices[v], svm);
+      }
+    }
+    if (n_frontier == 0)
+      break;
+    m_unvisited -= m_frontier;
+
+    if (preds != NULL) {
+      if (!bottom_up && (m_frontier > m_unvisited/BFS_ALPHA))
+        bottom_up = 1;
+      else if (bottom_up && (n_frontier < n_vertices/BFS_BETA))
+        bottom_up = 0;
+    }
+
+    if (bottom_up) {
+      // every unvisited vertex looks for a predecessor in the frontier
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (unsigned v=0; v<n_vertices; v++) {
+        if (list_read(&levels[v], svm) != BFS_UNVISITED)
+          continue;
+        const unsigned n_preds = list_read(&preds[v].n_predecessors, svm);
+        vertex** const p       = (vertex **)list_read_ptr((void * const *)&preds[v].predecessors,
+          svm);
+        for (unsigned j=0; j<n_preds; j++) {
+          const unsigned u = list_id(list_successor(p, j, svm), svm);
+          if (list_read(&levels[u], svm) == depth) {
+            list_write(&levels[v], depth+1, svm);
+            break;
+          }
+        }
+      }
+    }
+    else {
+      // every frontier vertex visits its successors; racing threads write the same level
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (unsigned v=0; v<n_vertices; v++) {
+        if (list_read(&levels[v], svm) != depth)
+          continue;
+        const unsigned n_succs = list_n_successors(&vertices[v], svm);
+        vertex** const s       = list_successors(&vertices[v], svm);
+        for (unsigned j=0; j<n_succs; j++) {
+          const unsigned u = list_id(list_successor(s, j, svm), svm);
+          if (list_read(&levels[u], svm) == BFS_UNVISITED)
+            list_write(&levels[u], depth+1, svm);
+        }
+      }
+    }
+    depth++;
+  }
+
+  return depth;
+}
+
+static inline unsigned cc_propagate(vertex* const vertices, const unsigned n_vertices,
+    unsigned* const labels, const int svm)
+{
+  #pragma omp parallel for
+  for (unsigned v=0; v<n_vertices; v++)
+    list_write(&labels[v], v, svm);
+
+  // Labels only decrease to IDs of the same component, so a sweep without changes leaves every
+  // component labeled with its smallest ID.  A write racing with a smaller one delays convergence
+  // by a sweep, at worst.
+  unsigned n_sweeps = 0;
+  int      changed  = 1;
+  while (changed) {
+    changed = 0;
+    #pragma omp parallel for schedule(dynamic, 64) reduction(|: changed)
+    for (unsigned v=0; v<n_vertices; v++) {
+      const unsigned label_v = list_read(&labels[v], svm);
+      unsigned       label   = label_v;
+      const unsigned n_succs = list_n_successors(&vertices[v], svm);
+      vertex** const s       = list_successors(&vertices[v], svm);
+      for (unsigned j=0; j<n_succs; j++) {
+        const unsigned u       = list_id(list_successor(s, j, svm), svm);
+        const unsigned label_u = list_read(&labels[u], svm);
+        if (label_u < label)
+          label = label_u;
+        else if (label_u > label) {
+          list_write(&labels[u], label, svm);
+          changed = 1;
+        }
+      }
+      if (label < label_v) {
+        list_write(&labels[v], label, svm);
+        changed = 1;
+      }
+    }
+    n_sweeps++;
+  }
+
+  return n_sweeps;
+}
+
+static inline void pagerank(vertex* const vertices, const vertex_preds* const preds,
+    const unsigned n_vertices, const unsigned n_iterations, float* const ranks,
+    float* const ranks_tmp, const int svm)
+{
+  #pragma omp parallel for
+  for (unsigned v=0; v<n_vertices; v++)
+    list_write_f32(&ranks[v], 1.0f/n_vertices, svm);
+
+  float* cur  = ranks;
+  float* next = ranks_tmp;
+  for (unsigned it=0; it<n_iterations; it++) {
+    float dangling = 0;
+    #pragma omp parallel for reduction(+: dangling)
+    for (unsigned v=0; v<n_vertices; v++) {
+      if (list_n_successors(&vertices[v], svm) == 0)
+        dangling += list_read_f32(&cur[v], svm);
+    }
+    const float base = (1.0f - PR_DAMPING + PR_DAMPING*dangling) / n_vertices;
+
+    // every vertex pulls the shares of its predecessors
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (unsigned v=0; v<n_vertices; v++) {
+      const unsigned n_preds = list_read(&preds[v].n_predecessors, svm);
+      vertex** const p       = (vertex **)list_read_ptr((void * const *)&preds[v].predecessors,
+        svm);
+      float sum = 0;
+      for (unsigned j=0; j<n_preds; j++) {
+        const vertex* const u = list_successor(p, j, svm);
+        sum += list_read_f32(&cur[list_id(u, svm)], svm) / list_n_successors(u, svm);
+      }
+      list_write_f32(&next[v], base + PR_DAMPING*sum, svm);
+    }
+
+    float* const tmp = cur;
+    cur  = next;
+    next = tmp;
+  }
+
+  if (cur != ranks) {
+    #pragma omp parallel for
+    for (unsigned v=0; v<n_vertices; v++)
+      list_write_f32(&ranks[v], list_read_f32(&cur[v], svm), svm);
+  }
+}
+
+static inline unsigned long long triangles(vertex* const vertices, const unsigned n_vertices,
+    unsigned char* const marks, const int svm)
+{
+  unsigned long long n_triangles = 0;
+
+  #pragma omp parallel reduction(+: n_triangles)
+  {
+    unsigned char* const mark = marks != NULL ? marks + (size_t)omp_get_thread_num()*n_vertices
+      : NULL;
+    if (mark != NULL) {
+      for (unsigned v=0; v<n_vertices; v++)
+        mark[v] = 0;
+    }
+
+    #pragma omp for schedule(dynamic, 16)
+    for (unsigned u=0; u<n_vertices; u++) {
+      const unsigned n_succs_u = list_n_successors(&vertices[u], svm);
+      vertex** const s_u       = list_successors(&vertices[u], svm);
+      if (mark != NULL) {
+        for (unsigned j=0; j<n_succs_u; j++)
+          mark[list_id(list_successor(s_u, j, svm), svm)] = 1;
+      }
+
+      for (unsigned j=0; j<n_succs_u; j++) {
+        const vertex* const v   = list_successor(s_u, j, svm);
+        const unsigned n_succs_v = list_n_successors(v, svm);
+        vertex** const s_v       = list_successors(v, svm);
+        for (unsigned k=0; k<n_succs_v; k++) {
+          const unsigned w = list_id(list_successor(s_v, k, svm), svm);
+          if (mark != NULL)
+            n_triangles += mark[w];
+          else {
+            for (unsigned l=0; l<n_succs_u; l++) {
+              if (list_id(list_successor(s_u, l, svm), svm) == w) {
+                n_triangles++;
+                break;
+              }
+            }
+          }
+        }
+      }
+
+      if (mark != NULL) {
+        for (unsigned j=0; j<n_succs_u; j++)
+          mark[list_id(list_successor(s_u, j, svm), svm)] = 0;
+      }
+    }
+  }
+
+  return n_triangles;
+}
+
+#pragma omp end declare target
+
+/**
+ * Label every vertex with the smallest vertex ID of its weakly connected component, by union-find
+ * over the edges with compare-and-swap (host only).  `parents` provides `n_vertices` entries of
+ * scratch memory.
+ */
+static inline void cc_union_find(vertex* vertices, unsigned n_vertices, unsigned* parents,
+    unsigned* labels);
+
+/**
+ * Serial references on the CSR layout, with the results of the kernels above.
+ */
+static inline unsigned bfs_ref(const csr_graph* graph, unsigned source, unsigned* levels);
+static inline void cc_ref(const csr_graph* graph, unsigned* labels);
+static inline void pagerank_ref(const csr_graph* graph, unsigned n_iterations, float* ranks,
+    float* ranks_tmp);
+static inline unsigned long long triangles_ref(const csr_graph* graph);
+
+/*
+ * Root of the tree of `v`, halving the path on the way.
+ */
+static inline unsigned __cc_find(unsigned* const parents, unsigned v)
+{
+  for (;;) {
+    unsigned       p  = __atomic_load_n(&parents[v], __ATOMIC_RELAXED);
+    const unsigned gp = __atomic_load_n(&parents[p], __ATOMIC_RELAXED);
+    if (p == gp)
+      return p;
+    // a failed shortcut is harmless, the next iteration sees the current parent
+    __atomic_compare_exchange_n(&parents[v], &p, gp, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    v = gp;
+  }
+}
+
+static inline void cc_union_find(vertex* const vertices, const unsigned n_vertices,
+    unsigned* const parents, unsigned* const labels)
+{
+  #pragma omp parallel
+  {
+    #pragma omp for
+    for (unsigned v=0; v<n_vertices; v++)
+      parents[v] = v;
+
+    // link the larger root below the smaller one, so every root is the smallest ID of its tree
+    #pragma omp for schedule(dynamic, 64)
+    for (unsigned v=0; v<n_vertices; v++) {
+      for (unsigned j=0; j<vertices[v].n_successors; j++) {
+        unsigned a = v;
+        unsigned b = vertices[v].successors[j]->vertex_id;
+        for (;;) {
+          a = __cc_find(parents, a);
+          b = __cc_find(parents, b);
+          if (a == b)
+            break;
+          if (a < b) {
+            const unsigned t = a;
+            a = b;
+            b = t;
+          }
+          unsigned expected = a;
+          if (__atomic_compare_exchange_n(&parents[a], &expected, b, 0, __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED))
+            break;
+        }
+      }
+    }
+
+    #pragma omp for
+    for (unsigned v=0; v<n_vertices; v++)
+      labels[v] = __cc_find(parents, v);
+  }
+}
+
+static inline unsigned bfs_ref(const csr_graph* const graph, const unsigned source,
+    unsigned* const levels)
+{
+  unsigned* const queue = (unsigned *)malloc(((size_t)graph->n_vertices+1)*sizeof(unsigned));
+  if (queue == NULL)
+    return 0;
+
+  for (unsigned v=0; v<graph->n_vertices; v++)
+    levels[v] = BFS_UNVISITED;
+  levels[source] = 0;
+  queue[0] = source;
+  unsigned head = 0, tail = 1, n_levels = 1;
+  while (head < tail) {
+    const unsigned v = queue[head++];
+    for (unsigned e=graph->offsets[v]; e<graph->offsets[v+1]; e++) {
+      const unsigned u = graph->neighbors[e];
+      if (levels[u] == BFS_UNVISITED) {
+        levels[u] = levels[v] + 1;
+        n_levels  = levels[u] + 1;
+        queue[tail++] = u;
+      }
+    }
+  }
+
+  free(queue);
+  return n_levels;
+}
+
+static inline void cc_ref(const csr_graph* const graph, unsigned* const labels)
+{
+  // serial union-find without ranks, the smaller root wins
+  for (unsigned v=0; v<graph->n_vertices; v++)
+    labels[v] = v;
+  for (unsigned v=0; v<graph->n_vertices; v++) {
+    for (unsigned e=graph->offsets[v]; e<graph->offsets[v+1]; e++) {
+      unsigned a = v, b = graph->neighbors[e];
+      while (labels[a] != a)
+        a = labels[a];
+      while (labels[b] != b)
+        b = labels[b];
+      if (a < b)
+        labels[b] = a;
+      else
+        labels[a] = b;
+    }
+  }
+  for (unsigned v=0; v<graph->n_vertices; v++) {
+    unsigned r = v;
+    while (labels[r] != r)
+      r = labels[r];
+    labels[v] = r;
+  }
+}
+
+static inline void pagerank_ref(const csr_graph* const graph, const unsigned n_iterations,
+    float* const ranks, float* const ranks_tmp)
+{
+  // push-based, i.e., in a different summation order than the kernel
+  const unsigned n = graph->n_vertices;
+  for (unsigned v=0; v<n; v++)
+    ranks[v] = 1.0f/n;
+  for (unsigned it=0; it<n_iterations; it++) {
+    float dangling = 0;
+    for (unsigned v=0; v<n; v++) {
+      if (graph->offsets[v+1] == graph->offsets[v])
+        dangling += ranks[v];
+    }
+    const float base = (1.0f - PR_DAMPING + PR_DAMPING*dangling) / n;
+    for (unsigned v=0; v<n; v++)
+      ranks_tmp[v] = 0;
+    for (unsigned v=0; v<n; v++) {
+      const unsigned degree = graph->offsets[v+1] - graph->offsets[v];
+      for (unsigned e=graph->offsets[v]; e<graph->offsets[v+1]; e++)
+        ranks_tmp[graph->neighbors[e]] += ranks[v] / degree;
+    }
+    for (unsigned v=0; v<n; v++)
+      ranks[v] = base + PR_DAMPING*ranks_tmp[v];
+  }
+}
+
+static inline unsigned long long triangles_ref(const csr_graph* const graph)
+{
+  unsigned long long n_triangles = 0;
+  for (unsigned u=0; u<graph->n_vertices; u++) {
+    for (unsigned e=graph->offsets[u]; e<graph->offsets[u+1]; e++) {
+      const unsigned v = graph->neighbors[e];
+      for (unsigned f=graph->offsets[v]; f<graph->offsets[v+1]; f++) {
+        const unsigned w = graph->neighbors[f];
+        for (unsigned g=graph->offsets[u]; g<graph->offsets[u+1]; g++) {
+          if (graph->neighbors[g] == w) {
+            n_triangles++;
+            break;
+          }
+        }
+      }
+    }
+  }
+  return n_triangles;
+}
+
+#endif
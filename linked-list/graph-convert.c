@@ -0,0 +1,65 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Convert a text edge list, or a synthetic graph (see graph-gen.h), into a binary graph file (see
+ * graph.h), which `linked-list` maps into memory instead of parsing or generating it.
+ *
+ * Usage: graph-convert [-p] <edge list | graph specification> <binary graph file>
+ *
+ *   -p  also write the (zeroed) payloads, which are then mapped instead of allocated
+ */
+
+#include <errno.h>        // for error codes
+#include <stdio.h>
+#include <string.h>
+#include "graph.h"
+#include "graph-gen.h"
+
+int main(int argc, char *argv[])
+{
+  int with_payloads = 0;
+  int arg = 1;
+  if ( (argc > arg) && (strcmp(argv[arg], "-p") == 0) ) {
+    with_payloads = 1;
+    arg++;
+  }
+  if (argc != arg+2) {
+    printf("Usage: %s [-p] <edge list | graph specification> <binary graph file>\n", argv[0]);
+    return -EINVAL;
+  }
+  const char* const in_name  = argv[arg];
+  const char* const out_name = argv[arg+1];
+
+  csr_graph graph = { 0 };
+  int err = graph_open(&graph, in_name);
+  if (err == -ENOENT)
+    printf("ERROR: Could not open input file %s.\n", in_name);
+  else if (err == -ENOMEM)
+    printf("ERROR: malloc() failed.\n");
+  if (err)
+    return err;
+
+  err = graph_save_binary(&graph, out_name, with_payloads);
+  if (err)
+    printf("ERROR: Could not write %s.\n", out_name);
+  else
+    printf("%s: %u vertices, %u edges%s\n", out_name, graph.n_vertices, graph.n_edges,
+      with_payloads ? ", with payloads" : "");
+
+  csr_free(&graph);
+  return err;
+}
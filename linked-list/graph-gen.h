@@ -0,0 +1,275 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GRAPH_GEN_H__
+#define __GRAPH_GEN_H__
+
+#include <errno.h>      // error codes
+#include <limits.h>     // UINT_MAX
+#include <stdint.h>     // uint64_t
+#include <stdio.h>      // printf()
+#include <stdlib.h>     // free(), malloc(), strtod(), strtoull()
+#include <string.h>     // strchr(), strncmp()
+#include "graph.h"
+
+/*
+ * Synthetic graphs
+ *
+ * Instead of a file, every program taking a graph accepts a specification
+ *
+ *   <kind>:<vertices>[:<edges>[:<skew>[:<seed>]]]
+ *
+ * where the counts take the suffixes K, M and G (powers of 1024), e.g. `rmat:1M:16M:0.57:1`.
+ * The edges are generated in parallel straight into the arrays the loader parses an edge list
+ * into, and placed into the CSR layout by the same code, so no file is involved.
+ *
+ *   rmat     R-MAT: every edge descends into one of the four quadrants of the adjacency matrix,
+ *            with probabilities a = skew, and b, c, d in the ratio 0.19 : 0.19 : 0.05 of the
+ *            Graph500 generator, until it reaches a single entry.  The larger the skew, the more
+ *            the edges concentrate on a few vertices with low IDs; skew = 0.57 gives the Graph500
+ *            graphs.
+ *   uniform  Erdos-Renyi: the end points of every edge are uniformly random.
+ *   grid     2D grid, as square as possible, with edges to the 4 neighbors of every vertex; the
+ *            number of edges follows from the vertices.
+ *
+ * Edges default to GRAPH_GEN_EDGE_FACTOR times the vertices.  Edge e is drawn from random numbers
+ * seeded with (seed, e) only, so a specification always gives the same graph, with any number of
+ * threads.  Like edge lists, the graphs may have self loops and duplicate edges.
+ */
+
+#ifndef GRAPH_GEN_EDGE_FACTOR
+  #define GRAPH_GEN_EDGE_FACTOR 16  // default edges per vertex, as in Graph500
+#endif
+#ifndef GRAPH_GEN_SKEW
+  #define GRAPH_GEN_SKEW 0.57       // default skew of R-MAT graphs
+#endif
+
+typedef enum {
+  GRAPH_GEN_RMAT,
+  GRAPH_GEN_UNIFORM,
+  GRAPH_GEN_GRID,
+} graph_gen_kind_t;
+
+typedef struct {
+  graph_gen_kind_t    kind;
+  unsigned            n_vertices;
+  unsigned            n_edges;    // ignored for grids
+  double              skew;       // only used for R-MAT graphs
+  unsigned long long  seed;
+} graph_gen_params;
+
+/**
+ * Parse a graph specification.  Omitted fields get their defaults.
+ *
+ * @return  0 on success; -EINVAL if `spec` is no valid specification.
+ */
+static inline int graph_gen_parse(const char* spec, graph_gen_params* params);
+
+/**
+ * Generate a graph, with zeroed payloads.
+ *
+ * @return  0 on success; -EINVAL if the graph has no vertices or too many edges; -ENOMEM if the
+ *          memory cannot be allocated.
+ */
+static inline int graph_generate(csr_graph* graph, const graph_gen_params* params);
+
+/**
+ * Generate a graph if `name` is a graph specification, or load it with graph_load() otherwise.
+ *
+ * @return  See graph_generate() and graph_load().
+ */
+static inline int graph_open(csr_graph* graph, const char* name);
+
+/**
+ * Parse a count with an optional suffix K, M or G, and advance `*str` past it.
+ *
+ * @return  0 on success; -EINVAL if there is no count or it exceeds UINT_MAX.
+ */
+static inline int graph_gen_parse_count(const char** str, unsigned long long* count);
+
+static inline int graph_gen_parse_count(const char** const str, unsigned long long* const count)
+{
+  char* end;
+  unsigned long long n = strtoull(*str, &end, 10);
+  if (end == *str)
+    return -EINVAL;
+  switch (*end) {
+    case 'K': n <<= 10; end++; break;
+    case 'M': n <<= 20; end++; break;
+    case 'G': n <<= 30; end++; break;
+    default: break;
+  }
+  if (n > UINT_MAX)
+    return -EINVAL;
+  *count = n;
+  *str   = end;
+  return 0;
+}
+
+static inline int graph_gen_parse(const char* const spec, graph_gen_params* const params)
+{
+  static const struct { const char* name; graph_gen_kind_t kind; } kinds[] = {
+    { "rmat:", GRAPH_GEN_RMAT }, { "uniform:", GRAPH_GEN_UNIFORM }, { "grid:", GRAPH_GEN_GRID },
+  };
+
+  const char* p = NULL;
+  for (unsigned k=0; k<sizeof(kinds)/sizeof(kinds[0]); k++) {
+    if (strncmp(spec, kinds[k].name, strlen(kinds[k].name)) == 0) {
+      params->kind = kinds[k].kind;
+      p = spec + strlen(kinds[k].name);
+    }
+  }
+  if (p == NULL)
+    return -EINVAL;
+
+  unsigned long long n;
+  if ( (graph_gen_parse_count(&p, &n) != 0) || (n == 0) )
+    return -EINVAL;
+  params->n_vertices = (unsigned)n;
+  params->n_edges    = n*GRAPH_GEN_EDGE_FACTOR < UINT_MAX ? n*GRAPH_GEN_EDGE_FACTOR : UINT_MAX-1;
+  params->skew       = GRAPH_GEN_SKEW;
+  params->seed       = 1;
+
+  if (*p == ':') {
+    p++;
+    if (graph_gen_parse_count(&p, &n) != 0)
+      return -EINVAL;
+    params->n_edges = (unsigned)n;
+  }
+  if (*p == ':') {
+    char* end;
+    params->skew = strtod(++p, &end);
+    if ( (end == p) || (params->skew < 0.25) || (params->skew >= 1) )
+      return -EINVAL;
+    p = end;
+  }
+  if (*p == ':') {
+    char* end;
+    params->seed = strtoull(++p, &end, 10);
+    if (end == p)
+      return -EINVAL;
+    p = end;
+  }
+  return *p == '\0' ? 0 : -EINVAL;
+}
+
+/*
+ * Random number `i` of the stream `stream` (SplitMix64, which passes BigCrush with any seed).
+ */
+static inline uint64_t __graph_gen_rand(const uint64_t stream, const uint64_t i)
+{
+  uint64_t z = stream + (i+1)*0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static inline int graph_generate(csr_graph* const graph, const graph_gen_params* const params)
+{
+  const unsigned n_vertices = params->n_vertices;
+  if (n_vertices == 0)
+    return -EINVAL;
+
+  // grids with the smallest width w such that w*w >= n_vertices
+  unsigned width = 1;
+  while ((unsigned long long)width*width < n_vertices)
+    width++;
+
+  unsigned long long n_edges = params->n_edges;
+  if (params->kind == GRAPH_GEN_GRID) {
+    n_edges = 0;
+    for (unsigned v=0; v<n_vertices; v++) {
+      n_edges += (v % width > 0) + (v % width < width-1 && v+1 < n_vertices);
+      n_edges += (v >= width) + (v+width < n_vertices);
+    }
+  }
+  if (n_edges >= UINT_MAX)
+    return -EINVAL;
+
+  unsigned* const from = (unsigned *)malloc((n_edges+1)*sizeof(unsigned));
+  unsigned* const to   = (unsigned *)malloc((n_edges+1)*sizeof(unsigned));
+  if ( (from == NULL) || (to == NULL) ) {
+    free(from);
+    free(to);
+    return -ENOMEM;
+  }
+
+  if (params->kind == GRAPH_GEN_GRID) {
+    // neighbors left, right, up and down, in the order of the sources
+    unsigned e = 0;
+    for (unsigned v=0; v<n_vertices; v++) {
+      const unsigned col = v % width;
+      if (col > 0)                                  { from[e] = v; to[e++] = v-1;     }
+      if ( (col < width-1) && (v+1 < n_vertices) )  { from[e] = v; to[e++] = v+1;     }
+      if (v >= width)                               { from[e] = v; to[e++] = v-width; }
+      if (v+width < n_vertices)                     { from[e] = v; to[e++] = v+width; }
+    }
+  }
+  else {
+    // R-MAT draws one random number per level, up to the smallest power of 2 >= n_vertices
+    unsigned scale = 0;
+    while ((1ull << scale) < n_vertices)
+      scale++;
+    const double a  = params->skew;
+    const double ab = a + (1-a)*0.19/0.43;
+    const double c_norm = (1-a)*0.19/0.43 / (1-ab);   // P(c | c or d)
+    const double a_norm = a / ab;                     // P(a | a or b)
+    const uint64_t stream = __graph_gen_rand(params->seed, UINT64_MAX - params->kind);
+    const int rmat = params->kind == GRAPH_GEN_RMAT;
+
+    #pragma omp parallel for schedule(static)
+    for (unsigned e=0; e<(unsigned)n_edges; e++) {
+      const uint64_t edge_stream = __graph_gen_rand(stream, e);
+      uint64_t i = 0;
+      unsigned u, v;
+      do {   // R-MAT vertices beyond n_vertices are drawn again
+        if (rmat) {
+          u = 0;
+          v = 0;
+          for (unsigned l=0; l<scale; l++) {
+            const double r_row = (double)(__graph_gen_rand(edge_stream, i++) >> 11) * 0x1p-53;
+            const double r_col = (double)(__graph_gen_rand(edge_stream, i++) >> 11) * 0x1p-53;
+            const unsigned row = r_row >= ab;
+            const unsigned col = r_col >= (row ? c_norm : a_norm);
+            u = (u << 1) | row;
+            v = (v << 1) | col;
+          }
+        }
+        else {
+          u = (unsigned)((__graph_gen_rand(edge_stream, i++) >> 32) * n_vertices >> 32);
+          v = (unsigned)((__graph_gen_rand(edge_stream, i++) >> 32) * n_vertices >> 32);
+        }
+      } while ( (u >= n_vertices) || (v >= n_vertices) );
+      from[e] = u;
+      to[e]   = v;
+    }
+  }
+
+  const int err = __graph_from_edges(graph, n_vertices, (unsigned)n_edges, from, to);
+  free(from);
+  free(to);
+  return err;
+}
+
+static inline int graph_open(csr_graph* const graph, const char* const name)
+{
+  graph_gen_params params;
+  if ( (strchr(name, ':') != NULL) && (graph_gen_parse(name, &params) == 0) )
+    return graph_generate(graph, &params);
+  return graph_load(graph, name);
+}
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scaling study of the graph kernels on the host
+ *
+ * Generates synthetic graphs (see graph-gen.h) whose linked list takes from <min size> to
+ * <max size> bytes, 4x more each step, and runs the host kernels on every one of them, so the
+ * throughput can be followed from graphs that fit into the caches to ones that do not.
+ *
+ * Usage: graph-scale [<kind> [<min size> [<max size> [<edges per vertex>]]]]
+ *
+ *   kind              rmat, uniform or grid (default: rmat)
+ *   min size          smallest linked list, with suffix K, M or G (default: 16K)
+ *   max size          largest linked list (default: 1G)
+ *   edges per vertex  default: GRAPH_GEN_EDGE_FACTOR; grids always have about 4
+ */
+
+#include <errno.h>        // for error codes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "bench.h"
+#include "analytics.h"
+#include "graph.h"
+#include "graph-gen.h"
+#include "pred-count.h"
+#include "vertex.h"
+
+#define SCALE_MAX_STEPS 16
+
+typedef struct {
+  unsigned long long  size_b;
+  unsigned            n_vertices;
+  unsigned            n_edges;
+  unsigned            n_edges_bfs;  // edges traversed by the BFS, i.e., leaving reached vertices
+  double              ms[4];        // BFS, BFS direction-optimizing, PageRank, predecessors
+} scale_row;
+
+static const char* const scale_kernels[] = { "BFS", "BFS-DO", "PageRank", "Predecessors" };
+
+/*
+ * Format a number of bytes with a binary unit.
+ */
+static void format_size(char* const buf, const size_t len, const unsigned long long size_b)
+{
+  static const char* const units[] = { "B", "KiB", "MiB", "GiB" };
+  unsigned u = 0;
+  double size = size_b;
+  while ( (size >= 1024) && (u < 3) ) {
+    size /= 1024;
+    u++;
+  }
+  snprintf(buf, len, "%.4g %s", size, units[u]);
+}
+
+/*
+ * Generate a graph, build its linked list and predecessor arrays, and time the kernels on it.
+ */
+static int scale_step(const graph_gen_params* const params, scale_row* const row)
+{
+  char size[32];
+  format_size(size, sizeof(size), row->size_b);
+
+  csr_graph graph = { 0 };
+  bench_start("Host - %s - Generate", size);
+  int err = graph_generate(&graph, params);
+  bench_stop();
+  if (err)
+    return err;
+
+  const unsigned n_vertices = graph.n_vertices;
+  vertex*       vertices = NULL;
+  vertex_preds* preds    = NULL;
+  unsigned* const levels     = malloc(n_vertices*sizeof(unsigned));
+  unsigned* const levels_ref = malloc(n_vertices*sizeof(unsigned));
+  float* const    ranks      = malloc(n_vertices*sizeof(float));
+  float* const    ranks_tmp  = malloc(n_vertices*sizeof(float));
+  unsigned* const counts     = malloc(n_vertices*sizeof(unsigned));
+  bench_start("Host - %s - Build Linked List", size);
+  if ( (levels == NULL) || (levels_ref == NULL) || (ranks == NULL) || (ranks_tmp == NULL) ||
+       (counts == NULL) || (list_from_csr(&vertices, &graph) != 0) ||
+       (list_transpose(&preds, vertices, n_vertices) != 0) )
+    err = -ENOMEM;
+  bench_stop();
+
+  // the list holds the payloads from here on
+  free(graph.payloads);
+  graph.payloads = NULL;
+
+  row->n_vertices = n_vertices;
+  row->n_edges    = graph.n_edges;
+
+  bench_region_t region;
+  if (!err) {
+    BENCH_REGION(region, "Host - %s - BFS - top-down", size) {
+      bfs(vertices, NULL, n_vertices, 0, levels_ref, 0);
+    }
+    row->ms[0] = region.stats.median_ms;
+
+    BENCH_REGION(region, "Host - %s - BFS - direction-optimizing", size) {
+      bfs(vertices, preds, n_vertices, 0, levels, 0);
+    }
+    row->ms[1] = region.stats.median_ms;
+    for (unsigned v=0; v<n_vertices; v++) {
+      if (levels_ref[v] != BFS_UNVISITED)
+        row->n_edges_bfs += graph.offsets[v+1] - graph.offsets[v];
+    }
+    if (memcmp(levels, levels_ref, n_vertices*sizeof(unsigned)) != 0) {
+      printf("ERROR: The BFS levels differ between top-down and direction-optimizing BFS!\n");
+      err = 1;
+    }
+
+    BENCH_REGION(region, "Host - %s - PageRank", size) {
+      pagerank(vertices, preds, n_vertices, PR_ITERATIONS, ranks, ranks_tmp, 0);
+    }
+    row->ms[2] = region.stats.median_ms / PR_ITERATIONS;
+
+    const pred_strategy_t strategy = pred_choose(n_vertices, graph.n_edges, omp_get_max_threads(),
+      PRED_HOST_CACHE_B);
+    BENCH_REGION(region, "Host - %s - CSR - Predecessors - %s", size,
+        pred_strategy_name(strategy)) {
+      if (pred_count(strategy, &graph, counts) != 0)
+        err = -ENOMEM;
+    }
+    row->ms[3] = region.stats.median_ms;
+  }
+
+  if (preds != NULL)
+    list_preds_free(preds, n_vertices);
+  if (vertices != NULL)
+    list_free(vertices, n_vertices);
+  free(levels);
+  free(levels_ref);
+  free(ranks);
+  free(ranks_tmp);
+  free(counts);
+  csr_free(&graph);
+  return err;
+}
+
+int main(int argc, char *argv[])
+{
+  char spec[64];
+  const char* const kind = argc > 1 ? argv[1] : "rmat";
+  const char* min_str    = argc > 2 ? argv[2] : "16K";
+  const char* max_str    = argc > 3 ? argv[3] : "1G";
+  unsigned edge_factor   = argc > 4 ? strtoul(argv[4], NULL, 10) : GRAPH_GEN_EDGE_FACTOR;
+
+  // parse the arguments as the graph specification of the smallest graph
+  graph_gen_params params;
+  unsigned long long min_b, max_b;
+  snprintf(spec, sizeof(spec), "%s:1", kind);
+  if ( (argc > 5) || (graph_gen_parse(spec, &params) != 0) ||
+       (graph_gen_parse_count(&min_str, &min_b) != 0) ||
+       (graph_gen_parse_count(&max_str, &max_b) != 0) || (edge_factor == 0) ) {
+    printf("Usage: %s [<rmat | uniform | grid> [<min size> [<max size> [<edges per vertex>]]]]\n",
+      argv[0]);
+    return -EINVAL;
+  }
+  if (params.kind == GRAPH_GEN_GRID)
+    edge_factor = 4;
+
+  const size_t size_b_vertex = sizeof(vertex) + edge_factor*sizeof(vertex *);
+  printf("HERO graph scaling started: %s graphs with %u edges per vertex, %zu B per vertex.\n",
+    kind, edge_factor, size_b_vertex);
+
+  scale_row rows[SCALE_MAX_STEPS];
+  unsigned  n_rows = 0;
+  int       err    = 0;
+  for (unsigned long long size_b=min_b; (size_b <= max_b) && (n_rows < SCALE_MAX_STEPS);
+       size_b*=4) {
+    const unsigned long long n_vertices = size_b / size_b_vertex;
+    if ( (n_vertices == 0) || (n_vertices*edge_factor >= UINT_MAX) )
+      continue;
+    params.n_vertices = (unsigned)n_vertices;
+    params.n_edges    = (unsigned)(n_vertices*edge_factor);
+
+    scale_row* const row = &rows[n_rows++];
+    memset(row, 0, sizeof(*row));
+    row->size_b = size_b;
+    err = scale_step(&params, row);
+    if (err == -ENOMEM)
+      printf("ERROR: malloc() failed.\n");
+    if (err) {
+      n_rows--;
+      break;
+    }
+  }
+
+  // throughput in million traversed edges per second: for the BFS, as in Graph500, the edges
+  // leaving the reached vertices; for the other kernels, which visit every edge, all edges, and
+  // PageRank per iteration
+  printf("\n%10s %10s %11s %11s", "List", "Vertices", "Edges", "BFS edges");
+  for (unsigned k=0; k<sizeof(scale_kernels)/sizeof(scale_kernels[0]); k++)
+    printf(" %12s", scale_kernels[k]);
+  printf("   [MTEPS]\n");
+  for (unsigned r=0; r<n_rows; r++) {
+    char size[32];
+    format_size(size, sizeof(size), rows[r].size_b);
+    printf("%10s %10u %11u %11u", size, rows[r].n_vertices, rows[r].n_edges, rows[r].n_edges_bfs);
+    for (unsigned k=0; k<sizeof(scale_kernels)/sizeof(scale_kernels[0]); k++) {
+      const unsigned n_edges = k < 2 ? rows[r].n_edges_bfs : rows[r].n_edges;
+      printf(" %12.1f", rows[r].ms[k] > 0 ? n_edges / rows[r].ms[k] / 1e3 : 0);
+    }
+    printf("\n");
+  }
+
+  return err;
+}
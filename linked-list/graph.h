@@ -0,0 +1,521 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GRAPH_H__
+#define __GRAPH_H__
+
+#include <errno.h>      // error codes
+#include <fcntl.h>      // open()
+#include <limits.h>     // UINT_MAX
+#include <stdint.h>     // uint32_t, uint64_t
+#include <stdio.h>      // printf()
+#include <stdlib.h>     // calloc(), free(), malloc()
+#include <string.h>     // memcmp(), memcpy()
+#include <sys/mman.h>   // mmap(), munmap()
+#include <sys/stat.h>   // fstat()
+#include <unistd.h>     // close()
+
+#ifdef _OPENMP
+  #include <omp.h>      // omp_get_max_threads()
+#endif
+
+#ifndef PAYLOAD_SIZE_B
+  #define PAYLOAD_SIZE_B 0x100
+#endif
+
+#ifndef GRAPH_CHUNK_MIN_B
+  #define GRAPH_CHUNK_MIN_B (64*1024)  // smallest part of an edge list parsed by one thread
+#endif
+
+/*
+ * Binary graph files
+ *
+ * A binary graph file holds the CSR arrays in the layout used in memory, in the byte order of the
+ * machine that wrote it:
+ *
+ *   graph_file_header   32 B
+ *   offsets             (n_vertices + 1) * 4 B
+ *   neighbors           n_edges * 4 B
+ *   payloads            n_vertices * payload_size_b B at `payloads_pos`, aligned to
+ *                       GRAPH_FILE_ALIGN (optional, payload_size_b is 0 without them)
+ *
+ * Such a file is not parsed but mapped into memory, and the arrays of the graph point into the
+ * mapping, which also serves as the shared virtual memory buffer offloaded to PULP.  Only the
+ * header, the size of the file and the first and last offset are checked, so loading takes the
+ * same time for every graph; the pages are read on the first access.  The rest of the arrays is
+ * trusted: the kernels index with the offsets and neighbor IDs unchecked, so a file corrupted in
+ * between makes them access memory out of bounds.  Building with GRAPH_CHECK = 1 checks all
+ * offsets and neighbor IDs with graph_check() when a file is mapped, at the price of reading it.
+ */
+
+#ifndef GRAPH_CHECK
+  #define GRAPH_CHECK 0   // check the CSR arrays of mapped binary graph files (see graph_check())
+#endif
+
+#define GRAPH_FILE_MAGIC   "HEROCSR"  // including the terminating NUL, 8 bytes
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_ALIGN   64
+
+typedef struct {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  n_vertices;
+  uint32_t  n_edges;
+  uint32_t  payload_size_b;   // 0 if the file has no payloads
+  uint64_t  payloads_pos;     // offset of the payloads in the file, 0 if it has none
+} graph_file_header;
+
+/*
+ * Compressed sparse row (CSR) layout of a directed graph: the successors of vertex i are the
+ * vertex IDs neighbors[offsets[i]] to neighbors[offsets[i+1]-1], in the order of the input.
+ * Offsets and neighbors are contiguous arrays of 32-bit entries, and the payloads are kept apart,
+ * so walking the graph structure does not touch them.
+ */
+typedef struct {
+  unsigned int    n_vertices;
+  unsigned int    n_edges;
+  unsigned int*   offsets;      // n_vertices + 1 entries
+  unsigned int*   neighbors;    // n_edges entries
+  unsigned char*  payloads;     // n_vertices * PAYLOAD_SIZE_B bytes
+  void*           map;          // mapping of a binary graph file the arrays point into, or NULL
+  size_t          map_size_b;
+  int             payloads_mapped;
+} csr_graph;
+
+/**
+ * Load a graph from a text file with one edge `vertex_from vertex_to` per line.  Empty lines and
+ * lines starting with `#` are skipped, as is anything following the two vertex IDs of a line.
+ * The graph has max(vertex ID) + 1 vertices; the payloads are zeroed.
+ *
+ * The file is mapped into memory and parsed in parallel, in chunks of whole lines: a first pass
+ * counts the edges of every chunk, and a second one writes them to the positions given by the
+ * prefix sums of the counts.  The edges are then placed into the CSR arrays with the prefix sums
+ * of the vertex degrees, all in O(E).
+ *
+ * @return  0 on success; -ENOENT if the file cannot be read; -EINVAL if it is malformed; -ENOMEM if
+ *          the memory cannot be allocated.
+ */
+static inline int graph_load_edge_list(csr_graph* graph, const char* path);
+
+/**
+ * Map a binary graph file into memory.  Files without payloads get zeroed ones.
+ *
+ * @return  0 on success; -ENOENT if the file cannot be read or mapped; -EINVAL if it is no binary
+ *          graph file, is truncated, its offsets do not start at 0 and end at n_edges (or, with
+ *          GRAPH_CHECK, fail graph_check()), or its payloads are not PAYLOAD_SIZE_B large;
+ *          -ENOMEM if the payloads cannot be allocated.
+ */
+static inline int graph_map_binary(csr_graph* graph, const char* path);
+
+/**
+ * Check the CSR arrays of a graph: the offsets start at 0, do not decrease and end at n_edges, and
+ * all neighbor IDs are less than n_vertices.
+ *
+ * @return  0 if the arrays are consistent; -EINVAL otherwise.
+ */
+static inline int graph_check(const csr_graph* graph);
+
+/**
+ * Write a graph to a binary graph file, with or without its payloads.
+ *
+ * @return  0 on success; -ENOENT if the file cannot be created; -EIO if writing fails.
+ */
+static inline int graph_save_binary(const csr_graph* graph, const char* path, int with_payloads);
+
+/**
+ * Load a graph from a binary graph file or, if the file does not start with GRAPH_FILE_MAGIC, from
+ * a text edge list.
+ *
+ * @return  See graph_map_binary() and graph_load_edge_list().
+ */
+static inline int graph_load(csr_graph* graph, const char* path);
+
+/**
+ * Free the arrays of a graph, or unmap them for a mapped binary graph file.
+ */
+static inline void csr_free(csr_graph* graph);
+
+/*
+ * Parse the edges of the lines in [p, end).  If `from` and `to` are not NULL, the edges are stored
+ * there.  Returns the number of edges, or -EINVAL for a malformed line.
+ */
+static inline long long __graph_parse(const char* p, const char* const end, unsigned* const from,
+    unsigned* const to, unsigned* const max_vertex)
+{
+  long long n_edges = 0;
+  unsigned  max     = 0;
+
+  while (p < end) {
+    while ( (p < end) && ( (*p == ' ') || (*p == '\t') || (*p == '\r') ) )
+      p++;
+    if ( (p < end) && (*p != '\n') && (*p != '#') ) {
+      unsigned long long ids[2];
+      for (unsigned i=0; i<2; i++) {
+        while ( (i > 0) && (p < end) && ( (*p == ' ') || (*p == '\t') ) )
+          p++;
+        if ( (p == end) || (*p < '0') || (*p > '9') )
+          return -EINVAL;
+        ids[i] = 0;
+        while ( (p < end) && (*p >= '0') && (*p <= '9') ) {
+          ids[i] = ids[i]*10 + (*p - '0');
+          if (ids[i] >= UINT_MAX)
+            return -EINVAL;
+          p++;
+        }
+      }
+      if (from != NULL) {
+        from[n_edges] = (unsigned)ids[0];
+        to[n_edges]   = (unsigned)ids[1];
+      }
+      n_edges++;
+      if (ids[0] > max)
+        max = (unsigned)ids[0];
+      if (ids[1] > max)
+        max = (unsigned)ids[1];
+    }
+    // skip the rest of the line
+    while ( (p < end) && (*p != '\n') )
+      p++;
+    p++;
+  }
+
+  *max_vertex = max;
+  return n_edges;
+}
+
+/*
+ * Build the CSR arrays from a list of edges.
+ */
+static inline int __graph_from_edges(csr_graph* const graph, const unsigned n_vertices,
+    const unsigned n_edges, const unsigned* const from, const unsigned* const to)
+{
+  graph->n_vertices      = n_vertices;
+  graph->n_edges         = n_edges;
+  graph->map             = NULL;
+  graph->map_size_b      = 0;
+  graph->payloads_mapped = 0;
+  graph->offsets    = (unsigned *)calloc((size_t)n_vertices+1, sizeof(unsigned));
+  graph->neighbors  = (unsigned *)malloc(((size_t)n_edges+1)*sizeof(unsigned));
+  graph->payloads   = (unsigned char *)calloc(n_vertices, PAYLOAD_SIZE_B);
+  unsigned* cursor  = (unsigned *)malloc((size_t)n_vertices*sizeof(unsigned));
+  if ( (graph->offsets == NULL) || (graph->neighbors == NULL) || (graph->payloads == NULL) ||
+       (cursor == NULL) ) {
+    csr_free(graph);
+    free(cursor);
+    return -ENOMEM;
+  }
+
+  // degrees, then their prefix sums
+  unsigned* const offsets = graph->offsets;
+  #pragma omp parallel for
+  for (unsigned e=0; e<n_edges; e++) {
+    #pragma omp atomic update
+    offsets[from[e]+1]++;
+  }
+  for (unsigned i=0; i<n_vertices; i++)
+    offsets[i+1] += offsets[i];
+
+  // place the edges in the order of the input
+  memcpy(cursor, offsets, (size_t)n_vertices*sizeof(unsigned));
+  for (unsigned e=0; e<n_edges; e++)
+    graph->neighbors[cursor[from[e]]++] = to[e];
+
+  free(cursor);
+  return 0;
+}
+
+static inline int graph_load_edge_list(csr_graph* const graph, const char* const path)
+{
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -ENOENT;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -ENOENT;
+  }
+  const size_t size_b = (size_t)st.st_size;
+  const char*  data   = NULL;
+  if (size_b > 0) {
+    data = (const char *)mmap(NULL, size_b, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -ENOENT;
+    }
+  }
+  close(fd);
+
+  // Split the file into chunks of whole lines, a few per thread for load balance.
+  unsigned n_chunks = 1;
+#ifdef _OPENMP
+  n_chunks = 4*omp_get_max_threads();
+#endif
+  if (n_chunks > size_b/GRAPH_CHUNK_MIN_B + 1)
+    n_chunks = size_b/GRAPH_CHUNK_MIN_B + 1;
+
+  size_t*    bounds  = (size_t *)malloc((n_chunks+1)*sizeof(size_t));
+  long long* n_edges = (long long *)malloc((n_chunks+1)*sizeof(long long));
+  unsigned*  max     = (unsigned *)malloc(n_chunks*sizeof(unsigned));
+  if ( (bounds == NULL) || (n_edges == NULL) || (max == NULL) ) {
+    free(bounds);
+    free(n_edges);
+    free(max);
+    if (data != NULL)
+      munmap((void *)data, size_b);
+    return -ENOMEM;
+  }
+  bounds[0] = 0;
+  for (unsigned c=1; c<n_chunks; c++) {
+    size_t b = c*(size_b/n_chunks);
+    if (b < bounds[c-1])
+      b = bounds[c-1];
+    while ( (b < size_b) && (b > 0) && (data[b-1] != '\n') )
+      b++;
+    bounds[c] = b;
+  }
+  bounds[n_chunks] = size_b;
+
+  // first pass: count the edges of every chunk
+  #pragma omp parallel for schedule(dynamic)
+  for (unsigned c=0; c<n_chunks; c++)
+    n_edges[c] = __graph_parse(data + bounds[c], data + bounds[c+1], NULL, NULL, &max[c]);
+
+  int       err         = 0;
+  long long n_edges_sum = 0;
+  unsigned  max_vertex  = 0;
+  for (unsigned c=0; c<n_chunks; c++) {
+    if (n_edges[c] < 0)
+      err = -EINVAL;
+    const long long n = n_edges[c];
+    n_edges[c]   = n_edges_sum;   // offset of the chunk
+    n_edges_sum += n;
+    if (max[c] > max_vertex)
+      max_vertex = max[c];
+  }
+  n_edges[n_chunks] = n_edges_sum;
+  if ( !err && (n_edges_sum >= UINT_MAX) )
+    err = -EINVAL;
+  if (err)
+    printf("ERROR: %s is not a valid edge list!\n", path);
+
+  // second pass: store the edges at the offsets of their chunks
+  unsigned* from = NULL;
+  unsigned* to   = NULL;
+  if (!err) {
+    from = (unsigned *)malloc(((size_t)n_edges_sum+1)*sizeof(unsigned));
+    to   = (unsigned *)malloc(((size_t)n_edges_sum+1)*sizeof(unsigned));
+    if ( (from == NULL) || (to == NULL) )
+      err = -ENOMEM;
+  }
+  if (!err) {
+    #pragma omp parallel for schedule(dynamic)
+    for (unsigned c=0; c<n_chunks; c++) {
+      unsigned max_chunk;
+      __graph_parse(data + bounds[c], data + bounds[c+1], from + n_edges[c], to + n_edges[c],
+        &max_chunk);
+    }
+    err = __graph_from_edges(graph, max_vertex+1, (unsigned)n_edges_sum, from, to);
+  }
+
+  free(from);
+  free(to);
+  free(bounds);
+  free(n_edges);
+  free(max);
+  if (data != NULL)
+    munmap((void *)data, size_b);
+
+  return err;
+}
+
+/*
+ * Position of the payloads in a binary graph file.
+ */
+static inline uint64_t __graph_file_payloads_pos(const uint32_t n_vertices, const uint32_t n_edges)
+{
+  const uint64_t end = sizeof(graph_file_header) + ((uint64_t)n_vertices+1 + n_edges)*4;
+  return (end + GRAPH_FILE_ALIGN-1) / GRAPH_FILE_ALIGN * GRAPH_FILE_ALIGN;
+}
+
+static inline int graph_map_binary(csr_graph* const graph, const char* const path)
+{
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -ENOENT;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -ENOENT;
+  }
+  const size_t size_b = (size_t)st.st_size;
+  if (size_b < sizeof(graph_file_header)) {
+    close(fd);
+    printf("ERROR: %s is not a binary graph file!\n", path);
+    return -EINVAL;
+  }
+  // private and writable: the payloads can be modified without changing the file
+  void* const map = mmap(NULL, size_b, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -ENOENT;
+
+  const graph_file_header* const header = (const graph_file_header *)map;
+  const uint64_t payloads_pos = __graph_file_payloads_pos(header->n_vertices, header->n_edges);
+  const uint64_t arrays_end   = sizeof(graph_file_header)
+    + ((uint64_t)header->n_vertices+1 + header->n_edges)*4;
+  int err = 0;
+  if ( (memcmp(header->magic, GRAPH_FILE_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->version != GRAPH_FILE_VERSION) || (header->n_vertices >= UINT_MAX) ||
+       (arrays_end > size_b) ) {
+    printf("ERROR: %s is not a binary graph file of version %u!\n", path, GRAPH_FILE_VERSION);
+    err = -EINVAL;
+  }
+  else if ( (header->payload_size_b != 0) && ( (header->payload_size_b != PAYLOAD_SIZE_B) ||
+            (header->payloads_pos != payloads_pos) ||
+            (payloads_pos + (uint64_t)header->n_vertices*PAYLOAD_SIZE_B > size_b) ) ) {
+    printf("ERROR: The payloads of %s do not match PAYLOAD_SIZE_B = %u!\n", path,
+      (unsigned)PAYLOAD_SIZE_B);
+    err = -EINVAL;
+  }
+  else {
+    const uint32_t* const offsets = (const uint32_t *)(header + 1);
+    if ( (offsets[0] != 0) || (offsets[header->n_vertices] != header->n_edges) ) {
+      printf("ERROR: The offsets of %s do not span its %u edges!\n", path, header->n_edges);
+      err = -EINVAL;
+    }
+  }
+  if (err) {
+    munmap(map, size_b);
+    return err;
+  }
+
+  unsigned char* const base = (unsigned char *)map;
+  graph->n_vertices      = header->n_vertices;
+  graph->n_edges         = header->n_edges;
+  graph->offsets         = (unsigned *)(base + sizeof(graph_file_header));
+  graph->neighbors       = graph->offsets + graph->n_vertices + 1;
+  graph->map             = map;
+  graph->map_size_b      = size_b;
+  graph->payloads_mapped = header->payload_size_b != 0;
+#if GRAPH_CHECK
+  if (graph_check(graph) != 0) {
+    printf("ERROR: The CSR arrays of %s are inconsistent!\n", path);
+    munmap(map, size_b);
+    return -EINVAL;
+  }
+#endif
+  if (graph->payloads_mapped)
+    graph->payloads = base + payloads_pos;
+  else {
+    graph->payloads = (unsigned char *)calloc(graph->n_vertices, PAYLOAD_SIZE_B);
+    if (graph->payloads == NULL) {
+      munmap(map, size_b);
+      return -ENOMEM;
+    }
+  }
+
+  return 0;
+}
+
+static inline int graph_check(const csr_graph* const graph)
+{
+  const unsigned  n_vertices = graph->n_vertices;
+  const unsigned* offsets    = graph->offsets;
+  const unsigned* neighbors  = graph->neighbors;
+  if ( (offsets[0] != 0) || (offsets[n_vertices] != graph->n_edges) )
+    return -EINVAL;
+
+  // the neighbors of a vertex are only read once its offsets are known to be in bounds
+  const unsigned n_edges = graph->n_edges;
+  unsigned n_errors = 0;
+  #pragma omp parallel for schedule(dynamic, 1024) reduction(+: n_errors)
+  for (unsigned v=0; v<n_vertices; v++) {
+    if ( (offsets[v] > offsets[v+1]) || (offsets[v+1] > n_edges) ) {
+      n_errors++;
+      continue;
+    }
+    for (unsigned e=offsets[v]; e<offsets[v+1]; e++)
+      n_errors += neighbors[e] >= n_vertices;
+  }
+  return n_errors > 0 ? -EINVAL : 0;
+}
+
+static inline int graph_save_binary(const csr_graph* const graph, const char* const path,
+    const int with_payloads)
+{
+  graph_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(header.magic));
+  header.version        = GRAPH_FILE_VERSION;
+  header.n_vertices     = graph->n_vertices;
+  header.n_edges        = graph->n_edges;
+  header.payload_size_b = with_payloads ? PAYLOAD_SIZE_B : 0;
+  header.payloads_pos   = with_payloads ? __graph_file_payloads_pos(graph->n_vertices,
+    graph->n_edges) : 0;
+
+  FILE* const fp = fopen(path, "wb");
+  if (fp == NULL)
+    return -ENOENT;
+
+  int ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+  ok = ok && (fwrite(graph->offsets, sizeof(unsigned), (size_t)graph->n_vertices+1, fp)
+    == (size_t)graph->n_vertices+1);
+  ok = ok && (fwrite(graph->neighbors, sizeof(unsigned), graph->n_edges, fp) == graph->n_edges);
+  if (with_payloads) {
+    const char zeros[GRAPH_FILE_ALIGN] = {0};
+    const uint64_t arrays_end = sizeof(header) + ((uint64_t)graph->n_vertices+1 + graph->n_edges)*4;
+    const size_t   padding_b  = (size_t)(header.payloads_pos - arrays_end);
+    ok = ok && (fwrite(zeros, 1, padding_b, fp) == padding_b);
+    ok = ok && (fwrite(graph->payloads, PAYLOAD_SIZE_B, graph->n_vertices, fp)
+      == graph->n_vertices);
+  }
+  ok = (fclose(fp) == 0) && ok;
+
+  return ok ? 0 : -EIO;
+}
+
+static inline int graph_load(csr_graph* const graph, const char* const path)
+{
+  FILE* const fp = fopen(path, "rb");
+  if (fp == NULL)
+    return -ENOENT;
+  char magic[sizeof(((graph_file_header *)0)->magic)];
+  const int is_binary = (fread(magic, sizeof(magic), 1, fp) == 1) &&
+    (memcmp(magic, GRAPH_FILE_MAGIC, sizeof(magic)) == 0);
+  fclose(fp);
+
+  return is_binary ? graph_map_binary(graph, path) : graph_load_edge_list(graph, path);
+}
+
+static inline void csr_free(csr_graph* const graph)
+{
+  if (graph->map != NULL) {
+    munmap(graph->map, graph->map_size_b);
+    if (!graph->payloads_mapped)
+      free(graph->payloads);
+  }
+  else {
+    free(graph->offsets);
+    free(graph->neighbors);
+    free(graph->payloads);
+  }
+  graph->map       = NULL;
+  graph->offsets   = NULL;
+  graph->neighbors = NULL;
+  graph->payloads  = NULL;
+}
+
+#endif
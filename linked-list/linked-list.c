@@ -22,102 +22,388 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>        // for error codes
+#include <stddef.h>       // offsetof()
+#include <math.h>         // fabsf()
 #include "bench.h"
+#include "analytics.h"
+#include "graph.h"
+#include "graph-gen.h"
+#include "pred-count.h"
+#include "svm-gather.h"
+#include "verify.h"
+#include "vertex.h"
+#include "vertex-layout.h"
 #include <hero-target.h>
 
 #ifndef PAYLOAD_SIZE_B
   #define PAYLOAD_SIZE_B 0x100
 #endif
+#ifndef GATHER_BLOCK
+  #define GATHER_BLOCK 32   // vertices whose metadata is gathered at once
+#endif
+#ifndef GATHER_EDGES
+  #define GATHER_EDGES 128  // successors staged in L1 per core
+#endif
 
-typedef struct vertex vertex;
+typedef enum {
+  BFS_TOP_DOWN,
+  BFS_DIRECTION_OPTIMIZING,
+  CC_PROPAGATE,
+  PAGERANK,
+  TRIANGLES,
+} analytics_kernel_t;
 
-struct vertex {
-  unsigned int  vertex_id;
-  unsigned int  n_successors;
-  vertex**      successors;
-  unsigned char payload [PAYLOAD_SIZE_B];
-};
+static const char* const analytics_names[] = { "BFS - top-down", "BFS - direction-optimizing",
+  "CC - label propagation", "PageRank", "Triangles" };
 
-int main(int argc, char *argv[])
+#pragma omp declare target
+
+/**
+ * Run one kernel of analytics.h on the host (`svm` = 0) or on PULP (`svm` = 1).  BFS writes the
+ * levels and CC the labels to `out`, PageRank writes `ranks`.
+ *
+ * @return  Number of levels for BFS, of sweeps for CC, and of triangles for Triangles.
+ */
+static inline unsigned long long analytics_kernel(analytics_kernel_t kernel, vertex* vertices,
+    const vertex_preds* preds, unsigned n_vertices, unsigned* out, float* ranks, float* ranks_tmp,
+    unsigned char* marks, int svm);
+
+static inline unsigned long long analytics_kernel(const analytics_kernel_t kernel,
+    vertex * const vertices, const vertex_preds * const preds, const unsigned n_vertices,
+    unsigned * const out, float * const ranks, float * const ranks_tmp,
+    unsigned char * const marks, const int svm)
 {
-  printf("HERO linked list started.\n");
+  const unsigned source = BFS_SOURCE < n_vertices ? BFS_SOURCE : 0;
+  switch (kernel) {
+    case BFS_TOP_DOWN:
+      return bfs(vertices, NULL, n_vertices, source, out, svm);
+    case BFS_DIRECTION_OPTIMIZING:
+      return bfs(vertices, preds, n_vertices, source, out, svm);
+    case CC_PROPAGATE:
+      return cc_propagate(vertices, n_vertices, out, svm);
+    case PAGERANK:
+      pagerank(vertices, preds, n_vertices, PR_ITERATIONS, ranks, ranks_tmp, svm);
+      return PR_ITERATIONS;
+    default:
+      return triangles(vertices, n_vertices, marks, svm);
+  }
+}
 
-  char file_name[30] = "tutte.txt";
-  if( argc > 1 ) {
-    strcpy(file_name, argv[1]);
+#pragma omp end declare target
+
+/**
+ * Compare ranks with a relative tolerance of PR_TOLERANCE.
+ *
+ * @return  Number of mismatches.
+ */
+unsigned check_ranks(const float* ranks, const float* ref, unsigned n_vertices, const char* label);
+
+unsigned check_ranks(const float * const ranks, const float * const ref, const unsigned n_vertices,
+    const char * const label)
+{
+  unsigned n_mismatches = 0;
+  for (unsigned v=0; v<n_vertices; v++) {
+    if (!(fabsf(ranks[v] - ref[v]) <= PR_TOLERANCE*fabsf(ref[v]))) {   // catches NaNs too
+      if (n_mismatches == 0)
+        printf("ERROR: %s: Vertex %u: rank %.8g instead of %.8g\n", label, v, ranks[v], ref[v]);
+      n_mismatches++;
+    }
+  }
+  if (n_mismatches > 0)
+    printf("ERROR: %s: %u of %u ranks mismatch!\n", label, n_mismatches, n_vertices);
+  return n_mismatches;
+}
+
+/**
+ * Run the kernels of analytics.h on the host and on PULP and check them against the serial
+ * references on the CSR layout.
+ *
+ * @return  0 if all results match; 1 on a mismatch; -ENOMEM if memory cannot be allocated.
+ */
+int run_analytics(vertex* vertices, const csr_graph* graph);
+
+int run_analytics(vertex * const vertices, const csr_graph * const graph)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const unsigned source     = BFS_SOURCE < n_vertices ? BFS_SOURCE : 0;
+
+  vertex_preds * preds = NULL;
+  unsigned * const out_ref   = malloc(n_vertices*sizeof(unsigned));
+  unsigned * const out       = malloc(n_vertices*sizeof(unsigned));
+  unsigned * const parents   = malloc(n_vertices*sizeof(unsigned));
+  float * const    ranks_ref = malloc(n_vertices*sizeof(float));
+  float * const    ranks     = malloc(n_vertices*sizeof(float));
+  float * const    ranks_tmp = malloc(n_vertices*sizeof(float));
+  unsigned char *  marks     = malloc((size_t)omp_get_max_threads()*n_vertices);
+  if ( (out_ref == NULL) || (out == NULL) || (parents == NULL) || (ranks_ref == NULL) ||
+       (ranks == NULL) || (ranks_tmp == NULL) || (marks == NULL) ||
+       (list_transpose(&preds, vertices, n_vertices) != 0) ) {
+    printf("ERROR: malloc() failed.\n");
+    return -ENOMEM;
   }
 
   /*
-   * Read graph from file and generate the linked list
+   * Serial references on the CSR layout
    */
-  unsigned int n_vertices = 0;
-  unsigned int n_edges = 0;
-  unsigned int vertex_from = 0, vertex_to = 0;
+  const unsigned n_levels_ref = bfs_ref(graph, source, out_ref);
+  verify_ref_modified();   // out_ref may reuse the memory of a freed reference
+  unsigned n_reached = 0;
+  for (unsigned v=0; v<n_vertices; v++)
+    n_reached += out_ref[v] != BFS_UNVISITED;
+  printf("BFS from vertex %u: %u levels, %u of %u vertices reached\n", source, n_levels_ref,
+    n_reached, n_vertices);
+
+  int err = 0;
+  bench_region_t region;
+  for (unsigned k=BFS_TOP_DOWN; k<=TRIANGLES; k++) {
+    const analytics_kernel_t kernel = (analytics_kernel_t)k;
+
+    // references of this and the following kernels
+    unsigned long long result_ref = n_levels_ref;
+    if (kernel == CC_PROPAGATE) {
+      cc_ref(graph, out_ref);
+      verify_ref_modified();   // out_ref held the BFS levels
+      unsigned n_components = 0;
+      for (unsigned v=0; v<n_vertices; v++)
+        n_components += out_ref[v] == v;
+      printf("CC: %u weakly connected components\n", n_components);
+
+      memset(out, 0xff, n_vertices*sizeof(unsigned));
+      BENCH_REGION(region, "Host - CC - union-find") {
+        cc_union_find(vertices, n_vertices, parents, out);
+      }
+      if (verify_check_u32(out, out_ref, 1, n_vertices, "Host - CC - union-find") != 0)
+        err = 1;
+    }
+    else if (kernel == PAGERANK)
+      pagerank_ref(graph, PR_ITERATIONS, ranks_ref, ranks_tmp);
+    else if (kernel == TRIANGLES) {
+      result_ref = triangles_ref(graph);
+      printf("Triangles: %llu\n", result_ref);
+    }
 
-  vertex * vertices;
+    // host, then PULP with the marks of the triangle count in L1 if they fit
+    for (int svm=0; svm<=1; svm++) {
+      const char* const side = svm ? "PULP" : "Host";
+      unsigned long long result = 0;
+      // poison the results, so that no run can pass on the results of the previous one
+      memset(out, 0xff, n_vertices*sizeof(unsigned));
+      memset(ranks, 0xff, n_vertices*sizeof(float));
+      if (!svm) {
+        BENCH_REGION(region, "Host - %s", analytics_names[kernel]) {
+          result = analytics_kernel(kernel, vertices, preds, n_vertices, out, ranks, ranks_tmp,
+            marks, 0);
+        }
+      }
+      else {
+        unsigned result_pulp[2] = { 0, 0 };
+        BENCH_REGION(region, "PULP - %s", analytics_names[kernel]) {
+          #pragma omp target device(BIGPULP_SVM) \
+            map(to: vertices[0:n_vertices], preds[0:n_vertices], n_vertices, kernel) \
+            map(to: out[0:n_vertices], ranks[0:n_vertices], ranks_tmp[0:n_vertices]) \
+            map(tofrom: result_pulp[0:2])
+          {
+            const unsigned n_vertices_local = hero_tryread((unsigned int *)&n_vertices);
+            const analytics_kernel_t kernel_local =
+              (analytics_kernel_t)hero_tryread((unsigned int *)&kernel);
+            vertex * vertices_local    = (vertex *)tryread_ptr((void **)&vertices);
+            vertex_preds * preds_local = (vertex_preds *)tryread_ptr((void **)&preds);
+            unsigned * out_local       = (unsigned *)tryread_ptr((void **)&out);
+            float * ranks_local        = (float *)tryread_ptr((void **)&ranks);
+            float * ranks_tmp_local    = (float *)tryread_ptr((void **)&ranks_tmp);
+
+            const unsigned size_b_marks = omp_get_max_threads()*n_vertices_local;
+            unsigned char * marks_local = NULL;
+            if ( (kernel_local == TRIANGLES) && (size_b_marks <= ANALYTICS_L1_BUDGET_B) )
+              marks_local = (unsigned char *)hero_l1malloc(size_b_marks);
+
+            const unsigned long long result_local = analytics_kernel(kernel_local, vertices_local,
+              preds_local, n_vertices_local, out_local, ranks_local, ranks_tmp_local, marks_local,
+              1);
+            hero_trywrite(&result_pulp[0], (unsigned)result_local);
+            hero_trywrite(&result_pulp[1], (unsigned)(result_local >> 32));
+
+            if (marks_local != NULL)
+              hero_l1free(marks_local);
+          } // target
+        }
+        result = ((unsigned long long)result_pulp[1] << 32) | result_pulp[0];
+      }
 
-  FILE * fp;
-  if ((fp = fopen(file_name, "r")) == NULL) {
-    printf("ERROR: Could not open input file.\n");
-    return -ENOENT;
+      // cross-validation
+      char label[64];
+      snprintf(label, sizeof(label), "%s - %s", side, analytics_names[kernel]);
+      unsigned n_mismatches = 0;
+      if (kernel == PAGERANK)
+        n_mismatches = check_ranks(ranks, ranks_ref, n_vertices, label);
+      else if (kernel != TRIANGLES)
+        n_mismatches = verify_check_u32(out, out_ref, 1, n_vertices, label);
+      if ( (kernel != CC_PROPAGATE) && (kernel != PAGERANK) && (result != result_ref) ) {
+        printf("ERROR: %s: %llu instead of %llu!\n", label, result, result_ref);
+        n_mismatches++;
+      }
+      if (kernel == CC_PROPAGATE)
+        printf("%s: %llu sweeps\n", label, result);
+      if (n_mismatches > 0)
+        err = 1;
+    }
   }
 
-  // Parse input file to count the number of vertices.
-  // Expected format: vertex_from vertex_to
-  while (fscanf(fp, "%u %u", &vertex_from, &vertex_to) != EOF) {
-    if (vertex_from > n_vertices)
-      n_vertices = vertex_from;
-    else if (vertex_to > n_vertices)
-      n_vertices = vertex_to;
-  }
-  n_vertices++;
+  list_preds_free(preds, n_vertices);
+  free(out_ref);
+  free(out);
+  free(parents);
+  free(ranks_ref);
+  free(ranks);
+  free(ranks_tmp);
+  free(marks);
 
-  // Allocate memory for vertices.
-  vertices = (vertex *)malloc(n_vertices*sizeof(vertex));
-  if (!vertices) {
-    printf("Malloc failed for vertices.\n");
-    return -ENOMEM;
-  }
-  memset((void *)vertices, 0, (size_t)(n_vertices*sizeof(vertex)));
+  return err;
+}
 
-  // Parse input file to count the number of successors of each vertex.
-  fseek(fp, 0L, SEEK_SET);
-  while (fscanf(fp, "%u %u", &vertex_from, &vertex_to) != EOF) {
-    vertices[vertex_from].n_successors++;
-    n_edges++;
+/**
+ * Run the traversals of vertex-layout.h in all layouts with payloads of `payload_size_b` bytes, on
+ * the host and on PULP, and report what they read.
+ *
+ * @return  0 if all results match; 1 on a mismatch; -ENOMEM if memory cannot be allocated.
+ */
+int run_layouts(const csr_graph* graph, unsigned payload_size_b);
+
+int run_layouts(const csr_graph * const graph, const unsigned payload_size_b)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const unsigned n_edges    = graph->n_edges;
+
+  // references on the CSR layout
+  unsigned           max_ref = 0;
+  unsigned long long sum_ref = 0;
+  for (unsigned v=0; v<n_vertices; v++) {
+    const unsigned n_succs = graph->offsets[v+1] - graph->offsets[v];
+    if (n_succs > max_ref)
+      max_ref = n_succs;
+    for (unsigned e=graph->offsets[v]; e<graph->offsets[v+1]; e++)
+      sum_ref += graph->offsets[graph->neighbors[e]+1] - graph->offsets[graph->neighbors[e]];
   }
 
-  // Allocate memory for successor pointers.
-  for (unsigned i = 0; i < n_vertices; i++) {
-    vertices[i].vertex_id = i;
-    if (vertices[i].n_successors > 0) {
-      vertices[i].successors = (vertex **)malloc(vertices[i].n_successors*sizeof(vertex *));
-      if (!vertices[i].successors) {
-        printf("Malloc failed for successors of vertex %d.\n",i);
+  int err = 0;
+  bench_region_t region;
+  for (unsigned l=VERTEX_AOS; l<=VERTEX_SOA; l++) {
+    const vertex_layout_t layout = (vertex_layout_t)l;
+    const char * const    name   = vertex_layout_name(layout);
+
+    vertex_store store;
+    if (vertex_store_build(&store, layout, graph, payload_size_b) != 0) {
+      printf("ERROR: malloc() failed.\n");
+      return -ENOMEM;
+    }
+
+    // bytes read per traversal, on the host and through SVM
+    for (unsigned k=LAYOUT_SCAN; k<=LAYOUT_NEIGHBORS; k++) {
+      layout_touched_t touched;
+      if (layout_touched(&store, (layout_kernel_t)k, &touched) != 0) {
+        printf("ERROR: malloc() failed.\n");
+        vertex_store_free(&store);
         return -ENOMEM;
       }
-      memset((void *)vertices[i].successors, 0, (size_t)(vertices[i].n_successors*sizeof(vertex *)));
+      const unsigned n_units = k == LAYOUT_SCAN ? n_vertices : n_edges;
+      printf("Layout %s, %u B payload, %s: host %.1f KiB in %llu lines (%.1f B/%s), "
+        "SVM %.1f KiB in %llu pages\n", name, payload_size_b,
+        k == LAYOUT_SCAN ? "scan" : "neighbors", touched.lines*LAYOUT_LINE_B/1024.0,
+        touched.lines, n_units > 0 ? (double)touched.lines*LAYOUT_LINE_B/n_units : 0,
+        k == LAYOUT_SCAN ? "vertex" : "edge", touched.svm_words*sizeof(unsigned)/1024.0,
+        touched.pages);
     }
-    else
-      vertices[i].successors = NULL;
-  }
 
-  // Parse input file to set up the successor pointers.
-  fseek(fp, 0L, SEEK_SET);
-  while (fscanf(fp, "%d %d", &vertex_from, &vertex_to) != EOF) {
-    for (unsigned i = 0; i < vertices[vertex_from].n_successors; i++) {
-      if (vertices[vertex_from].successors[i] == NULL) {
-        vertices[vertex_from].successors[i] = &vertices[vertex_to];
-        break;
-      }
-      else if (i == vertices[vertex_from].n_successors-1) {
-        printf("Setting up the successor pointers of virtex %u failed",vertex_from);
-        return -1;
+    unsigned           max = 0;
+    unsigned long long sum = 0;
+    BENCH_REGION(region, "Host - Layout - %s - scan", name) {
+      max = layout_scan(&store, 0);
+    }
+    err |= max != max_ref;
+    BENCH_REGION(region, "Host - Layout - %s - neighbors", name) {
+      sum = layout_neighbors(&store, 0);
+    }
+    err |= sum != sum_ref;
+
+    // PULP, once reading every word with hero_tryread() and once gathering blocks with DMA
+    unsigned results[4] = { 0, 0, 0, 0 };   // scan, gathered scan, neighbors (low, high)
+    for (unsigned k=0; k<3; k++) {
+      BENCH_REGION(region, "PULP - Layout - %s - %s", name,
+          k == 0 ? "scan" : k == 1 ? "scan - gathered" : "neighbors") {
+        #pragma omp target device(BIGPULP_SVM) map(to: store, k) map(tofrom: results[0:4])
+        {
+          vertex_store store_local;
+          vertex_store_read(&store_local, &store);
+          const unsigned k_local = hero_tryread((unsigned int *)&k);
+
+          if (k_local == 0)
+            hero_trywrite(&results[0], layout_scan(&store_local, 1));
+          else if (k_local == 1) {
+            unsigned * staging_local = hero_l1malloc(omp_get_max_threads()*LAYOUT_BLOCK
+              * sizeof(unsigned));
+            if (staging_local == NULL)
+              printf("ERROR: Memory allocation failed!\n");
+            else {
+              hero_trywrite(&results[1], layout_scan_gathered(&store_local, staging_local));
+              hero_l1free(staging_local);
+            }
+          }
+          else {
+            const unsigned long long sum_local = layout_neighbors(&store_local, 1);
+            hero_trywrite(&results[2], (unsigned)sum_local);
+            hero_trywrite(&results[3], (unsigned)(sum_local >> 32));
+          }
+        } // target
       }
     }
+    err |= (results[0] != max_ref) || (results[1] != max_ref);
+    err |= (((unsigned long long)results[3] << 32) | results[2]) != sum_ref;
+
+    vertex_store_free(&store);
+  }
+
+  if (err)
+    printf("ERROR: Results of the vertex layouts do not match!\n");
+  printf("max_successors = %u, sum_successors_of_successors = %llu\n", max_ref, sum_ref);
+  return err;
+}
+
+int main(int argc, char *argv[])
+{
+  printf("HERO linked list started.\n");
+
+  const char* file_name = "tutte.txt";
+  if( argc > 1 ) {
+    file_name = argv[1];
+  }
+  // payload size of the layout comparison, PAYLOAD_SIZE_B is fixed for `struct vertex`
+  const unsigned payload_size_b = argc > 2 ? strtoul(argv[2], NULL, 0) : PAYLOAD_SIZE_B;
+
+  /*
+   * Read graph from file and generate the linked list
+   */
+  csr_graph graph;
+  bench_start("Host - Load Graph");
+  const int err = graph_open(&graph, file_name);
+  bench_stop();
+  if (err == -ENOENT) {
+    printf("ERROR: Could not open input file.\n");
+    return -ENOENT;
   }
+  else if (err == -ENOMEM) {
+    printf("ERROR: malloc() failed.\n");
+    return -ENOMEM;
+  }
+  else if (err != 0)
+    return err;
+  const unsigned n_vertices = graph.n_vertices;
+  unsigned int n_edges = graph.n_edges;
 
-  fclose(fp);
+  vertex * vertices;
+  if (list_from_csr(&vertices, &graph) != 0) {
+    printf("Malloc failed for vertices.\n");
+    return -ENOMEM;
+  }
 
   printf("n_vertices = %u\n", n_vertices);
   unsigned int size_b_vertices;
@@ -128,34 +414,41 @@ int main(int argc, char *argv[])
 
   printf("List start address: %p\n", vertices);
 
+  unsigned int * offsets   = graph.offsets;
+  unsigned int * neighbors = graph.neighbors;
+  const unsigned size_b_offsets   = (n_vertices+1)*sizeof(unsigned);
+  const unsigned size_b_neighbors = n_edges*sizeof(unsigned);
+  printf("CSR size = %.3f KiB without payloads.\n",
+    (float)(size_b_offsets+size_b_neighbors)/1024);
+
   /*
    * Execute on host
    */
   unsigned n_successors_max = 0;
 
-  bench_start("Host - Max Number of Successors");
-  #pragma omp parallel firstprivate(vertices, n_vertices) shared(n_successors_max)
-  {
-    #pragma omp for reduction(max: n_successors_max)
-    for (unsigned i=0; i<n_vertices; i++) {
-      if (n_successors_max < vertices[i].n_successors)
-        n_successors_max = vertices[i].n_successors;
+  bench_region_t region;
+  BENCH_REGION(region, "Host - Max Number of Successors") {
+    #pragma omp parallel firstprivate(vertices, n_vertices) shared(n_successors_max)
+    {
+      #pragma omp for reduction(max: n_successors_max)
+      for (unsigned i=0; i<n_vertices; i++) {
+        if (n_successors_max < vertices[i].n_successors)
+          n_successors_max = vertices[i].n_successors;
+      }
     }
   }
-  bench_stop();
   printf("n_successors_max = %u\n", n_successors_max);
 
-  n_edges = 0;
-
-  bench_start("Host - Number of Edges");
-  #pragma omp parallel firstprivate(vertices, n_vertices) shared(n_edges)
-  {
-    #pragma omp for reduction(+:n_edges)
-    for (unsigned i=0; i<n_vertices; i++) {
-      n_edges += vertices[i].n_successors;
+  BENCH_REGION(region, "Host - Number of Edges") {
+    n_edges = 0;
+    #pragma omp parallel firstprivate(vertices, n_vertices) shared(n_edges)
+    {
+      #pragma omp for reduction(+:n_edges)
+      for (unsigned i=0; i<n_vertices; i++) {
+        n_edges += vertices[i].n_successors;
+      }
     }
   }
-  bench_stop();
   printf("n_edges = %u\n", n_edges);
 
   unsigned n_predecessors_max = 0;
@@ -164,42 +457,123 @@ int main(int argc, char *argv[])
     printf("ERROR: malloc() failed.\n");
     return -ENOMEM;
   }
-  memset((void *)n_predecessors, 0, (size_t)(n_vertices*sizeof(unsigned)));
 
-  bench_start("Host - Max Number of Predecessors");
-  #pragma omp parallel firstprivate(vertices, n_vertices) \
-    shared(n_predecessors, n_predecessors_max)
-  {
-    // get the number of predecessors for every vertex
-    unsigned n_successors_tmp = 0;
-    unsigned vertex_id_tmp    = 0;
-    #pragma omp for
-    for (unsigned i=0; i<n_vertices; i++) {
-      n_successors_tmp = vertices[i].n_successors;
-      for (unsigned j=0; j<n_successors_tmp; j++) {
-        vertex_id_tmp = vertices[i].successors[j]->vertex_id;
-        #pragma omp atomic update
-        n_predecessors[vertex_id_tmp] += 1;
+  BENCH_REGION(region, "Host - Max Number of Predecessors") {
+    #pragma omp parallel firstprivate(vertices, n_vertices) \
+      shared(n_predecessors, n_predecessors_max)
+    {
+      #pragma omp for
+      for (unsigned i=0; i<n_vertices; i++)
+        n_predecessors[i] = 0;
+
+      // get the number of predecessors for every vertex
+      unsigned n_successors_tmp = 0;
+      unsigned vertex_id_tmp    = 0;
+      #pragma omp for
+      for (unsigned i=0; i<n_vertices; i++) {
+        n_successors_tmp = vertices[i].n_successors;
+        for (unsigned j=0; j<n_successors_tmp; j++) {
+          vertex_id_tmp = vertices[i].successors[j]->vertex_id;
+          #pragma omp atomic update
+          n_predecessors[vertex_id_tmp] += 1;
+        }
       }
-    }
 
-    // get the max
-    #pragma omp for reduction(max: n_predecessors_max)
-    for (unsigned i=0; i < n_vertices; i++) {
-      if (n_predecessors[i] > n_predecessors_max)
-        n_predecessors_max = n_predecessors[i];
+      // get the max
+      #pragma omp for reduction(max: n_predecessors_max)
+      for (unsigned i=0; i < n_vertices; i++) {
+        if (n_predecessors[i] > n_predecessors_max)
+          n_predecessors_max = n_predecessors[i];
+      }
     }
   }
-  bench_stop();
   printf("n_predecessors_max = %u\n", n_predecessors_max);
 
   const unsigned n_successors_max_host   = n_successors_max;
   const unsigned n_edges_host            = n_edges;
   const unsigned n_predecessors_max_host = n_predecessors_max;
+
+  /*
+   * Execute on host, CSR layout
+   */
+  unsigned n_successors_max_csr = 0;
+  BENCH_REGION(region, "Host - CSR - Max Number of Successors") {
+    #pragma omp parallel firstprivate(offsets, n_vertices) shared(n_successors_max_csr)
+    {
+      #pragma omp for reduction(max: n_successors_max_csr)
+      for (unsigned i=0; i<n_vertices; i++) {
+        if (n_successors_max_csr < offsets[i+1] - offsets[i])
+          n_successors_max_csr = offsets[i+1] - offsets[i];
+      }
+    }
+  }
+  printf("n_successors_max = %u\n", n_successors_max_csr);
+
+  unsigned n_edges_csr = 0;
+  BENCH_REGION(region, "Host - CSR - Number of Edges") {
+    n_edges_csr = 0;
+    #pragma omp parallel firstprivate(offsets, n_vertices) shared(n_edges_csr)
+    {
+      #pragma omp for reduction(+:n_edges_csr)
+      for (unsigned i=0; i<n_vertices; i++) {
+        n_edges_csr += offsets[i+1] - offsets[i];
+      }
+    }
+  }
+  printf("n_edges = %u\n", n_edges_csr);
+
+  // count the predecessors with every strategy of pred-count.h, the atomic one first
+  unsigned* const n_predecessors_ref = malloc(n_vertices*sizeof(unsigned));
+  if (n_predecessors_ref == NULL) {
+    printf("ERROR: malloc() failed.\n");
+    return -ENOMEM;
+  }
+  const pred_strategy_t pred_strategies[] = { PRED_ATOMIC, PRED_PRIVATE, PRED_PARTITION };
+  double pred_time_ms[3];
+  unsigned n_predecessors_max_csr = 0;
+  for (unsigned s=0; s<3; s++) {
+    const char* const name = pred_strategy_name(pred_strategies[s]);
+    int err_pred = 0;
+    BENCH_REGION(region, "Host - CSR - Max Number of Predecessors - %s", name) {
+      err_pred = pred_count(pred_strategies[s], &graph, n_predecessors);
+      n_predecessors_max_csr = 0;
+      #pragma omp parallel for reduction(max: n_predecessors_max_csr)
+      for (unsigned i=0; i < n_vertices; i++) {
+        if (n_predecessors[i] > n_predecessors_max_csr)
+          n_predecessors_max_csr = n_predecessors[i];
+      }
+    }
+    printf("n_predecessors_max = %u\n", n_predecessors_max_csr);
+    pred_time_ms[s] = region.stats.median_ms;
+    if (err_pred) {
+      printf("ERROR: malloc() failed.\n");
+      return -ENOMEM;
+    }
+    if (s == 0)
+      memcpy(n_predecessors_ref, n_predecessors, n_vertices*sizeof(unsigned));
+    else if (verify_check_u32(n_predecessors, n_predecessors_ref, 1, n_vertices, name) != 0)
+      return 1;
+  }
+
+  pred_contention_t contention;
+  pred_contention(n_predecessors_ref, n_vertices, n_edges_host, &contention);
+  const pred_strategy_t pred_strategy = pred_choose(n_vertices, n_edges_host,
+    omp_get_max_threads(), PRED_HOST_CACHE_B);
+  printf("Predecessors: max. %u, mean %.2f, collision probability %.3g %%; "
+    "%s chosen for %d threads\n", contention.max, contention.mean, 100*contention.collision,
+    pred_strategy_name(pred_strategy), omp_get_max_threads());
+  printf("Predecessor counting: atomic %.3f ms, private %.3f ms, partitioned %.3f ms\n",
+    pred_time_ms[0], pred_time_ms[1], pred_time_ms[2]);
+
+  if ( (n_successors_max_csr != n_successors_max_host) || (n_edges_csr != n_edges_host) ||
+       (n_predecessors_max_csr != n_predecessors_max_host) )
+  {
+    printf("ERROR: Results do not match between the list and CSR layouts.\n");
+    return 1;
+  }
+
   n_successors_max = 0;
-  n_edges = 0;
   n_predecessors_max = 0;
-  memset((void *)n_predecessors, 0, (size_t)(n_vertices*sizeof(unsigned)));
 
   /*
    * Excute on PULP
@@ -216,122 +590,422 @@ int main(int argc, char *argv[])
   }
   tmp_1 = tmp_2;
 
-  bench_start("PULP - Max Number of Successors");
-  #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
-    map(tofrom: n_successors_max)
-  {
-    unsigned n_vertices_local       = hero_tryread((unsigned int *)&n_vertices);
-    unsigned n_successors_max_local = hero_tryread((unsigned int *)&n_successors_max);
-    vertex * vertices_local         = (vertex *)hero_tryread((unsigned int *)&vertices);
-
-    #pragma omp parallel firstprivate(vertices_local, n_vertices_local) \
-      shared(n_successors_max_local)
+  BENCH_REGION(region, "PULP - Max Number of Successors") {
+    #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
+      map(tofrom: n_successors_max)
     {
-      unsigned n_successors_tmp = 0;
+      unsigned n_vertices_local       = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_successors_max_local = hero_tryread((unsigned int *)&n_successors_max);
+      vertex * vertices_local         = (vertex *)tryread_ptr((void **)&vertices);
 
-      #pragma omp for reduction(max: n_successors_max_local)
-      for (unsigned i=0; i<n_vertices_local; i++) {
-        n_successors_tmp = hero_tryread((unsigned *)(&(vertices_local[i].n_successors)));
+      #pragma omp parallel firstprivate(vertices_local, n_vertices_local) \
+        shared(n_successors_max_local)
+      {
+        unsigned n_successors_tmp = 0;
 
-        if (n_successors_max_local < n_successors_tmp)
-          n_successors_max_local = n_successors_tmp;
-      }
-    }
+        #pragma omp for reduction(max: n_successors_max_local)
+        for (unsigned i=0; i<n_vertices_local; i++) {
+          n_successors_tmp = hero_tryread((unsigned *)(&(vertices_local[i].n_successors)));
 
-    hero_trywrite(&n_successors_max, n_successors_max_local);
-  } // target
+          if (n_successors_max_local < n_successors_tmp)
+            n_successors_max_local = n_successors_tmp;
+        }
+      }
 
-  bench_stop();
+      hero_trywrite(&n_successors_max, n_successors_max_local);
+    } // target
+  }
   printf("n_successors_max = %u\n", n_successors_max);
 
-  bench_start("PULP - Number of Edges");
-  #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
-    map(tofrom: n_edges)
-  {
-    unsigned n_vertices_local = hero_tryread((unsigned int *)&n_vertices);
-    unsigned n_edges_local    = hero_tryread((unsigned int *)&n_edges);
-    vertex * vertices_local   = (vertex *)hero_tryread((unsigned int *)&vertices);
+  BENCH_REGION(region, "PULP - Number of Edges") {
+    n_edges = 0;
+    #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
+      map(tofrom: n_edges)
+    {
+      unsigned n_vertices_local = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_edges_local    = hero_tryread((unsigned int *)&n_edges);
+      vertex * vertices_local   = (vertex *)tryread_ptr((void **)&vertices);
+
+      #pragma omp parallel firstprivate(vertices_local, n_vertices_local) \
+        shared(n_edges_local)
+      {
+        #pragma omp for reduction(+:n_edges_local)
+        for (unsigned i=0; i<n_vertices_local; i++) {
+          n_edges_local += hero_tryread((unsigned *)(&(vertices_local[i].n_successors)));
+        }
+      }
+
+      hero_trywrite(&n_edges, n_edges_local);
+    } // target
+  }
+  printf("n_edges = %u\n", n_edges);
 
-    #pragma omp parallel firstprivate(vertices_local, n_vertices_local) \
-      shared(n_edges_local)
+  // skipped if the counters of all vertices do not fit into L1
+  unsigned l1_failed = 0;
+  BENCH_REGION(region, "PULP - Max Number of Predecessors") {
+    #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
+      map(tofrom: n_predecessors_max, l1_failed) map(from: n_predecessors[0:n_vertices])
     {
-      #pragma omp for reduction(+:n_edges_local)
-      for (unsigned i=0; i<n_vertices_local; i++) {
-        n_edges_local += hero_tryread((unsigned *)(&(vertices_local[i].n_successors)));
+      unsigned n_vertices_local         = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_predecessors_max_local = hero_tryread((unsigned int *)&n_predecessors_max);
+      vertex * vertices_local           = (vertex *)tryread_ptr((void **)&vertices);
+      unsigned * n_predecessors_local   = NULL;
+      if (n_vertices_local*sizeof(unsigned) <= PRED_L1_BUDGET_B)
+        n_predecessors_local = hero_l1malloc(n_vertices_local * sizeof(unsigned));
+      if (n_predecessors_local == NULL)
+        hero_trywrite(&l1_failed, 1);
+      else {
+        #pragma omp parallel firstprivate(vertices_local, n_vertices_local, n_predecessors_local) \
+          shared(n_predecessors_max_local)
+        {
+          unsigned n_successors_tmp = 0;
+          unsigned vertex_id_tmp    = 0;
+
+          #pragma omp for
+          for (unsigned i=0; i<n_vertices_local; i++)
+            n_predecessors_local[i] = 0;
+
+          // get the number of predecessors for every vertex
+          #pragma omp for
+          for (unsigned i=0; i<n_vertices_local; i++) {
+            n_successors_tmp = hero_tryread((unsigned *)&vertices_local[i].n_successors);
+            for (unsigned j=0; j<n_successors_tmp; j++) {
+              hero_tryread((unsigned *)&vertices_local[i].successors[j]);
+              vertex_id_tmp = hero_tryread((unsigned *)&(vertices[i].successors[j]->vertex_id));
+              #pragma omp atomic update
+              n_predecessors_local[vertex_id_tmp] += 1;
+            }
+          }
+
+          // get the max
+          #pragma omp for reduction(max: n_predecessors_max_local)
+          for (unsigned i=0; i < n_vertices_local; i++) {
+            if (n_predecessors_local[i] > n_predecessors_max_local)
+              n_predecessors_max_local = n_predecessors_local[i];
+          }
+        }
+
+        hero_trywrite(&n_predecessors_max, n_predecessors_max_local);
+
+        hero_dma_memcpy((void *)n_predecessors, (void *)n_predecessors_local,
+          n_vertices*sizeof(unsigned));
+
+        hero_l1free(n_predecessors_local);
       }
-    }
+    } // target
+  }
+  if (l1_failed)
+    printf("WARNING: PULP - Max Number of Predecessors skipped: %u counters do not fit into L1.\n",
+      n_vertices);
+  else
+    printf("n_predecessors_max = %u\n", n_predecessors_max);
+
+  // the same with the metadata and successors of blocks of vertices gathered into L1
+  const unsigned n_predecessors_max_tryread = n_predecessors_max;
+  unsigned l1_failed_gathered = 0;
+  BENCH_REGION(region, "PULP - Max Number of Predecessors - gathered") {
+    n_predecessors_max = 0;
+    #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
+      map(tofrom: n_predecessors_max, l1_failed_gathered) map(from: n_predecessors[0:n_vertices])
+    {
+      unsigned n_vertices_local         = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_predecessors_max_local = hero_tryread((unsigned int *)&n_predecessors_max);
+      vertex * vertices_local           = (vertex *)tryread_ptr((void **)&vertices);
+      unsigned * n_predecessors_local   = NULL;
+      if (n_vertices_local*sizeof(unsigned) <= PRED_L1_BUDGET_B)
+        n_predecessors_local = hero_l1malloc(n_vertices_local * sizeof(unsigned));
+      // staging buffers of every core, pointers first for their alignment
+      const unsigned size_b_staging = GATHER_BLOCK*(sizeof(vertex **) + sizeof(unsigned))
+        + GATHER_EDGES*(sizeof(vertex *) + sizeof(unsigned));
+      char * staging_local = hero_l1malloc(omp_get_max_threads() * size_b_staging);
+      if ( (n_predecessors_local == NULL) || (staging_local == NULL) ) {
+        hero_trywrite(&l1_failed_gathered, 1);
+        if (n_predecessors_local != NULL)
+          hero_l1free(n_predecessors_local);
+        if (staging_local != NULL)
+          hero_l1free(staging_local);
+      }
+      else {
+
+        #pragma omp parallel firstprivate(vertices_local, n_vertices_local, n_predecessors_local) \
+          firstprivate(staging_local) shared(n_predecessors_max_local)
+        {
+          char * const     staging     = staging_local + omp_get_thread_num()*size_b_staging;
+          vertex *** const succ_arrays = (vertex ***)staging;   // successor arrays of the block
+          vertex ** const  succs       = (vertex **)(succ_arrays + GATHER_BLOCK);
+          unsigned * const n_succs     = (unsigned *)(succs + GATHER_EDGES);
+          unsigned * const succ_ids    = n_succs + GATHER_BLOCK;
+
+          #pragma omp for
+          for (unsigned i=0; i<n_vertices_local; i++)
+            n_predecessors_local[i] = 0;
+
+          // get the number of predecessors for every vertex
+          #pragma omp for
+          for (unsigned b=0; b<n_vertices_local; b+=GATHER_BLOCK) {
+            const unsigned n_block = n_vertices_local-b < GATHER_BLOCK ? n_vertices_local-b
+              : GATHER_BLOCK;
+            svm_gather_strided(n_succs, &vertices_local[b].n_successors, n_block, sizeof(vertex),
+              sizeof(unsigned));
+            svm_gather_strided(succ_arrays, &vertices_local[b].successors, n_block, sizeof(vertex),
+              sizeof(vertex **));
+
+            // stage as many successor pointers as fit, gather their IDs, then count
+            unsigned i = 0, j = 0;
+            while (i < n_block) {
+              // at most one transfer per vertex of the block
+              hero_dma_job_t jobs[GATHER_BLOCK];
+              unsigned n_jobs = 0, n_staged = 0;
+              while ( (i < n_block) && (n_staged < GATHER_EDGES) ) {
+                const unsigned n_left = n_succs[i] - j;
+                const unsigned n_copy = n_left < GATHER_EDGES-n_staged ? n_left
+                  : GATHER_EDGES-n_staged;
+                if (n_copy > 0)
+                  jobs[n_jobs++] = hero_dma_memcpy_async((void *)&succs[n_staged],
+                    (void *)&succ_arrays[i][j], n_copy*sizeof(vertex *));
+                n_staged += n_copy;
+                j        += n_copy;
+                if (j == n_succs[i]) {
+                  i++;
+                  j = 0;
+                }
+              }
+              if (n_staged == 0)
+                continue;
+              for (unsigned k=0; k<n_jobs; k++)
+                hero_dma_wait(jobs[k]);
+
+              svm_gather(succ_ids, (void * const *)succs, n_staged, offsetof(vertex, vertex_id),
+                sizeof(unsigned));
+              for (unsigned k=0; k<n_staged; k++) {
+                #pragma omp atomic update
+                n_predecessors_local[succ_ids[k]] += 1;
+              }
+            }
+          }
+
+          // get the max
+          #pragma omp for reduction(max: n_predecessors_max_local)
+          for (unsigned i=0; i < n_vertices_local; i++) {
+            if (n_predecessors_local[i] > n_predecessors_max_local)
+              n_predecessors_max_local = n_predecessors_local[i];
+          }
+        }
 
-    hero_trywrite(&n_edges, n_edges_local);
-  } // target
+        hero_trywrite(&n_predecessors_max, n_predecessors_max_local);
 
-  bench_stop();
-  printf("n_edges = %u\n", n_edges);
+        hero_dma_memcpy((void *)n_predecessors, (void *)n_predecessors_local,
+          n_vertices_local*sizeof(unsigned));
 
-  bench_start("PULP - Max Number of Predecessors");
-  #pragma omp target device(BIGPULP_SVM) map(to: vertices[0:n_vertices], n_vertices) \
-    map(tofrom: n_predecessors_max, n_predecessors[0:n_vertices])
-  {
-    unsigned n_vertices_local         = hero_tryread((unsigned int *)&n_vertices);
-    unsigned n_predecessors_max_local = hero_tryread((unsigned int *)&n_predecessors_max);
-    vertex * vertices_local           = (vertex *)hero_tryread((unsigned int *)&vertices);
-    unsigned * n_predecessors_local   = hero_l1malloc(n_vertices_local * sizeof(unsigned));
-    if (n_predecessors_local == NULL) {
-      printf("ERROR: Memory allocation failed!\n");
-    }
+        hero_l1free(staging_local);
+        hero_l1free(n_predecessors_local);
+      }
+    } // target
+  }
+  if (l1_failed_gathered) {
+    printf("WARNING: PULP - Max Number of Predecessors - gathered skipped: %u counters do not fit "
+      "into L1.\n", n_vertices);
+  }
+  else {
+    printf("n_predecessors_max = %u\n", n_predecessors_max);
+    if (verify_check_u32(n_predecessors, n_predecessors_ref, 1, n_vertices, "PULP - gathered") != 0)
+      return 1;
+  }
 
-    hero_dma_memcpy((void *)n_predecessors_local, (void *)n_predecessors, n_vertices*sizeof(unsigned));
+  // compare results
+  if ( (n_successors_max != n_successors_max_host) ||
+       (n_edges != n_edges_host) ||
+       (!l1_failed_gathered && (n_predecessors_max != n_predecessors_max_host)) ||
+       (!l1_failed && (n_predecessors_max_tryread != n_predecessors_max_host)) )
+  {
+    printf("ERROR: Results do not match between host and PULP.\n");
+    return 1;
+  }
+  n_successors_max = 0;
+  n_predecessors_max = 0;
 
-    #pragma omp parallel firstprivate(vertices_local, n_vertices_local, n_predecessors_local) \
-      shared(n_predecessors_max_local)
+  /*
+   * Execute on PULP, CSR layout
+   */
+  BENCH_REGION(region, "PULP - CSR - Max Number of Successors") {
+    #pragma omp target device(BIGPULP_SVM) map(to: offsets[0:n_vertices+1], n_vertices) \
+      map(tofrom: n_successors_max)
     {
-      unsigned n_successors_tmp = 0;
-      unsigned vertex_id_tmp    = 0;
+      unsigned n_vertices_local       = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_successors_max_local = hero_tryread((unsigned int *)&n_successors_max);
+      unsigned * offsets_local        = (unsigned *)tryread_ptr((void **)&offsets);
 
-      // get the number of predecessors for every vertex
-      #pragma omp for
-      for (unsigned i=0; i<n_vertices_local; i++) {
-        n_successors_tmp = hero_tryread((unsigned *)&vertices_local[i].n_successors);
-        for (unsigned j=0; j<n_successors_tmp; j++) {
-          hero_tryread((unsigned *)&vertices_local[i].successors[j]);
-          vertex_id_tmp = hero_tryread((unsigned *)&(vertices[i].successors[j]->vertex_id));
-          #pragma omp atomic update
-          n_predecessors_local[vertex_id_tmp] += 1;
+      #pragma omp parallel firstprivate(offsets_local, n_vertices_local) \
+        shared(n_successors_max_local)
+      {
+        unsigned n_successors_tmp = 0;
+
+        #pragma omp for reduction(max: n_successors_max_local)
+        for (unsigned i=0; i<n_vertices_local; i++) {
+          n_successors_tmp = hero_tryread(&offsets_local[i+1]) - hero_tryread(&offsets_local[i]);
+
+          if (n_successors_max_local < n_successors_tmp)
+            n_successors_max_local = n_successors_tmp;
         }
       }
 
-      // get the max
-      #pragma omp for reduction(max: n_predecessors_max_local)
-      for (unsigned i=0; i < n_vertices_local; i++) {
-        if (n_predecessors_local[i] > n_predecessors_max_local)
-          n_predecessors_max_local = n_predecessors_local[i];
-      }
-    }
+      hero_trywrite(&n_successors_max, n_successors_max_local);
+    } // target
+  }
+  printf("n_successors_max = %u\n", n_successors_max);
 
-    hero_trywrite(&n_predecessors_max, n_predecessors_max_local);
+  BENCH_REGION(region, "PULP - CSR - Number of Edges") {
+    n_edges = 0;
+    #pragma omp target device(BIGPULP_SVM) map(to: offsets[0:n_vertices+1], n_vertices) \
+      map(tofrom: n_edges)
+    {
+      unsigned n_vertices_local = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_edges_local    = hero_tryread((unsigned int *)&n_edges);
+      unsigned * offsets_local  = (unsigned *)tryread_ptr((void **)&offsets);
+
+      #pragma omp parallel firstprivate(offsets_local, n_vertices_local) \
+        shared(n_edges_local)
+      {
+        #pragma omp for reduction(+:n_edges_local)
+        for (unsigned i=0; i<n_vertices_local; i++) {
+          n_edges_local += hero_tryread(&offsets_local[i+1]) - hero_tryread(&offsets_local[i]);
+        }
+      }
 
-    hero_dma_memcpy((void *)n_predecessors, (void *)n_predecessors_local, n_vertices*sizeof(unsigned));
+      hero_trywrite(&n_edges, n_edges_local);
+    } // target
+  }
+  printf("n_edges = %u\n", n_edges);
 
-    hero_l1free(n_predecessors_local);
-  } // target
+  // private histograms per core if they fit into L1, else one histogram updated atomically if it
+  // fits, else atomic histograms of ranges of vertices that fit, counted one range after the other
+  // (PULP has no memory for the copy of the edges PRED_PARTITION takes)
+  unsigned pred_strategy_pulp = PRED_ATOMIC;
+  unsigned l1_failed_csr      = 0;
+  BENCH_REGION(region, "PULP - CSR - Max Number of Predecessors") {
+    #pragma omp target device(BIGPULP_SVM) \
+      map(to: neighbors[0:n_edges_host], n_vertices, n_edges_host) \
+      map(tofrom: n_predecessors_max, pred_strategy_pulp, l1_failed_csr) \
+      map(from: n_predecessors[0:n_vertices])
+    {
+      unsigned n_vertices_local         = hero_tryread((unsigned int *)&n_vertices);
+      unsigned n_edges_local            = hero_tryread((unsigned int *)&n_edges_host);
+      unsigned n_predecessors_max_local = hero_tryread((unsigned int *)&n_predecessors_max);
+      unsigned * neighbors_local        = (unsigned *)tryread_ptr((void **)&neighbors);
+
+      const unsigned n_cores = omp_get_max_threads();
+      pred_strategy_t strategy = PRED_ATOMIC_RANGED;
+      if (pred_choose(n_vertices_local, n_edges_local, n_cores + 1, PRED_L1_BUDGET_B)
+          == PRED_PRIVATE)
+        strategy = PRED_PRIVATE;
+      else if (n_vertices_local*sizeof(unsigned) <= PRED_L1_BUDGET_B)
+        strategy = PRED_ATOMIC;
+
+      // vertices counted per pass over the edges
+      const unsigned width = strategy == PRED_ATOMIC_RANGED ? PRED_L1_BUDGET_B/sizeof(unsigned)
+        : n_vertices_local;
+      unsigned * n_predecessors_local = hero_l1malloc((strategy == PRED_PRIVATE ? n_cores+1 : 1)
+        * width * sizeof(unsigned));
+      if (n_predecessors_local == NULL)
+        hero_trywrite(&l1_failed_csr, 1);
+      else {
+        unsigned * hists_local = n_predecessors_local + width;
+
+        for (unsigned first=0; first<n_vertices_local; first+=width) {
+          const unsigned n_range = n_vertices_local-first < width ? n_vertices_local-first : width;
+
+          #pragma omp parallel firstprivate(neighbors_local, n_vertices_local, n_edges_local) \
+            firstprivate(n_predecessors_local, hists_local, first, n_range) \
+            shared(n_predecessors_max_local)
+          {
+            if (strategy == PRED_PRIVATE) {
+              // count the edges of this core into its own histogram, then merge by vertex
+              unsigned * const hist = hists_local + omp_get_thread_num()*n_vertices_local;
+              for (unsigned i=0; i<n_vertices_local; i++)
+                hist[i] = 0;
+              #pragma omp for schedule(static)
+              for (unsigned j=0; j<n_edges_local; j++)
+                hist[hero_tryread(&neighbors_local[j])]++;
+
+              const unsigned n_threads = omp_get_num_threads();
+              #pragma omp for schedule(static)
+              for (unsigned i=0; i<n_vertices_local; i++) {
+                unsigned sum = 0;
+                for (unsigned t=0; t<n_threads; t++)
+                  sum += hists_local[t*n_vertices_local + i];
+                n_predecessors_local[i] = sum;
+              }
+            }
+            else {
+              #pragma omp for
+              for (unsigned i=0; i<n_range; i++)
+                n_predecessors_local[i] = 0;
+
+              // count the edges into the range, which covers all vertices unless ranged
+              #pragma omp for
+              for (unsigned j=0; j<n_edges_local; j++) {
+                const unsigned i = hero_tryread(&neighbors_local[j]) - first;
+                if (i < n_range) {
+                  #pragma omp atomic update
+                  n_predecessors_local[i] += 1;
+                }
+              }
+            }
+
+            // get the max
+            #pragma omp for reduction(max: n_predecessors_max_local)
+            for (unsigned i=0; i < n_range; i++) {
+              if (n_predecessors_local[i] > n_predecessors_max_local)
+                n_predecessors_max_local = n_predecessors_local[i];
+            }
+          }
+
+          hero_dma_memcpy((void *)&n_predecessors[first], (void *)n_predecessors_local,
+            n_range*sizeof(unsigned));
+        }
 
-  bench_stop();
-  printf("n_predecessors_max = %u\n", n_predecessors_max);
+        hero_trywrite(&n_predecessors_max, n_predecessors_max_local);
+        hero_trywrite(&pred_strategy_pulp, strategy);
 
-  // compare results
+        hero_l1free(n_predecessors_local);
+      }
+    } // target
+  }
+  if (l1_failed_csr) {
+    printf("ERROR: PULP - CSR - Max Number of Predecessors: L1 allocation failed!\n");
+    return -ENOMEM;
+  }
+  printf("n_predecessors_max = %u (%s)\n", n_predecessors_max,
+    pred_strategy_name((pred_strategy_t)pred_strategy_pulp));
+  if (verify_check_u32(n_predecessors, n_predecessors_ref, 1, n_vertices, "PULP - CSR") != 0)
+    return 1;
   if ( (n_successors_max != n_successors_max_host) ||
        (n_edges != n_edges_host) ||
        (n_predecessors_max != n_predecessors_max_host) )
   {
-    printf("ERROR: Results do not match between host and PULP.\n");
+    printf("ERROR: Results do not match between host and PULP for the CSR layout.\n");
     return 1;
   }
 
+  /*
+   * Graph analytics
+   */
+  const int err_analytics = run_analytics(vertices, &graph);
+  if (err_analytics != 0)
+    return err_analytics;
+
+  /*
+   * Vertex layouts
+   */
+  const int err_layouts = run_layouts(&graph, payload_size_b);
+  if (err_layouts != 0)
+    return err_layouts;
+
   // free memory
   free(n_predecessors);
-  for (unsigned i = 0; i < n_vertices; i++) {
-    free(vertices[i].successors);
-  }
-  free(vertices);
+  free(n_predecessors_ref);
+  csr_free(&graph);
+  list_free(vertices, n_vertices);
 
   return 0;
 }
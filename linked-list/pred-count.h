@@ -0,0 +1,279 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PRED_COUNT_H__
+#define __PRED_COUNT_H__
+
+#include <errno.h>      // error codes
+#include <stdio.h>      // printf()
+#include <stdlib.h>     // free(), malloc()
+#include <omp.h>        // omp_get_max_threads(), omp_get_num_threads(), omp_get_thread_num()
+#include "graph.h"
+
+/*
+ * Counting the predecessors of every vertex of a CSR graph
+ *
+ * Every edge increments the counter of its destination.  With the edges distributed over the
+ * threads, the increments of different threads collide on the same counters, so the baseline
+ * needs an atomic update per edge, which serializes on the vertices with many predecessors.  The
+ * alternatives do without atomics:
+ *
+ *   PRED_ATOMIC     one shared histogram, updated atomically
+ *   PRED_PRIVATE    one histogram per thread, merged in parallel by vertex; costs threads x
+ *                   vertices counters, which must stay in the cache to be fast
+ *   PRED_PARTITION  the destinations of the edges are partitioned into one range of vertices per
+ *                   thread (counting, prefix sums, scatter), and every thread then counts the edges
+ *                   of its range; costs a copy of the edges, but every counter has a single writer
+ *   PRED_ATOMIC_RANGED
+ *                   the atomic histogram of one range of vertices at a time, with a pass over the
+ *                   edges per range; the fallback of PULP if not even one histogram of all
+ *                   vertices fits into L1 (`pred_count()` counts it like PRED_ATOMIC)
+ *
+ * `pred_choose()` picks the private histograms if they fit into the cache budget, the partitioning
+ * if there are at least as many edges as vertices, i.e., enough of them to collide, and the
+ * atomics otherwise.
+ */
+
+#ifndef PRED_HOST_CACHE_B
+  #define PRED_HOST_CACHE_B (256*1024)  // cache the private histograms of the host must fit into
+#endif
+#ifndef PRED_L1_BUDGET_B
+  #define PRED_L1_BUDGET_B  (192*1024)  // L1 memory available for the histograms of PULP
+#endif
+
+typedef enum {
+  PRED_ATOMIC,
+  PRED_PRIVATE,
+  PRED_PARTITION,
+  PRED_ATOMIC_RANGED,
+} pred_strategy_t;
+
+/*
+ * Contention of the predecessor counters, computed from the counts.
+ */
+typedef struct {
+  unsigned  max;          // largest number of predecessors
+  double    mean;         // edges per vertex
+  double    collision;    // probability that two random edges have the same destination
+} pred_contention_t;
+
+/**
+ * Name of a strategy, as used in the benchmark regions.
+ */
+static inline const char* pred_strategy_name(pred_strategy_t strategy);
+
+/**
+ * Choose a strategy for a graph, a number of threads, and the memory the private histograms may
+ * take.
+ */
+static inline pred_strategy_t pred_choose(unsigned n_vertices, unsigned n_edges, unsigned n_threads,
+    size_t budget_b);
+
+/**
+ * Count the predecessors of all vertices with all threads of a new parallel region.
+ *
+ * @return  0 on success; -ENOMEM if the memory of the strategy cannot be allocated.
+ */
+static inline int pred_count(pred_strategy_t strategy, const csr_graph* graph, unsigned* counts);
+
+/**
+ * Measure the contention of a graph from its predecessor counts.
+ */
+static inline void pred_contention(const unsigned* counts, unsigned n_vertices, unsigned n_edges,
+    pred_contention_t* contention);
+
+static inline const char* pred_strategy_name(const pred_strategy_t strategy)
+{
+  switch (strategy) {
+    case PRED_PRIVATE:        return "private";
+    case PRED_PARTITION:      return "partitioned";
+    case PRED_ATOMIC_RANGED:  return "atomic, ranged";
+    default:                  return "atomic";
+  }
+}
+
+static inline pred_strategy_t pred_choose(const unsigned n_vertices, const unsigned n_edges,
+    const unsigned n_threads, const size_t budget_b)
+{
+  if ( (unsigned long long)n_threads*n_vertices*sizeof(unsigned) <= budget_b )
+    return PRED_PRIVATE;
+  if (n_edges >= n_vertices)
+    return PRED_PARTITION;
+  return PRED_ATOMIC;
+}
+
+/*
+ * PRED_ATOMIC
+ */
+static inline int __pred_count_atomic(const csr_graph* const graph, unsigned* const counts)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const unsigned n_edges    = graph->n_edges;
+  const unsigned* const neighbors = graph->neighbors;
+
+  #pragma omp parallel
+  {
+    #pragma omp for
+    for (unsigned i=0; i<n_vertices; i++)
+      counts[i] = 0;
+
+    #pragma omp for
+    for (unsigned e=0; e<n_edges; e++) {
+      #pragma omp atomic update
+      counts[neighbors[e]] += 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * PRED_PRIVATE
+ */
+static inline int __pred_count_private(const csr_graph* const graph, unsigned* const counts)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const unsigned n_edges    = graph->n_edges;
+  const unsigned* const neighbors = graph->neighbors;
+
+  unsigned* const hists = (unsigned *)malloc((size_t)omp_get_max_threads()*n_vertices*
+    sizeof(unsigned));
+  if (hists == NULL)
+    return -ENOMEM;
+
+  #pragma omp parallel
+  {
+    // zeroed by its thread, so the pages are local to it
+    unsigned* const hist = hists + (size_t)omp_get_thread_num()*n_vertices;
+    for (unsigned i=0; i<n_vertices; i++)
+      hist[i] = 0;
+
+    #pragma omp for schedule(static)
+    for (unsigned e=0; e<n_edges; e++)
+      hist[neighbors[e]]++;
+
+    const unsigned n_threads = omp_get_num_threads();
+    #pragma omp for schedule(static)
+    for (unsigned i=0; i<n_vertices; i++) {
+      unsigned sum = 0;
+      for (unsigned t=0; t<n_threads; t++)
+        sum += hists[(size_t)t*n_vertices + i];
+      counts[i] = sum;
+    }
+  }
+
+  free(hists);
+  return 0;
+}
+
+/*
+ * PRED_PARTITION
+ */
+static inline int __pred_count_partition(const csr_graph* const graph, unsigned* const counts)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const unsigned n_edges    = graph->n_edges;
+  const unsigned* const neighbors = graph->neighbors;
+
+  const unsigned max_threads = omp_get_max_threads();
+  unsigned* const part = (unsigned *)malloc(((size_t)n_edges+1)*sizeof(unsigned));
+  // bucket sizes and then positions, by thread and range: pos[t*n_ranges + r]
+  unsigned* const pos  = (unsigned *)malloc(((size_t)max_threads*max_threads+1)*sizeof(unsigned));
+  if ( (part == NULL) || (pos == NULL) ) {
+    free(part);
+    free(pos);
+    return -ENOMEM;
+  }
+
+  #pragma omp parallel
+  {
+    const unsigned n_threads = omp_get_num_threads();
+    const unsigned t         = omp_get_thread_num();
+    const unsigned n_ranges  = n_threads;
+    const unsigned width     = (n_vertices + n_ranges-1) / n_ranges;
+    unsigned* const my_pos   = pos + t*n_ranges;
+
+    // the edges of this thread, as in a static schedule
+    const unsigned e_begin = (unsigned)((unsigned long long)n_edges*t/n_threads);
+    const unsigned e_end   = (unsigned)((unsigned long long)n_edges*(t+1)/n_threads);
+
+    for (unsigned r=0; r<n_ranges; r++)
+      my_pos[r] = 0;
+    for (unsigned e=e_begin; e<e_end; e++)
+      my_pos[neighbors[e]/width]++;
+    #pragma omp barrier
+
+    // exclusive prefix sums, range by range, so every range is contiguous
+    #pragma omp single
+    {
+      unsigned sum = 0;
+      for (unsigned r=0; r<n_ranges; r++) {
+        for (unsigned s=0; s<n_threads; s++) {
+          const unsigned size = pos[s*n_ranges + r];
+          pos[s*n_ranges + r] = sum;
+          sum += size;
+        }
+      }
+    }
+
+    for (unsigned e=e_begin; e<e_end; e++)
+      part[my_pos[neighbors[e]/width]++] = neighbors[e];
+    #pragma omp barrier
+
+    // after the scatter, range r ends where the bucket of the last thread in range r ends
+    const unsigned v_begin = t*width < n_vertices ? t*width : n_vertices;
+    const unsigned v_end   = v_begin+width < n_vertices ? v_begin+width : n_vertices;
+    const unsigned p_begin = t > 0 ? pos[(n_threads-1)*n_ranges + t-1] : 0;
+    const unsigned p_end   = pos[(n_threads-1)*n_ranges + t];
+    for (unsigned i=v_begin; i<v_end; i++)
+      counts[i] = 0;
+    for (unsigned p=p_begin; p<p_end; p++)
+      counts[part[p]]++;
+  }
+
+  free(part);
+  free(pos);
+  return 0;
+}
+
+static inline int pred_count(const pred_strategy_t strategy, const csr_graph* const graph,
+    unsigned* const counts)
+{
+  switch (strategy) {
+    case PRED_PRIVATE:    return __pred_count_private(graph, counts);
+    case PRED_PARTITION:  return __pred_count_partition(graph, counts);
+    default:              return __pred_count_atomic(graph, counts);
+  }
+}
+
+static inline void pred_contention(const unsigned* const counts, const unsigned n_vertices,
+    const unsigned n_edges, pred_contention_t* const contention)
+{
+  unsigned max         = 0;
+  double   sum_squares = 0;
+  #pragma omp parallel for reduction(max: max) reduction(+: sum_squares)
+  for (unsigned i=0; i<n_vertices; i++) {
+    if (counts[i] > max)
+      max = counts[i];
+    sum_squares += (double)counts[i]*counts[i];
+  }
+
+  contention->max       = max;
+  contention->mean      = n_vertices > 0 ? (double)n_edges/n_vertices : 0;
+  contention->collision = n_edges > 0 ? sum_squares/((double)n_edges*n_edges) : 0;
+}
+
+#endif
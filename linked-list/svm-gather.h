@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SVM_GATHER_H__
+#define __SVM_GATHER_H__
+
+#include <stddef.h>       // size_t
+#include <hero-target.h>
+
+/*
+ * Batched gathers from shared virtual memory
+ *
+ * Following pointers through SVM with `hero_tryread()` pays the full latency of every access, one
+ * after the other.  The gathers below instead issue one DMA transfer per element, back to back,
+ * and keep up to SVM_GATHER_WINDOW of them in flight, so their latencies overlap.  Kernels first
+ * gather everything a block of work needs into L1 staging buffers and only then compute on L1.
+ *
+ * Every transfer moves a few bytes, so the gathers pay off when the latency of an SVM access is
+ * high compared to the issue cost of a DMA transfer, i.e., when the accesses miss in the remapping
+ * address block (RAB) or the caches of the host.
+ */
+
+#ifndef SVM_GATHER_WINDOW
+  #define SVM_GATHER_WINDOW 16  // transfers in flight, the depth of the DMA command queue
+#endif
+
+#pragma omp declare target
+
+/**
+ * Gather `n` elements of `size_b` bytes that are `stride_b` bytes apart in SVM, starting at `src`,
+ * into the contiguous buffer `dst`, and wait for all of them.
+ */
+static inline void svm_gather_strided(void* dst, const void* src, unsigned n, size_t stride_b,
+    unsigned size_b);
+
+/**
+ * Gather the `size_b` bytes at `offset_b` of each of the `n` objects `srcs[k]` in SVM into the
+ * contiguous buffer `dst`, and wait for all of them.
+ */
+static inline void svm_gather(void* dst, void* const* srcs, unsigned n, size_t offset_b,
+    unsigned size_b);
+
+/*
+ * Gather `n` elements, element k from `srcs[k] + step_b` if `srcs` is given and from
+ * `src + k*step_b` otherwise.  Up to SVM_GATHER_WINDOW transfers are in flight; the DMA engine may
+ * complete them in any order, so every one of them is waited for.
+ */
+static inline void __svm_gather(void* const dst, const void* const src, void* const* const srcs,
+    const unsigned n, const size_t step_b, const unsigned size_b)
+{
+  hero_dma_job_t jobs[SVM_GATHER_WINDOW];
+  for (unsigned k=0; k<n; k++) {
+    if (k >= SVM_GATHER_WINDOW)
+      hero_dma_wait(jobs[k % SVM_GATHER_WINDOW]);
+    char * const src_k = srcs != NULL ? (char *)srcs[k] + step_b : (char *)src + (size_t)k*step_b;
+    jobs[k % SVM_GATHER_WINDOW] = hero_dma_memcpy_async((char *)dst + (size_t)k*size_b,
+      src_k, (int)size_b);
+  }
+  for (unsigned k=n > SVM_GATHER_WINDOW ? n-SVM_GATHER_WINDOW : 0; k<n; k++)
+    hero_dma_wait(jobs[k % SVM_GATHER_WINDOW]);
+}
+
+static inline void svm_gather_strided(void* const dst, const void* const src, const unsigned n,
+    const size_t stride_b, const unsigned size_b)
+{
+  __svm_gather(dst, src, NULL, n, stride_b, size_b);
+}
+
+static inline void svm_gather(void* const dst, void* const* const srcs, const unsigned n,
+    const size_t offset_b, const unsigned size_b)
+{
+  __svm_gather(dst, NULL, srcs, n, offset_b, size_b);
+}
+
+#pragma omp end declare target
+
+#endif
@@ -0,0 +1,379 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VERTEX_LAYOUT_H__
+#define __VERTEX_LAYOUT_H__
+
+#include <errno.h>        // error codes
+#include <stdint.h>       // uintptr_t
+#include <stdlib.h>       // calloc(), free(), malloc(), qsort()
+#include <omp.h>          // omp_get_thread_num()
+#include <hero-target.h>
+#include "graph.h"
+#include "svm-gather.h"
+#include "vertex.h"
+
+/*
+ * Layouts of the vertex metadata
+ *
+ * `struct vertex` holds a PAYLOAD_SIZE_B payload fixed at compile time next to the metadata, so the
+ * metadata of neighboring vertices lie more than the payload apart and every vertex visited costs
+ * a cache line of its own.  A vertex store keeps the same metadata (ID, number of successors and
+ * pointer to the successors) with a payload size chosen at run time, in one of three layouts:
+ *
+ *   VERTEX_AOS        array of structs: records of metadata and payload, as `struct vertex`
+ *   VERTEX_HOT_COLD   array of metadata records, with the payloads in a separate array
+ *   VERTEX_SOA        struct of arrays: one array per field, and one of the payloads
+ *
+ * The successors are the vertex IDs of the CSR layout, shared by all layouts, so the layouts only
+ * differ in where the metadata lie.  The traversals run on the host (`svm` = 0) and on PULP
+ * (`svm` = 1), and layout_touched() counts what a traversal reads: the distinct cache lines on the
+ * host, and the words read through SVM together with the distinct pages they lie in, each of
+ * which needs a slice of the remapping address block (RAB).
+ */
+
+#ifndef LAYOUT_LINE_B
+  #define LAYOUT_LINE_B 64      // cache line size of the host
+#endif
+#ifndef LAYOUT_PAGE_B
+  #define LAYOUT_PAGE_B 4096    // page size, i.e., granularity of the RAB
+#endif
+#ifndef LAYOUT_BLOCK
+  #define LAYOUT_BLOCK  256     // vertices whose metadata are gathered into L1 at once
+#endif
+
+typedef enum {
+  VERTEX_AOS,
+  VERTEX_HOT_COLD,
+  VERTEX_SOA,
+} vertex_layout_t;
+
+typedef enum {
+  LAYOUT_SCAN,        // largest number of successors, over all vertices in order
+  LAYOUT_NEIGHBORS,   // sum of the numbers of successors of the successors of all vertices
+} layout_kernel_t;
+
+/*
+ * Metadata of a vertex in the AoS and hot/cold layouts.  AoS records append the payload.
+ */
+typedef struct {
+  unsigned int  vertex_id;
+  unsigned int  n_successors;
+  unsigned int* successors;
+} vertex_meta;
+
+typedef struct {
+  vertex_layout_t layout;
+  unsigned int    n_vertices;
+  unsigned int    payload_size_b;
+  unsigned int    stride_b;       // bytes between the records of the AoS and hot/cold layouts
+  unsigned char*  records;        // AoS and hot/cold
+  unsigned int*   ids;            // SoA
+  unsigned int*   n_successors;   // SoA
+  unsigned int**  successors;     // SoA
+  unsigned char*  payloads;       // hot/cold and SoA
+} vertex_store;
+
+/*
+ * What a traversal reads, see layout_touched().
+ */
+typedef struct {
+  unsigned long long  lines;      // distinct cache lines of the host
+  unsigned long long  svm_words;  // 32-bit words read through SVM, one hero_tryread() each
+  unsigned long long  pages;      // distinct pages
+} layout_touched_t;
+
+/**
+ * Name of a layout.
+ */
+static inline const char* vertex_layout_name(vertex_layout_t layout);
+
+/**
+ * Build a vertex store of a graph in a layout, with zeroed payloads of `payload_size_b` bytes.  The
+ * successors point into the CSR arrays of the graph.
+ *
+ * @return  0 on success; -ENOMEM if the memory cannot be allocated.
+ */
+static inline int vertex_store_build(vertex_store* store, vertex_layout_t layout,
+    const csr_graph* graph, unsigned payload_size_b);
+
+/**
+ * Free the arrays of a vertex store.
+ */
+static inline void vertex_store_free(vertex_store* store);
+
+/**
+ * Count what a traversal of a vertex store reads, by replaying its accesses.
+ *
+ * @return  0 on success; -ENOMEM if the memory cannot be allocated.
+ */
+static inline int layout_touched(const vertex_store* store, layout_kernel_t kernel,
+    layout_touched_t* touched);
+
+static inline const char* vertex_layout_name(const vertex_layout_t layout)
+{
+  switch (layout) {
+    case VERTEX_HOT_COLD: return "hot-cold";
+    case VERTEX_SOA:      return "SoA";
+    default:              return "AoS";
+  }
+}
+
+static inline int vertex_store_build(vertex_store* const store, const vertex_layout_t layout,
+    const csr_graph* const graph, const unsigned payload_size_b)
+{
+  const unsigned n_vertices = graph->n_vertices;
+  const size_t   align_b    = sizeof(void *);
+
+  store->layout         = layout;
+  store->n_vertices     = n_vertices;
+  store->payload_size_b = payload_size_b;
+  store->stride_b       = sizeof(vertex_meta);
+  if (layout == VERTEX_AOS)
+    store->stride_b = (sizeof(vertex_meta) + payload_size_b + align_b-1) / align_b * align_b;
+  store->records      = NULL;
+  store->ids          = NULL;
+  store->n_successors = NULL;
+  store->successors   = NULL;
+  store->payloads     = NULL;
+
+  int err = 0;
+  if (layout == VERTEX_SOA) {
+    store->ids          = (unsigned *)malloc(((size_t)n_vertices+1)*sizeof(unsigned));
+    store->n_successors = (unsigned *)malloc(((size_t)n_vertices+1)*sizeof(unsigned));
+    store->successors   = (unsigned **)malloc(((size_t)n_vertices+1)*sizeof(unsigned *));
+    err = (store->ids == NULL) || (store->n_successors == NULL) || (store->successors == NULL);
+  }
+  else {
+    store->records = (unsigned char *)calloc((size_t)n_vertices+1, store->stride_b);
+    err = store->records == NULL;
+  }
+  if (layout != VERTEX_AOS) {
+    store->payloads = (unsigned char *)calloc((size_t)n_vertices+1, payload_size_b);
+    err |= store->payloads == NULL;
+  }
+  if (err) {
+    vertex_store_free(store);
+    return -ENOMEM;
+  }
+
+  for (unsigned v=0; v<n_vertices; v++) {
+    const unsigned n_succs = graph->offsets[v+1] - graph->offsets[v];
+    unsigned* const succs  = &graph->neighbors[graph->offsets[v]];
+    if (layout == VERTEX_SOA) {
+      store->ids[v]          = v;
+      store->n_successors[v] = n_succs;
+      store->successors[v]   = succs;
+    }
+    else {
+      vertex_meta* const meta = (vertex_meta *)(store->records + (size_t)v*store->stride_b);
+      meta->vertex_id    = v;
+      meta->n_successors = n_succs;
+      meta->successors   = succs;
+    }
+  }
+
+  return 0;
+}
+
+static inline void vertex_store_free(vertex_store* const store)
+{
+  free(store->records);
+  free(store->ids);
+  free(store->n_successors);
+  free(store->successors);
+  free(store->payloads);
+  store->records      = NULL;
+  store->ids          = NULL;
+  store->n_successors = NULL;
+  store->successors   = NULL;
+  store->payloads     = NULL;
+}
+
+#pragma omp declare target
+
+/**
+ * Copy the description of a vertex store from shared virtual memory.
+ */
+static inline void vertex_store_read(vertex_store* dst, const vertex_store* src);
+
+/**
+ * Largest number of successors of all vertices, read one by one.
+ */
+static inline unsigned layout_scan(const vertex_store* store, int svm);
+
+/**
+ * Largest number of successors of all vertices, with the numbers of blocks of LAYOUT_BLOCK vertices
+ * gathered into `staging`, which holds LAYOUT_BLOCK entries per thread: one DMA transfer per block
+ * in the SoA layout, one per vertex in the others (PULP only).
+ */
+static inline unsigned layout_scan_gathered(const vertex_store* store, unsigned* staging);
+
+/**
+ * Sum of the numbers of successors of the successors of all vertices.
+ */
+static inline unsigned long long layout_neighbors(const vertex_store* store, int svm);
+
+static inline void vertex_store_read(vertex_store* const dst, const vertex_store* const src)
+{
+  dst->layout         = (vertex_layout_t)hero_tryread((const unsigned *)&src->layout);
+  dst->n_vertices     = hero_tryread(&src->n_vertices);
+  dst->payload_size_b = hero_tryread(&src->payload_size_b);
+  dst->stride_b       = hero_tryread(&src->stride_b);
+  dst->records        = (unsigned char *)tryread_ptr((void * const *)&src->records);
+  dst->ids            = (unsigned *)tryread_ptr((void * const *)&src->ids);
+  dst->n_successors   = (unsigned *)tryread_ptr((void * const *)&src->n_successors);
+  dst->successors     = (unsigned **)tryread_ptr((void * const *)&src->successors);
+  dst->payloads       = (unsigned char *)tryread_ptr((void * const *)&src->payloads);
+}
+
+/*
+ * Addresses of the metadata of vertex v.
+ */
+static inline const unsigned* layout_n_successors_addr(const vertex_store* const store,
+    const unsigned v)
+{
+  if (store->layout == VERTEX_SOA)
+    return &store->n_successors[v];
+  return &((const vertex_meta *)(store->records + (size_t)v*store->stride_b))->n_successors;
+}
+
+static inline unsigned* const* layout_successors_addr(const vertex_store* const store,
+    const unsigned v)
+{
+  if (store->layout == VERTEX_SOA)
+    return &store->successors[v];
+  return &((const vertex_meta *)(store->records + (size_t)v*store->stride_b))->successors;
+}
+
+static inline unsigned layout_scan(const vertex_store* const store, const int svm)
+{
+  const unsigned n_vertices = store->n_vertices;
+  unsigned max = 0;
+  #pragma omp parallel for reduction(max: max)
+  for (unsigned v=0; v<n_vertices; v++) {
+    const unsigned n_succs = list_read(layout_n_successors_addr(store, v), svm);
+    if (n_succs > max)
+      max = n_succs;
+  }
+  return max;
+}
+
+static inline unsigned layout_scan_gathered(const vertex_store* const store,
+    unsigned* const staging)
+{
+  const unsigned n_vertices = store->n_vertices;
+  const unsigned n_blocks   = (n_vertices + LAYOUT_BLOCK-1) / LAYOUT_BLOCK;
+  unsigned max = 0;
+  #pragma omp parallel reduction(max: max)
+  {
+    unsigned* const n_succs = staging + omp_get_thread_num()*LAYOUT_BLOCK;
+
+    #pragma omp for schedule(static)
+    for (unsigned b=0; b<n_blocks; b++) {
+      const unsigned v = b*LAYOUT_BLOCK;
+      const unsigned n = n_vertices-v < LAYOUT_BLOCK ? n_vertices-v : LAYOUT_BLOCK;
+      if (store->layout == VERTEX_SOA)
+        hero_dma_memcpy((void *)n_succs, (void *)&store->n_successors[v], n*sizeof(unsigned));
+      else
+        svm_gather_strided(n_succs, layout_n_successors_addr(store, v), n, store->stride_b,
+          sizeof(unsigned));
+      for (unsigned k=0; k<n; k++) {
+        if (n_succs[k] > max)
+          max = n_succs[k];
+      }
+    }
+  }
+  return max;
+}
+
+static inline unsigned long long layout_neighbors(const vertex_store* const store, const int svm)
+{
+  const unsigned n_vertices = store->n_vertices;
+  unsigned long long sum = 0;
+  #pragma omp parallel for schedule(dynamic, 64) reduction(+: sum)
+  for (unsigned v=0; v<n_vertices; v++) {
+    const unsigned n_succs = list_read(layout_n_successors_addr(store, v), svm);
+    unsigned* const succs  = (unsigned *)list_read_ptr((void * const *)
+      layout_successors_addr(store, v), svm);
+    for (unsigned j=0; j<n_succs; j++)
+      sum += list_read(layout_n_successors_addr(store, list_read(&succs[j], svm)), svm);
+  }
+  return sum;
+}
+
+#pragma omp end declare target
+
+static inline int __layout_cmp_uintptr(const void* const a, const void* const b)
+{
+  const uintptr_t x = *(const uintptr_t *)a;
+  const uintptr_t y = *(const uintptr_t *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Number of distinct units of `unit_b` bytes among sorted addresses.
+ */
+static inline unsigned long long __layout_count_units(const uintptr_t* const addrs,
+    const size_t n_addrs, const uintptr_t unit_b)
+{
+  unsigned long long n_units = 0;
+  for (size_t i=0; i<n_addrs; i++) {
+    if ( (i == 0) || (addrs[i]/unit_b != addrs[i-1]/unit_b) )
+      n_units++;
+  }
+  return n_units;
+}
+
+static inline int layout_touched(const vertex_store* const store, const layout_kernel_t kernel,
+    layout_touched_t* const touched)
+{
+  const unsigned n_vertices = store->n_vertices;
+  size_t n_addrs = n_vertices;
+  if (kernel == LAYOUT_NEIGHBORS) {
+    for (unsigned v=0; v<n_vertices; v++)
+      n_addrs += 1 + 2*(size_t)*layout_n_successors_addr(store, v);
+  }
+
+  uintptr_t* const addrs = (uintptr_t *)malloc((n_addrs+1)*sizeof(uintptr_t));
+  if (addrs == NULL)
+    return -ENOMEM;
+
+  // the reads of the traversal, in order
+  size_t a = 0;
+  for (unsigned v=0; v<n_vertices; v++) {
+    addrs[a++] = (uintptr_t)layout_n_successors_addr(store, v);
+    if (kernel == LAYOUT_NEIGHBORS) {
+      const unsigned n_succs = *layout_n_successors_addr(store, v);
+      unsigned* const succs  = *layout_successors_addr(store, v);
+      addrs[a++] = (uintptr_t)layout_successors_addr(store, v);
+      for (unsigned j=0; j<n_succs; j++) {
+        addrs[a++] = (uintptr_t)&succs[j];
+        addrs[a++] = (uintptr_t)layout_n_successors_addr(store, succs[j]);
+      }
+    }
+  }
+
+  qsort(addrs, n_addrs, sizeof(uintptr_t), __layout_cmp_uintptr);
+  touched->lines     = __layout_count_units(addrs, n_addrs, LAYOUT_LINE_B);
+  touched->pages     = __layout_count_units(addrs, n_addrs, LAYOUT_PAGE_B);
+  touched->svm_words = n_addrs;
+
+  free(addrs);
+  return 0;
+}
+
+#endif
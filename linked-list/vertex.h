@@ -0,0 +1,233 @@
+/*
+ * Copyright 2018 ETH Zurich, University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VERTEX_H__
+#define __VERTEX_H__
+
+#include <errno.h>        // error codes
+#include <stdint.h>       // UINTPTR_MAX
+#include <stdlib.h>       // calloc(), free(), malloc()
+#include <string.h>       // memcpy()
+#include <hero-target.h>
+#include "graph.h"
+
+/*
+ * Linked-list layout of a graph
+ *
+ * Every vertex holds its metadata, an array of pointers to its successors, and a payload.  The
+ * vertices and the successor arrays are allocated with `malloc()` on the host and shared with
+ * PULP through SVM, where the pointers are followed as they are.
+ *
+ * The list_*() accessors read and write vertices and the arrays of the analyses either directly
+ * (`svm` = 0, on the host) or through `hero_tryread()`/`hero_trywrite()` (`svm` = 1, on PULP), so
+ * the same kernels run on both sides.  Direct accesses are relaxed atomics: the analyses let
+ * threads race on words that only ever take valid values.
+ */
+
+typedef struct vertex vertex;
+
+struct vertex {
+  unsigned int  vertex_id;
+  unsigned int  n_successors;
+  vertex**      successors;
+  unsigned char payload [PAYLOAD_SIZE_B];
+};
+
+/*
+ * Predecessors of a vertex, i.e., the transposed list, kept apart from the vertices.
+ */
+typedef struct {
+  unsigned int  n_predecessors;
+  vertex**      predecessors;
+} vertex_preds;
+
+/**
+ * Build the linked list of a graph: every vertex gets an array of pointers to its successors, in
+ * the order of the CSR layout.  The payloads are copied.
+ *
+ * @return  0 on success; -ENOMEM if the memory cannot be allocated.
+ */
+static inline int list_from_csr(vertex** vertices, const csr_graph* graph);
+
+/**
+ * Build the predecessor arrays of a linked list, in the order of the predecessors' IDs.
+ *
+ * @return  0 on success; -ENOMEM if the memory cannot be allocated.
+ */
+static inline int list_transpose(vertex_preds** preds, vertex* vertices, unsigned n_vertices);
+
+/**
+ * Free a linked list, or its predecessor arrays.
+ */
+static inline void list_free(vertex* vertices, unsigned n_vertices);
+static inline void list_preds_free(vertex_preds* preds, unsigned n_vertices);
+
+static inline int list_from_csr(vertex** const vertices, const csr_graph* const graph)
+{
+  const unsigned n_vertices = graph->n_vertices;
+
+  vertex* const list = (vertex *)calloc(n_vertices, sizeof(vertex));
+  if (list == NULL)
+    return -ENOMEM;
+
+  for (unsigned i=0; i<n_vertices; i++) {
+    const unsigned first = graph->offsets[i];
+    list[i].vertex_id    = i;
+    list[i].n_successors = graph->offsets[i+1] - first;
+    if (list[i].n_successors > 0) {
+      list[i].successors = (vertex **)malloc(list[i].n_successors*sizeof(vertex *));
+      if (list[i].successors == NULL) {
+        list_free(list, i);
+        return -ENOMEM;
+      }
+      for (unsigned j=0; j<list[i].n_successors; j++)
+        list[i].successors[j] = &list[graph->neighbors[first+j]];
+    }
+    memcpy(list[i].payload, &graph->payloads[(size_t)i*PAYLOAD_SIZE_B], PAYLOAD_SIZE_B);
+  }
+
+  *vertices = list;
+  return 0;
+}
+
+static inline int list_transpose(vertex_preds** const preds, vertex* const vertices,
+    const unsigned n_vertices)
+{
+  vertex_preds* const list = (vertex_preds *)calloc(n_vertices, sizeof(vertex_preds));
+  if (list == NULL)
+    return -ENOMEM;
+
+  for (unsigned i=0; i<n_vertices; i++) {
+    for (unsigned j=0; j<vertices[i].n_successors; j++)
+      list[vertices[i].successors[j]->vertex_id].n_predecessors++;
+  }
+  for (unsigned i=0; i<n_vertices; i++) {
+    if (list[i].n_predecessors == 0)
+      continue;
+    list[i].predecessors = (vertex **)malloc(list[i].n_predecessors*sizeof(vertex *));
+    if (list[i].predecessors == NULL) {
+      list_preds_free(list, i);
+      return -ENOMEM;
+    }
+    list[i].n_predecessors = 0;   // counted up again while filling
+  }
+  for (unsigned i=0; i<n_vertices; i++) {
+    for (unsigned j=0; j<vertices[i].n_successors; j++) {
+      vertex_preds* const p = &list[vertices[i].successors[j]->vertex_id];
+      p->predecessors[p->n_predecessors++] = &vertices[i];
+    }
+  }
+
+  *preds = list;
+  return 0;
+}
+
+static inline void list_free(vertex* const vertices, const unsigned n_vertices)
+{
+  for (unsigned i=0; i<n_vertices; i++)
+    free(vertices[i].successors);
+  free(vertices);
+}
+
+static inline void list_preds_free(vertex_preds* const preds, const unsigned n_vertices)
+{
+  for (unsigned i=0; i<n_vertices; i++)
+    free(preds[i].predecessors);
+  free(preds);
+}
+
+#pragma omp declare target
+
+/*
+ * Read a pointer from shared virtual memory.  Pointers are 32 bit wide on HERO; on hosts with wider
+ * pointers (i.e., in the host emulation), the memory is accessed directly.
+ */
+static inline void * tryread_ptr(void * const * addr)
+{
+#if UINTPTR_MAX == UINT32_MAX
+  return (void *)hero_tryread((unsigned int *)addr);
+#else
+  return *(void * const volatile *)addr;
+#endif
+}
+
+static inline unsigned list_read(const unsigned* const addr, const int svm)
+{
+  if (svm)
+    return hero_tryread(addr);
+  unsigned val;
+  #pragma omp atomic read
+  val = *addr;
+  return val;
+}
+
+static inline void list_write(unsigned* const addr, const unsigned val, const int svm)
+{
+  if (svm)
+    hero_trywrite(addr, val);
+  else {
+    #pragma omp atomic write
+    *addr = val;
+  }
+}
+
+static inline void* list_read_ptr(void* const* const addr, const int svm)
+{
+  return svm ? tryread_ptr(addr) : *addr;
+}
+
+static inline float list_read_f32(const float* const addr, const int svm)
+{
+  const unsigned bits = list_read((const unsigned *)addr, svm);
+  float val;
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+static inline void list_write_f32(float* const addr, const float val, const int svm)
+{
+  unsigned bits;
+  memcpy(&bits, &val, sizeof(bits));
+  list_write((unsigned *)addr, bits, svm);
+}
+
+/*
+ * Accessors of the vertex metadata.
+ */
+static inline unsigned list_id(const vertex* const v, const int svm)
+{
+  return list_read(&v->vertex_id, svm);
+}
+
+static inline unsigned list_n_successors(const vertex* const v, const int svm)
+{
+  return list_read(&v->n_successors, svm);
+}
+
+static inline vertex** list_successors(const vertex* const v, const int svm)
+{
+  return (vertex **)list_read_ptr((void * const *)&v->successors, svm);
+}
+
+static inline vertex* list_successor(vertex* const* const successors, const unsigned j,
+    const int svm)
+{
+  return (vertex *)list_read_ptr((void * const *)&successors[j], svm);
+}
+
+#pragma omp end declare target
+
+#endif
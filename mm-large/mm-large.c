@@ -22,241 +22,944 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>        // for error codes
+#include <math.h>         // sqrt()
 #include "bench.h"
+#include "dev-cache.h"
+#include "mm-host.h"
+#include "mm-kernel.h"
+#include "mm-types.h"
+#include "tile-stream.h"
+#include "verify.h"
 #include <hero-target.h>
+#ifdef HERO_EMU
+  #include <sched.h>      // sched_yield()
+#endif
 
-void compare_matrices(uint32_t* a, uint32_t* b, unsigned width, unsigned height)
+#ifndef L1_BUDGET_B
+  #define L1_BUDGET_B (192*1024)  // L1 memory available for the block and tile buffers
+#endif
+#ifndef TILE_K
+  #define TILE_K (256/sizeof(mm_elem_t))    // maximum length of the K blocks (256 B)
+#endif
+#ifndef TILE_K_MIN
+  #define TILE_K_MIN (64/sizeof(mm_elem_t)) // minimum length of the K blocks, unless K is shorter
+#endif
+
+#ifndef PIPELINE_DEPTH
+  #define PIPELINE_DEPTH 2        // default number of buffers per operand
+#endif
+
+#define PIPELINE_DEPTH_MAX TS_DEPTH_MAX  // maximum number of buffers per operand
+
+// pipeline modes
+#define MM_MODE_ROLES 0           // threads 0 to 2 issue the DMA transfers and compute
+#define MM_MODE_MOVER 1           // thread 0 issues all DMA transfers, the others compute
+
+#ifndef MM_SPLIT_SMOOTHING
+  #define MM_SPLIT_SMOOTHING 0.5  // weight of the latest run in the throughputs of the split
+#endif
+
+void compare_matrices(mm_acc_t* a, mm_acc_t* b, unsigned width, unsigned height)
+{
+  if (mm_verify(a, b, height, width, "Result") != 0)
+    exit(-1);
+}
+
+/*
+ * Tiling plan
+ *
+ * C (m x n) = A (m x k) * B (k x n), with B given as its transpose (n x k).  C is computed in tiles
+ * of tile_m x tile_n elements that stay in the L1 memory while the K dimension is streamed through
+ * in blocks of tile_k columns: each step multiplies a tile_m x tile_k block of A with a
+ * tile_n x tile_k block of B^T and accumulates the result in the C tile.  The blocks of A and B^T
+ * as well as the C tiles have `depth` buffers each.  The last tiles and blocks are ragged if the
+ * matrix dimensions are not multiples of the tile dimensions.
+ */
+typedef struct {
+  unsigned depth;       // number of buffers per operand
+  unsigned m;
+  unsigned n;
+  unsigned k;
+  unsigned tile_m;
+  unsigned tile_n;
+  unsigned tile_k;
+  unsigned n_tiles_m;
+  unsigned n_tiles_n;
+  unsigned n_tiles_k;
+} mm_plan_t;
+
+static unsigned round_down(const unsigned x, const unsigned mult, const unsigned max)
 {
-  for (unsigned i=0; i<width; i++) {
-    for (unsigned j=0; j<height; j++) {
-      if(a[i*width+j] != b[i*width+j] ) {
-        printf("ERROR: Result mismatch in Row %u, Column %u!\n", j, i);
-        exit(-1);
+  // Tiles smaller than the matrix are multiples of the register block, if possible.
+  if ( (x < max) && (x > mult) )
+    return x - x % mult;
+  return x < max ? x : max;
+}
+
+/**
+ * Compute the external memory traffic of a plan.  A block of A (B^T) stays in the L1 memory as
+ * long as consecutive steps use it, which is the case if K is not blocked.
+ *
+ * @return  Number of bytes transferred between the external and the L1 memory.
+ */
+double mm_plan_traffic_b(const mm_plan_t* const plan)
+{
+  const double a_loads = plan->n_tiles_k > 1 ? plan->n_tiles_n : 1;
+  const double b_loads = (plan->n_tiles_k > 1) || (plan->n_tiles_n > 1) ? plan->n_tiles_m : 1;
+
+  return sizeof(mm_elem_t) * (a_loads * plan->m * plan->k + b_loads * plan->n * plan->k)
+    + sizeof(mm_acc_t) * (double)plan->m * plan->n;
+}
+
+/*
+ * Determine the largest C tiles for a given K block length.  The budget is given in C elements,
+ * and the A and B^T blocks count with their share of the element size.
+ */
+static int mm_plan_tiles(mm_plan_t* const plan, const unsigned tile_k_elem, const double budget)
+{
+  const unsigned m = plan->m;
+  const unsigned n = plan->n;
+
+  plan->tile_k    = tile_k_elem;
+  plan->n_tiles_k = (plan->k + tile_k_elem - 1) / tile_k_elem;
+
+  const double tile_k = (double)tile_k_elem * sizeof(mm_elem_t) / sizeof(mm_acc_t);
+
+  // Square C tiles minimize the number of times A and B^T are streamed in.
+  const double tile = sqrt(tile_k*tile_k + budget) - tile_k;
+  plan->tile_m = round_down(tile, MM_KERNEL_MR, m);
+  if (plan->tile_m == 0)
+    return -ENOMEM;
+  plan->tile_n = round_down((budget - (double)plan->tile_m*tile_k) / (tile_k + plan->tile_m),
+    MM_KERNEL_NR, n);
+  if (plan->tile_n == 0)
+    return -ENOMEM;
+
+  // If one dimension fits entirely, spend the rest of the budget on the other one.
+  if (plan->tile_n == n)
+    plan->tile_m = round_down((budget - (double)n*tile_k) / (tile_k + n), MM_KERNEL_MR, m);
+  else if (plan->tile_m == m)
+    plan->tile_n = round_down((budget - (double)m*tile_k) / (tile_k + m), MM_KERNEL_NR, n);
+  if ( (plan->tile_m == 0) || (plan->tile_n == 0) )
+    return -ENOMEM;
+
+  plan->n_tiles_m = (m + plan->tile_m - 1) / plan->tile_m;
+  plan->n_tiles_n = (n + plan->tile_n - 1) / plan->tile_n;
+
+  return 0;
+}
+
+/**
+ * Determine the plan with the least external memory traffic whose double buffers fit into the L1
+ * budget.  The K blocks are between TILE_K_MIN and TILE_K columns long and split K evenly; shorter
+ * blocks leave room for larger C tiles, but make for shorter DMA transfers.
+ *
+ * @return  0 on success; -ENOMEM if not even a single row of A and B^T fits.
+ */
+int mm_plan(mm_plan_t* const plan, const unsigned m, const unsigned n, const unsigned k,
+    const unsigned depth, const unsigned l1_budget_b)
+{
+  // bytes per buffer: (tile_m*tile_k + tile_n*tile_k) * sizeof(mm_elem_t)
+  //                   + tile_m*tile_n * sizeof(mm_acc_t) <= l1_budget_b / depth
+  const double budget = (double)l1_budget_b / (depth*sizeof(mm_acc_t));
+
+  mm_plan_t cand = { .depth = depth, .m = m, .n = n, .k = k };
+  int ret = -ENOMEM;
+
+  unsigned tile_k_prev = 0;
+  for (unsigned n_tiles_k = (k + TILE_K - 1) / TILE_K; ; n_tiles_k++) {
+    const unsigned tile_k = (k + n_tiles_k - 1) / n_tiles_k;
+    if ( (tile_k < TILE_K_MIN) && (ret == 0) )
+      break;
+    if (tile_k != tile_k_prev) {
+      if ( (mm_plan_tiles(&cand, tile_k, budget) == 0) &&
+           ((ret != 0) || (mm_plan_traffic_b(&cand) < mm_plan_traffic_b(plan))) ) {
+        *plan = cand;
+        ret   = 0;
       }
     }
+    if (tile_k == 1)
+      break;
+    tile_k_prev = tile_k;
   }
+
+  return ret;
+}
+
+void mm_plan_print(const mm_plan_t* const plan)
+{
+  const double ops       = 2.0 * plan->m * plan->n * plan->k;
+  const double traffic_b = mm_plan_traffic_b(plan);
+  const unsigned l1_b    = plan->depth * ( (plan->tile_m + plan->tile_n) * plan->tile_k *
+    sizeof(mm_elem_t) + plan->tile_m * plan->tile_n * sizeof(mm_acc_t) );
+
+  printf("Tiling: tile_m = %u, tile_n = %u, tile_k = %u (%u x %u x %u tiles), depth = %u, "
+    "L1 usage = %.2f KiB\n", plan->tile_m, plan->tile_n, plan->tile_k, plan->n_tiles_m,
+    plan->n_tiles_n, plan->n_tiles_k, plan->depth, (float)l1_b/1024);
+  printf("Tiling: external traffic = %.2f KiB, arithmetic intensity = %.3f op/B\n",
+    traffic_b/1024, ops/traffic_b);
+}
+
+/*
+ * Print the external memory traffic a run has achieved, as reported by double_buf_mm(), and the
+ * resulting arithmetic intensity.
+ */
+void mm_print_traffic(const uint32_t* const traffic_b, const unsigned m, const unsigned n,
+    const unsigned k)
+{
+  const double bytes = (double)(((uint64_t)traffic_b[1] << 32) | traffic_b[0]);
+  printf("Achieved: external traffic = %.2f KiB, arithmetic intensity = %.3f op/B\n",
+    bytes/1024, bytes > 0 ? 2.0*m*n*k / bytes : 0);
 }
 
 #pragma omp declare target
 
-int double_buf_mm(uint32_t * __restrict__ a, uint32_t * __restrict__ b, uint32_t * __restrict__ c, uint32_t width, uint32_t height, uint32_t stripe_height)
+/*
+ * Schedule
+ *
+ * The accelerator works through the tiles of C in row-major order, with the k blocks innermost.
+ * Step `step` multiplies a block of A with a block of B^T and accumulates the result in c tile
+ * `step / n_tiles_k`.  The blocks are streamed with `common/tile-stream.h`: A with every grid row
+ * repeated once per column of c tiles, and B^T with the whole grid repeated once per row of c
+ * tiles.  If K is not blocked, a block stays in L1 as long as consecutive steps use it, so the
+ * streams are shorter than the number of steps.
+ */
+typedef struct {
+  unsigned    m;
+  unsigned    n;
+  unsigned    k;
+  unsigned    tile_m;
+  unsigned    tile_n;
+  unsigned    tile_k;
+  unsigned    depth;      // number of buffers per operand
+  unsigned    n_tiles_m;
+  unsigned    n_tiles_n;
+  unsigned    n_tiles_k;
+  unsigned    n_tiles;
+  unsigned    n_steps;
+  unsigned    a_stream;   // a new block of A (B^T) is loaded for every step
+  unsigned    b_stream;
+  ts_stream_t a;
+  ts_stream_t b;
+  ts_stream_t c;
+} mm_sched_t;
+
+typedef struct {
+  unsigned tile;
+  unsigned kb;
+  unsigned rows_m;
+  unsigned rows_n;
+  unsigned cols_k;
+  unsigned la;          // tile of the A stream used by this step
+  unsigned lb;          // tile of the B^T stream used by this step
+} mm_step_t;
+
+static inline unsigned min_u(const unsigned x, const unsigned y)
 {
-  const unsigned width_local         = hero_tryread((unsigned int *)&width);
-  const unsigned height_local        = hero_tryread((unsigned int *)&height);
-  const unsigned stripe_height_local = hero_tryread((unsigned int *)&stripe_height);
-
-  const unsigned n_stripes = height_local / stripe_height_local;
-  const unsigned stripe_size_b = width_local * stripe_height_local * sizeof(uint32_t);
-
-  uint32_t * a_ptrs[2];
-  uint32_t * b_ptrs[2];
-  uint32_t * c_ptrs[2];
-
-  hero_dma_job_t a_dma[2];
-  hero_dma_job_t b_dma[2];
-  hero_dma_job_t c_dma[2];
-
-  unsigned a_idx = 0;
-  unsigned c_idx = 0;
-  unsigned b_idx = 0;
-
-  // allocate the buffers
-  a_ptrs[0] = (uint32_t *)hero_l1malloc(stripe_size_b);
-  a_ptrs[1] = (uint32_t *)hero_l1malloc(stripe_size_b);
-  b_ptrs[0] = (uint32_t *)hero_l1malloc(stripe_size_b);
-  b_ptrs[1] = (uint32_t *)hero_l1malloc(stripe_size_b);
-  c_ptrs[0] = (uint32_t *)hero_l1malloc(stripe_size_b);
-  c_ptrs[1] = (uint32_t *)hero_l1malloc(stripe_size_b);
-
-  if ( (a_ptrs[0] == NULL) || (a_ptrs[1] == NULL) ||
-       (b_ptrs[0] == NULL) || (b_ptrs[1] == NULL) ||
-       (c_ptrs[0] == NULL) || (c_ptrs[1] == NULL) ) {
-    printf("ERROR: Memory allocation failed!\n");
-    return -ENOMEM;
+  return x < y ? x : y;
+}
+
+static inline void sched_step(const mm_sched_t * const sched, const unsigned step,
+    mm_step_t * const st)
+{
+  const unsigned s = step / sched->n_tiles_k / sched->n_tiles_n;
+  const unsigned t = step / sched->n_tiles_k % sched->n_tiles_n;
+
+  st->tile   = step / sched->n_tiles_k;
+  st->kb     = step % sched->n_tiles_k;
+  st->rows_m = min_u(sched->tile_m, sched->m - s*sched->tile_m);
+  st->rows_n = min_u(sched->tile_n, sched->n - t*sched->tile_n);
+  st->cols_k = min_u(sched->tile_k, sched->k - st->kb*sched->tile_k);
+  st->la     = sched->a_stream ? step : s;
+  st->lb     = sched->b_stream ? step : 0;
+}
+
+/*
+ * Compute the share of `worker` out of `n_workers` of a step.  The register blocks of the c tile
+ * are distributed cyclically, so every worker accumulates into the same blocks in all k steps of a
+ * tile, and no synchronization is needed between these steps.
+ */
+static inline void sched_compute(const mm_sched_t * const sched, const mm_step_t * const st,
+    const unsigned worker, const unsigned n_workers)
+{
+  const mm_elem_t * const a_buf = (const mm_elem_t *)ts_buf(&sched->a, st->la);
+  const mm_elem_t * const b_buf = (const mm_elem_t *)ts_buf(&sched->b, st->lb);
+  mm_acc_t * const        c_buf = (mm_acc_t *)ts_buf(&sched->c, st->tile);
+
+  const unsigned n_blocks_n = (st->rows_n + MM_KERNEL_NR - 1) / MM_KERNEL_NR;
+  const unsigned n_blocks   = (st->rows_m + MM_KERNEL_MR - 1) / MM_KERNEL_MR * n_blocks_n;
+
+  for (unsigned blk=worker; blk<n_blocks; blk+=n_workers) {
+    const unsigned i = blk / n_blocks_n * MM_KERNEL_MR;
+    const unsigned j = blk % n_blocks_n * MM_KERNEL_NR;
+
+    // accumulate the partial products of all k blocks in the c tile
+    mm_kernel_block(st->rows_m-i, st->rows_n-j, st->cols_k,
+      &a_buf[i*sched->tile_k], sched->tile_k,
+      &b_buf[j*sched->tile_k], sched->tile_k,
+      &c_buf[i*sched->tile_n+j], sched->tile_n, st->kb > 0);
+
+    // the last k block completes the block
+    if (st->kb == sched->n_tiles_k-1) {
+      mm_output_block(st->rows_m-i < MM_KERNEL_MR ? st->rows_m-i : MM_KERNEL_MR,
+        st->rows_n-j < MM_KERNEL_NR ? st->rows_n-j : MM_KERNEL_NR,
+        &c_buf[i*sched->tile_n+j], sched->tile_n);
+    }
   }
+}
 
-  #pragma omp parallel \
-    firstprivate(a_ptrs, b_ptrs, c_ptrs, width_local, height_local, stripe_height_local) \
-    firstprivate(a_dma, b_dma, c_dma) \
-    shared(a_idx, b_idx, c_idx) \
-    shared(a, b, c)
-  {
-    const int thread_id = omp_get_thread_num();
+/*
+ * Synchronization
+ *
+ * Threads synchronize through monotonic counters that are only ever read and written atomically,
+ * so a thread waits for exactly the buffer it needs instead of meeting the whole team at a barrier.
+ */
+static inline unsigned flag_read(unsigned * const flag)
+{
+  unsigned val;
+  #pragma omp atomic read seq_cst
+  val = *flag;
+  return val;
+}
+
+static inline void flag_write(unsigned * const flag, const unsigned val)
+{
+  #pragma omp atomic write seq_cst
+  *flag = val;
+}
 
-    // get the first stripes
-    if (thread_id == 0) {
-      a_dma[a_idx] = hero_dma_memcpy_async((void *)a_ptrs[a_idx], (void *)a, stripe_size_b);
+static inline void flag_inc(unsigned * const flag)
+{
+  #pragma omp atomic update seq_cst
+  *flag += 1;
+}
+
+static inline void flag_relax(void)
+{
+#ifdef HERO_EMU
+  // Emulated cores may share a host CPU, so give the threads that are waited for a chance to run.
+  sched_yield();
+#endif
+}
+
+/*
+ * Role-mixed pipeline
+ *
+ * Thread 0 drives the A stream, thread 1 the B^T stream, and thread 2 writes back the c tiles; all
+ * threads compute.  Every buffer has two counters: `ready` counts the tiles that have arrived in
+ * it, and `done` counts the threads that are done with its tiles.  Tile `l` is thus ready once
+ * `ready >= l/depth + 1`, and its buffer can be refilled once `done >= n_threads * (l/depth + 1)`.
+ * For the c tiles, `ready` counts the completed write backs instead.  A role thread keeps working
+ * through its role whenever it would otherwise wait.
+ */
+typedef struct {
+  unsigned ready[PIPELINE_DEPTH_MAX];
+  unsigned done[PIPELINE_DEPTH_MAX];
+} pipe_flags_t;
+
+/*
+ * Prefetch into the buffers all threads are done with, and wait for the tiles up to tile `l`.
+ */
+static void roles_get(ts_stream_t * const ts, pipe_flags_t * const flags, const unsigned l,
+    const unsigned n_threads)
+{
+  const unsigned d = ts->depth;
+
+  while ( (ts->released < ts->n_tiles) &&
+          (flag_read(&flags->done[ts->released % d]) >= n_threads * (ts->released / d + 1)) )
+    ts_release(ts, ts->released + 1);
+  while (ts_can_issue(ts))
+    ts_issue(ts);
+
+  const unsigned before = ts->completed;
+  const unsigned after  = ts_wait(ts, l);
+  for (unsigned i=before; i<after; i++)
+    flag_write(&flags->ready[i % d], i / d + 1);
+}
+
+/*
+ * Write back the c tiles all threads are done with, and complete the older write backs and the
+ * one whose buffer is needed for tile `tile`.
+ */
+static void roles_put(ts_stream_t * const ts, pipe_flags_t * const flags, const unsigned tile,
+    const unsigned n_threads)
+{
+  const unsigned d = ts->depth;
+
+  while ( (ts->issued < ts->n_tiles) &&
+          (flag_read(&flags->done[ts->issued % d]) >= n_threads * (ts->issued / d + 1)) )
+    ts_issue(ts);
+
+  while ( (ts->completed < ts->issued) &&
+          ((ts->completed + 1 < ts->issued) || (ts->completed + d <= tile)) ) {
+    const unsigned i = ts->completed;
+    ts_wait(ts, i);
+    flag_write(&flags->ready[i % d], i / d + 1);
+  }
+}
+
+static void mm_roles(mm_sched_t * const sched, pipe_flags_t * const a_flags,
+    pipe_flags_t * const b_flags, pipe_flags_t * const c_flags)
+{
+  const unsigned thread_id = omp_get_thread_num();
+  const unsigned n_threads = omp_get_num_threads();
+  const unsigned d         = sched->depth;
+
+  // With fewer than three threads, a thread takes several roles.
+  const int is_a = thread_id == 0;
+  const int is_b = thread_id == 1 % n_threads;
+  const int is_c = thread_id == 2 % n_threads;
+
+  for (unsigned step=0; step<sched->n_steps; step++) {
+    mm_step_t st;
+    sched_step(sched, step, &st);
+
+    // wait for the a and b blocks and, at the start of a tile, a free c buffer
+    while (1) {
+      if (is_a)
+        roles_get(&sched->a, a_flags, st.la, n_threads);
+      if (is_b)
+        roles_get(&sched->b, b_flags, st.lb, n_threads);
+      if (is_c)
+        roles_put(&sched->c, c_flags, st.tile, n_threads);
+
+      if ( (flag_read(&a_flags->ready[st.la % d]) > st.la / d) &&
+           (flag_read(&b_flags->ready[st.lb % d]) > st.lb / d) &&
+           ((st.kb > 0) || (flag_read(&c_flags->ready[st.tile % d]) >= st.tile / d)) )
+        break;
+      flag_relax();
     }
-    else if (thread_id == 1) {
-      b_dma[b_idx] = hero_dma_memcpy_async((void *)b_ptrs[b_idx], (void *)b, stripe_size_b);
+
+    sched_compute(sched, &st, thread_id, n_threads);
+
+    // release the buffers this thread is done with
+    mm_step_t next;
+    sched_step(sched, step+1, &next);
+    if ( (step == sched->n_steps-1) || (next.la != st.la) )
+      flag_inc(&a_flags->done[st.la % d]);
+    if ( (step == sched->n_steps-1) || (next.lb != st.lb) )
+      flag_inc(&b_flags->done[st.lb % d]);
+    if (st.kb == sched->n_tiles_k-1)
+      flag_inc(&c_flags->done[st.tile % d]);
+  } // step < n_steps
+
+  // copy out the remaining c tiles
+  if (is_c) {
+    while (sched->c.completed < sched->n_tiles) {
+      roles_put(&sched->c, c_flags, sched->n_tiles + d, n_threads);
+      flag_relax();
     }
+  }
+}
 
-    // horizontal a and c stripes
-    for (unsigned s=0; s<n_stripes; s++) {
+/*
+ * Data-mover pipeline
+ *
+ * Thread 0 drives all streams and publishes the steps whose blocks have arrived in a ring of step
+ * descriptors; all other threads only compute.  Descriptor `step` is published once
+ * `ready[step % depth] >= step/depth + 1`, and it has been consumed by all workers once
+ * `done[step % depth] >= n_workers * (step/depth + 1)`.  Only the mover tracks which buffers are in
+ * use, so the workers never wait for a DMA transfer themselves.
+ */
+typedef struct {
+  mm_step_t step[PIPELINE_DEPTH_MAX];
+  unsigned  ready[PIPELINE_DEPTH_MAX];
+  unsigned  done[PIPELINE_DEPTH_MAX];
+} mm_ring_t;
 
-      if (thread_id == 0) {
-        // swap buffer
-        a_idx = a_idx ? 0 : 1;
+static void mm_mover(mm_sched_t * const sched, mm_ring_t * const ring)
+{
+  const unsigned thread_id = omp_get_thread_num();
+  const unsigned n_workers = omp_get_num_threads() - 1;
+  const unsigned d         = sched->depth;
 
-        if (s < n_stripes-1) {
-          // determine next DMA XFER
-          const unsigned ext_addr = (unsigned)a + (s+1)*stripe_size_b;
+  if (thread_id > 0) {
+    // worker
+    for (unsigned step=0; step<sched->n_steps; step++) {
+      const unsigned slot = step % d;
+      while (flag_read(&ring->ready[slot]) <= step / d)
+        flag_relax();
 
-          // set up DMA XFER
-          a_dma[a_idx] = hero_dma_memcpy_async((void *)a_ptrs[a_idx], (void *)ext_addr, stripe_size_b);
-        }
+      const mm_step_t st = ring->step[slot];
+      sched_compute(sched, &st, thread_id-1, n_workers);
 
-        // wait for previous DMA XFER
-        hero_dma_wait(a_dma[!a_idx]);
-      }
-      else if ( (thread_id == 2) && (s > 0) ) {
-        // swap buffer
-        c_idx = c_idx ? 0 : 1;
+      flag_inc(&ring->done[slot]);
+    }
+    return;
+  }
 
-        // determine next DMA XFER
-        const unsigned ext_addr = (unsigned)c + (s-1)*stripe_size_b;
+  // data mover
+  ts_stream_t * const a = &sched->a;
+  ts_stream_t * const b = &sched->b;
+  ts_stream_t * const c = &sched->c;
 
-        // set up DMA XFER
-        c_dma[!c_idx] = hero_dma_memcpy_async((void *)ext_addr, (void *)c_ptrs[!c_idx], stripe_size_b);
+  unsigned c_computed = 0;
+  unsigned published  = 0;
+  unsigned consumed   = 0;
 
-        // wait for previous DMA XFER
-        if (s > 1)
-          hero_dma_wait(c_dma[c_idx]);
-      }
+  while (c->completed < sched->n_tiles) {
+    unsigned progress = 0;
 
-      // vertical b stripes
-      for (unsigned t=0; t<n_stripes; t++) {
+    // retire the steps all workers are done with
+    while ( (consumed < published) &&
+            (flag_read(&ring->done[consumed % d]) >= n_workers * (consumed / d + 1)) ) {
+      mm_step_t st, next;
+      sched_step(sched, consumed, &st);
+      sched_step(sched, consumed+1, &next);
+      consumed++;
 
-        if ( (thread_id == 1) ) {
-          // swap buffer
-          b_idx = b_idx ? 0 : 1;
+      if ( (consumed == sched->n_steps) || (next.la != st.la) )
+        ts_release(a, st.la + 1);
+      if ( (consumed == sched->n_steps) || (next.lb != st.lb) )
+        ts_release(b, st.lb + 1);
+      if (st.kb == sched->n_tiles_k-1)
+        c_computed++;
+      progress = 1;
+    }
 
-          if (t < n_stripes-1) {
-            // determine next DMA XFER
-            const unsigned ext_addr = (unsigned)b + (t+1)*stripe_size_b;
+    // copy out the computed c tiles
+    while (c->issued < c_computed) {
+      ts_issue(c);
+      progress = 1;
+    }
 
-            // set up DMA XFER
-            b_dma[b_idx] = hero_dma_memcpy_async((void *)b_ptrs[b_idx], (void *)ext_addr, stripe_size_b);
-          }
-          else if (s < n_stripes-1) {
-            // determine next DMA XFER
-            const unsigned ext_addr = (unsigned)b;
+    // set up the next DMA XFERs, as far as buffers are free
+    while (ts_can_issue(a)) {
+      ts_issue(a);
+      progress = 1;
+    }
+    while (ts_can_issue(b)) {
+      ts_issue(b);
+      progress = 1;
+    }
 
-            // set up DMA XFER
-            b_dma[b_idx] = hero_dma_memcpy_async((void *)b_ptrs[b_idx], (void *)ext_addr, stripe_size_b);
-          }
+    // publish the next step once its blocks have arrived and its c buffer is free
+    if ( (published < sched->n_steps) && (published < consumed + d) ) {
+      mm_step_t st;
+      sched_step(sched, published, &st);
 
-          // wait for previous DMA XFER
-          hero_dma_wait(b_dma[!b_idx]);
-        }
+      if ( (st.kb == 0) && (st.tile >= c->completed + d) && (c->completed < c->issued) )
+        ts_wait(c, c->completed);
 
-        #pragma omp barrier
+      if ( (st.la < a->issued) && (st.lb < b->issued) &&
+           ((st.kb > 0) || (st.tile < c->completed + d)) ) {
+        ts_wait(a, st.la);
+        ts_wait(b, st.lb);
 
-        #pragma omp for collapse(2)
+        ring->step[published % d] = st;
+        flag_write(&ring->ready[published % d], published / d + 1);
+        published++;
+        progress = 1;
+      }
+    }
+    else if ( (published == sched->n_steps) && (c->completed < c->issued) ) {
+      // complete the write backs
+      ts_wait(c, c->issued - 1);
+      progress = 1;
+    }
 
-        // horizontal a and c rows
-        for (unsigned i=0; i<stripe_height_local; i++) {
+    if (!progress)
+      flag_relax();
+  }
+}
 
-          // vertical b columns
-          for (unsigned j=0; j<stripe_height_local; j++) {
+/*
+ * Multiply A and B^T with the pipeline of `mode`.  The bytes the streams have transferred between
+ * the external and the L1 memory are written to `traffic_b`, low word first.
+ */
+int double_buf_mm(mm_elem_t * __restrict__ a, mm_elem_t * __restrict__ b, mm_acc_t * __restrict__ c,
+    uint32_t m, uint32_t n, uint32_t k, uint32_t tile_m, uint32_t tile_n, uint32_t tile_k,
+    uint32_t depth, uint32_t mode, uint32_t * traffic_b)
+{
+  mm_sched_t sched;
 
-            uint32_t sum = 0;
-            for (unsigned k=0; k<width_local; k++) {
-              sum = sum + a_ptrs[!a_idx][i*width_local+k] * b_ptrs[!b_idx][j*width_local+k];
-            } // k < width_local
-            c_ptrs[c_idx][i*width_local+t*stripe_height_local+j] = sum;
-          } // j < stripe_height_local
-        } // i < stripe_height_local
-      } // t < n_stripes
+  sched.m      = hero_tryread((unsigned int *)&m);
+  sched.n      = hero_tryread((unsigned int *)&n);
+  sched.k      = hero_tryread((unsigned int *)&k);
+  sched.tile_m = hero_tryread((unsigned int *)&tile_m);
+  sched.tile_n = hero_tryread((unsigned int *)&tile_n);
+  sched.tile_k = hero_tryread((unsigned int *)&tile_k);
+  sched.depth  = hero_tryread((unsigned int *)&depth);
+  const unsigned mode_local = hero_tryread((unsigned int *)&mode);
 
-    } // n_stripes
+  if ( (sched.depth < 2) || (sched.depth > PIPELINE_DEPTH_MAX) ) {
+    printf("ERROR: Pipeline depth must be between 2 and %u!\n", PIPELINE_DEPTH_MAX);
+    return -EINVAL;
+  }
+
+  sched.n_tiles_m = (sched.m + sched.tile_m - 1) / sched.tile_m;
+  sched.n_tiles_n = (sched.n + sched.tile_n - 1) / sched.tile_n;
+  sched.n_tiles_k = (sched.k + sched.tile_k - 1) / sched.tile_k;
+  sched.n_tiles   = sched.n_tiles_m * sched.n_tiles_n;
+  sched.n_steps   = sched.n_tiles * sched.n_tiles_k;
+  sched.a_stream  = sched.n_tiles_k > 1;
+  sched.b_stream  = (sched.n_tiles_k > 1) || (sched.n_tiles_n > 1);
+
+  // set up the streams and allocate their buffers
+  const unsigned elem_b = sizeof(mm_elem_t);
+  const unsigned acc_b  = sizeof(mm_acc_t);
+  int err_a = ts_init(&sched.a, TS_IN, (void *)a, elem_b, sched.m, sched.k, sched.k*elem_b,
+    sched.tile_m, sched.tile_k, 0, sched.depth);
+  int err_b = ts_init(&sched.b, TS_IN, (void *)b, elem_b, sched.n, sched.k, sched.k*elem_b,
+    sched.tile_n, sched.tile_k, 0, sched.depth);
+  int err_c = ts_init(&sched.c, TS_OUT, (void *)c, acc_b, sched.m, sched.n, sched.n*acc_b,
+    sched.tile_m, sched.tile_n, 0, sched.depth);
+  if (err_a || err_b || err_c) {
+    printf("ERROR: Memory allocation failed!\n");
+    if (!err_a) ts_free(&sched.a);
+    if (!err_b) ts_free(&sched.b);
+    if (!err_c) ts_free(&sched.c);
+    return -ENOMEM;
+  }
+  if (sched.a_stream)
+    ts_set_reps(&sched.a, sched.n_tiles_n, 1);
+  if (sched.b_stream)
+    ts_set_reps(&sched.b, 1, sched.n_tiles_m);
 
-    // copy out last c stripe
-    if (thread_id == 2)
-      hero_dma_memcpy((void *)((unsigned)c+(n_stripes-1)*stripe_size_b), (void *)c_ptrs[c_idx], stripe_size_b);
+  pipe_flags_t a_flags = { { 0 }, { 0 } };
+  pipe_flags_t b_flags = { { 0 }, { 0 } };
+  pipe_flags_t c_flags = { { 0 }, { 0 } };
+  mm_ring_t    ring    = { .ready = { 0 }, .done = { 0 } };
 
+  #pragma omp parallel shared(sched, a_flags, b_flags, c_flags, ring)
+  {
+    // A single thread cannot be both data mover and worker.
+    if ( (mode_local == MM_MODE_MOVER) && (omp_get_num_threads() > 1) )
+      mm_mover(&sched, &ring);
+    else
+      mm_roles(&sched, &a_flags, &b_flags, &c_flags);
   } // parallel
 
-  hero_l1free(a_ptrs[0]);
-  hero_l1free(a_ptrs[1]);
-  hero_l1free(b_ptrs[0]);
-  hero_l1free(b_ptrs[1]);
-  hero_l1free(c_ptrs[0]);
-  hero_l1free(c_ptrs[1]);
+  const uint64_t bytes = sched.a.bytes + sched.b.bytes + sched.c.bytes;
+  hero_trywrite(&traffic_b[0], (uint32_t)bytes);
+  hero_trywrite(&traffic_b[1], (uint32_t)(bytes >> 32));
+
+  ts_free(&sched.a);
+  ts_free(&sched.b);
+  ts_free(&sched.c);
 
   return 0;
 }
 
 #pragma omp end declare target
 
+/*
+ * Split of the rows of C between the accelerator and the host
+ *
+ * The accelerator computes the first `ratio * m` rows of C, the host the remaining ones, both at
+ * the same time.  The ratio balances the throughputs (rows per millisecond) of both sides, which
+ * are smoothed over the runs, so the split adapts to the load of the host and the accelerator.
+ * It is calibrated with the run times of both sides alone and, if the file named by the
+ * environment variable `MM_SPLIT_FILE` holds a split for the same matrix sizes, continued from
+ * there; the latest split is written back to that file at the end.
+ */
+typedef struct {
+  unsigned m, n, k;
+  double   acc_rate;    // rows per ms of the accelerator
+  double   host_rate;   // rows per ms of the host
+  double   ratio;       // share of the rows computed by the accelerator
+} mm_split_t;
+
+/**
+ * Calibrate a split with the run times of the whole multiplication on either side alone.
+ */
+void mm_split_init(mm_split_t* split, unsigned m, unsigned n, unsigned k, double acc_ms,
+    double host_ms);
+
+/**
+ * Update the throughputs and the ratio of a split with the run times of the last run.  A side that
+ * has not computed any rows keeps its throughput.
+ */
+void mm_split_update(mm_split_t* split, unsigned acc_rows, double acc_ms, unsigned host_rows,
+    double host_ms);
+
+/**
+ * Rows of C to be computed by the accelerator.  Unless there is only one row, both sides get at
+ * least one row, so both throughputs stay measured.
+ */
+unsigned mm_split_acc_rows(const mm_split_t* split);
+
+/**
+ * Load a split for the same matrix sizes from a file.
+ *
+ * @return  0 on success; -ENOENT if the file cannot be read or holds a split for other sizes.
+ */
+int mm_split_load(mm_split_t* split, const char* path);
+
+/**
+ * Store a split in a file.
+ *
+ * @return  0 on success; -EIO on failure.
+ */
+int mm_split_save(const mm_split_t* split, const char* path);
+
+/**
+ * Multiply the first `acc_rows` rows of A on the accelerator, in a `nowait` target task, while the
+ * host threads multiply the remaining rows with `mm_host_rec()`.
+ *
+ * @param acc_ms     Run time of the accelerator part, from the start of both parts.
+ * @param host_ms    Run time of the host part, from the start of both parts.
+ * @param traffic_b  External traffic of the accelerator part, as written by `double_buf_mm()`.
+ * @return           0 on success; a negative error code if the accelerator part cannot be planned
+ *                   or fails.
+ */
+int mm_coexec(mm_elem_t* a, mm_elem_t* b, mm_acc_t* c, unsigned m, unsigned n, unsigned k,
+    unsigned acc_rows, unsigned depth, unsigned mode, double* acc_ms, double* host_ms,
+    uint32_t* traffic_b);
+
+static void mm_split_set_ratio(mm_split_t* const split)
+{
+  if ( (split->acc_rate > 0) && (split->host_rate > 0) )
+    split->ratio = split->acc_rate / (split->acc_rate + split->host_rate);
+  else
+    split->ratio = split->acc_rate > 0 ? 1.0 : 0.0;
+}
+
+void mm_split_init(mm_split_t* const split, const unsigned m, const unsigned n,
+    const unsigned k, const double acc_ms, const double host_ms)
+{
+  split->m         = m;
+  split->n         = n;
+  split->k         = k;
+  split->acc_rate  = acc_ms > 0 ? m / acc_ms : 0;
+  split->host_rate = host_ms > 0 ? m / host_ms : 0;
+  mm_split_set_ratio(split);
+}
+
+static double mm_split_smooth(const double rate, const unsigned rows, const double ms)
+{
+  if ( (rows == 0) || (ms <= 0) )
+    return rate;
+  if (rate <= 0)
+    return rows / ms;
+  return (1-MM_SPLIT_SMOOTHING) * rate + MM_SPLIT_SMOOTHING * rows / ms;
+}
+
+void mm_split_update(mm_split_t* const split, const unsigned acc_rows, const double acc_ms,
+    const unsigned host_rows, const double host_ms)
+{
+  split->acc_rate  = mm_split_smooth(split->acc_rate, acc_rows, acc_ms);
+  split->host_rate = mm_split_smooth(split->host_rate, host_rows, host_ms);
+  mm_split_set_ratio(split);
+}
+
+unsigned mm_split_acc_rows(const mm_split_t* const split)
+{
+  unsigned rows = (unsigned)(split->ratio * split->m + 0.5);
+  if (split->m < 2)
+    return rows > split->m ? split->m : rows;
+  if (rows < 1)
+    rows = 1;
+  if (rows > split->m - 1)
+    rows = split->m - 1;
+  return rows;
+}
+
+int mm_split_load(mm_split_t* const split, const char* const path)
+{
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL)
+    return -ENOENT;
+
+  mm_split_t s;
+  const int n_read = fscanf(fp, "%u %u %u %lf %lf", &s.m, &s.n, &s.k, &s.acc_rate, &s.host_rate);
+  fclose(fp);
+  if ( (n_read != 5) || (s.m != split->m) || (s.n != split->n) || (s.k != split->k) ||
+       (s.acc_rate < 0) || (s.host_rate < 0) )
+    return -ENOENT;
+
+  mm_split_set_ratio(&s);
+  *split = s;
+  return 0;
+}
+
+int mm_split_save(const mm_split_t* const split, const char* const path)
+{
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL)
+    return -EIO;
+
+  fprintf(fp, "%u %u %u %.9g %.9g\n", split->m, split->n, split->k, split->acc_rate,
+    split->host_rate);
+  return fclose(fp) == 0 ? 0 : -EIO;
+}
+
+int mm_coexec(mm_elem_t* const a, mm_elem_t* const b, mm_acc_t* const c, const unsigned m,
+    const unsigned n, const unsigned k, const unsigned acc_rows, const unsigned depth,
+    const unsigned mode, double* const acc_ms, double* const host_ms, uint32_t* const traffic_b)
+{
+  // The accelerator part is planned for its own rows.
+  mm_plan_t plan = { 0 };
+  if ( (acc_rows > 0) && (mm_plan(&plan, acc_rows, n, k, depth, L1_BUDGET_B) != 0) )
+    return -ENOMEM;
+  unsigned tile_m = plan.tile_m;
+  unsigned tile_n = plan.tile_n;
+  unsigned tile_k = plan.tile_k;
+
+  mm_elem_t* const a_host     = a + (size_t)acc_rows*k;
+  mm_acc_t* const  c_host     = c + (size_t)acc_rows*n;
+  const size_t     a_acc_size = (size_t)acc_rows*k;
+  const size_t     b_size     = (size_t)n*k;
+  const size_t     c_acc_size = (size_t)acc_rows*n;
+
+  int          err      = 0;
+  const double start    = omp_get_wtime();
+  double       acc_end  = start;
+  double       host_end = start;
+
+  #pragma omp parallel shared(acc_end, host_end, err)
+  #pragma omp single
+  {
+    if (acc_rows > 0) {
+      // The completion of the target task is timed by a task depending on it.
+      #pragma omp target device(1) nowait depend(out: acc_end) \
+        map(to: a[0:a_acc_size], b[0:b_size], acc_rows, n, k, tile_m, tile_n, tile_k, depth, mode) \
+        map(from: c[0:c_acc_size]) map(tofrom: traffic_b[0:2], err)
+      err |= double_buf_mm(a, b, c, acc_rows, n, k, tile_m, tile_n, tile_k, depth, mode,
+        traffic_b);
+
+      #pragma omp task depend(in: acc_end)
+      acc_end = omp_get_wtime();
+    }
+
+    if (acc_rows < m) {
+      mm_host_rec(m-acc_rows, n, k, a_host, k, b, k, c_host, n, 0, 0);
+      mm_output_block(m-acc_rows, n, c_host, n);   // mm_host_rec() waits for its tasks
+      host_end = omp_get_wtime();
+    }
+
+    #pragma omp taskwait
+  } // parallel
+
+  *acc_ms  = (acc_end - start) * 1000;
+  *host_ms = (host_end - start) * 1000;
+
+  return err;
+}
+
 int main(int argc, char *argv[])
 {
   printf("HERO matrix multiplication started.\n");
 
-  unsigned height  = 128;
+  // C (m x n) = A (m x k) * B (k x n)
+  unsigned m = 128;
   if( argc > 1 ) {
-    height  = strtoul(argv[1], NULL, 0);
+    m = strtoul(argv[1], NULL, 0);
   }
-  if (height > 512) {
-    height = 512;
+  unsigned n = m;
+  if( argc > 2 ) {
+    n = strtoul(argv[2], NULL, 0);
   }
-  if (height < 32) {
-    height = 32;
+  unsigned k = m;
+  if( argc > 3 ) {
+    k = strtoul(argv[3], NULL, 0);
   }
-
-  // Take a height such that:
-  // - it is divisible by stripe_height,
-  // - the stripe size can actually be allocated in the L1 memory
-  unsigned stripe_height = height/2;
-  while (stripe_height*height*sizeof(uint32_t) >= 32*1024) {
-    stripe_height = stripe_height/2;
+  if ( (m == 0) || (n == 0) || (k == 0) ) {
+    printf("ERROR: Matrix dimensions must be positive!\n");
+    return -EINVAL;
+  }
+  unsigned depth = PIPELINE_DEPTH;
+  if( argc > 4 ) {
+    depth = strtoul(argv[4], NULL, 0);
+  }
+  if ( (depth < 2) || (depth > PIPELINE_DEPTH_MAX) ) {
+    printf("ERROR: Pipeline depth must be between 2 and %u!\n", PIPELINE_DEPTH_MAX);
+    return -EINVAL;
   }
-  const unsigned n_stripes = height/stripe_height;
-  height = n_stripes * stripe_height;
 
-  unsigned width = height;
+  // Take the largest tiles whose buffers can actually be allocated in the L1 memory.
+  mm_plan_t plan;
+  if (mm_plan(&plan, m, n, k, depth, L1_BUDGET_B) != 0) {
+    printf("ERROR: Tiles do not fit into the L1 budget of %u B!\n", L1_BUDGET_B);
+    return -ENOMEM;
+  }
+  unsigned tile_m = plan.tile_m;
+  unsigned tile_n = plan.tile_n;
+  unsigned tile_k = plan.tile_k;
 
   // Allocate memory
-  uint32_t * a = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * b = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * c = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * d = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
+  const size_t a_size = (size_t)m*k;
+  const size_t b_size = (size_t)n*k;
+  const size_t c_size = (size_t)m*n;
+  mm_elem_t * a = (mm_elem_t *)malloc(sizeof(mm_elem_t)*a_size);
+  mm_elem_t * b = (mm_elem_t *)malloc(sizeof(mm_elem_t)*b_size);
+  mm_acc_t *  c = (mm_acc_t *)malloc(sizeof(mm_acc_t)*c_size);
+  mm_acc_t *  d = (mm_acc_t *)malloc(sizeof(mm_acc_t)*c_size);
   if ( (a == NULL) || (b == NULL) || (c == NULL) || (d == NULL) ) {
     printf("ERROR: malloc() failed!\n");
     return -ENOMEM;
   }
-  printf("width = %u, height = %u, stripe_height = %u, a @ %p, b @ %p, c @ %p\n",
-    width, height, stripe_height, a, b, c);
-  printf("Total data size = %.2f KiB\n", 3*(float)(width*height*sizeof(uint32_t))/1024);
-
-  // Init matrices
-  for (unsigned i=0; i<width; i++) {
-    for (unsigned j=0; j<height; j++) {
-      a[i*width+j] = i*width+j;
-      b[i*width+j] = i == j ? 2 : 0;
+  printf("m = %u, n = %u, k = %u, a @ %p, b @ %p, c @ %p\n", m, n, k, a, b, c);
+  printf("Element type = %s, accumulator = %u B\n", MM_TYPE_NAME, (unsigned)sizeof(mm_acc_t));
+  printf("Total data size = %.2f KiB\n",
+    (float)((a_size+b_size)*sizeof(mm_elem_t) + c_size*sizeof(mm_acc_t))/1024);
+  mm_plan_print(&plan);
+
+  // Init matrices, b holds B transposed
+  for (unsigned i=0; i<m; i++) {
+    for (unsigned j=0; j<k; j++) {
+      a[i*k+j] = MM_TEST_VALUE(i*k+j);
+    }
+  }
+  for (unsigned i=0; i<n; i++) {
+    for (unsigned j=0; j<k; j++) {
+      b[i*k+j] = i == j ? 2 : 0;
     }
   }
-  memset((void *)c, 0, (size_t)(width*height));
-  memset((void *)d, 0, (size_t)(width*height));
+  memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+  memset((void *)d, 0, sizeof(mm_acc_t)*c_size);
 
   /*
    * Execute on host
    */
 
-  bench_start("Host");
-  #pragma omp parallel firstprivate(a, b, d, width, height) num_threads(1)
-  {
-    #pragma omp for collapse(2)
-    for (unsigned i=0; i<width; i++) {
-      for (unsigned j=0; j<height; j++) {
-        uint32_t sum = 0;
-        for (unsigned k=0; k<width; k++)
-          sum = sum + a[i*width+k] * b[j*width+k];
-        d[i*width+j] = sum;
+  // plain reference, independent of the kernels checked against it
+  bench_region_t region;
+  BENCH_REGION(region, "Host" MM_TYPE_TAG) {
+    #pragma omp parallel firstprivate(a, b, d, m, n, k) num_threads(1)
+    {
+      #pragma omp for collapse(2)
+      for (unsigned i=0; i<m; i++) {
+        for (unsigned j=0; j<n; j++) {
+          mm_acc_t sum = 0;
+          for (unsigned l=0; l<k; l++)
+            sum += (mm_acc_t)a[i*k+l] * (mm_acc_t)b[j*k+l];
+          d[i*n+j] = mm_output(sum);
+        }
+      }
+    }
+  }
+
+  BENCH_REGION(region, "Host: Micro-kernel" MM_TYPE_TAG) {
+    #pragma omp parallel firstprivate(a, b, c, m, n, k) num_threads(1)
+    {
+      #pragma omp for collapse(2)
+      for (unsigned i=0; i<m; i+=MM_KERNEL_MR) {
+        for (unsigned j=0; j<n; j+=MM_KERNEL_NR) {
+          mm_kernel_block(m-i, n-j, k, &a[i*k], k, &b[j*k], k, &c[i*n+j], n, 0);
+          mm_output_block(m-i < MM_KERNEL_MR ? m-i : MM_KERNEL_MR,
+            n-j < MM_KERNEL_NR ? n-j : MM_KERNEL_NR, &c[i*n+j], n);
+        }
       }
     }
   }
-  bench_stop();
+  compare_matrices(c, d, n, m);
+  memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+
+  BENCH_REGION(region, "Host: Recursive, parallel" MM_TYPE_TAG) {
+    mm_host(m, n, k, a, k, b, k, c, n, 0, 0);
+  }
+  const double host_ms = region.stats.median_ms;
+  compare_matrices(c, d, n, m);
+  memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+
+#if MM_HOST_STRASSEN
+  BENCH_REGION(region, "Host: Recursive, parallel, Strassen" MM_TYPE_TAG) {
+    mm_host(m, n, k, a, k, b, k, c, n, 0, MM_HOST_STRASSEN_MIN);
+  }
+  compare_matrices(c, d, n, m);
+  memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+#endif
 
   /*
    * Excute on PULP
@@ -276,14 +979,78 @@ int main(int argc, char *argv[])
   }
   tmp_1 = tmp_2;
 
-  bench_start("PULP: Execution: Parallel, double-buffered DMA, copy-based");
+  // Compare the pipeline with DMA roles mixed into the compute team against the one with a
+  // dedicated data mover.
+  const char * const mode_names[] = { "role-mixed", "data mover" };
+
+  // A and B are never modified, so they are copied to each device only once.
+  dev_cache_t cache;
+  dev_cache_init(&cache);
+
+  double   acc_ms[2];
+  uint32_t traffic_b[2] = { 0, 0 };   // achieved by the last run
+  int      err    = 0;
+  int      failed = 0;                // set if a kernel returns an error
+  for (unsigned mode=MM_MODE_ROLES; mode<=MM_MODE_MOVER; mode++) {
+    err = 0;
+    BENCH_REGION(region, "PULP: Execution: Parallel, %u-deep DMA pipeline, %s, copy-based"
+        MM_TYPE_TAG, depth, mode_names[mode]) {
+      dev_cache_map_to(&cache, 1, a, sizeof(mm_elem_t)*a_size, 0);
+      dev_cache_map_to(&cache, 1, b, sizeof(mm_elem_t)*b_size, 0);
+      #pragma omp target device(1) \
+        map(to: a[0:a_size], b[0:b_size], m, n, k, tile_m, tile_n, tile_k, depth, mode) \
+        map(from: c[0:c_size]) map(tofrom: traffic_b[0:2], err)
+      err |= double_buf_mm(a, b, c, m, n, k, tile_m, tile_n, tile_k, depth, mode, traffic_b);
+    }
+    acc_ms[mode] = region.stats.median_ms;
+    if (err) {
+      printf("ERROR: double_buf_mm() failed with %d (%s, copy-based)!\n", err, mode_names[mode]);
+      failed = 1;
+    }
+    else {
+      compare_matrices(c, d, n, m);
+      mm_print_traffic(traffic_b, m, n, k);
+    }
+    memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+  }
+
+  /*
+   * Execute on PULP and the host at the same time, with the faster pipeline mode
+   */
+  const unsigned split_mode =
+    acc_ms[MM_MODE_MOVER] < acc_ms[MM_MODE_ROLES] ? MM_MODE_MOVER : MM_MODE_ROLES;
+  const char * const split_file = getenv("MM_SPLIT_FILE");
+  mm_split_t split;
+  mm_split_init(&split, m, n, k, acc_ms[split_mode], host_ms);
+  if ( (split_file != NULL) && (mm_split_load(&split, split_file) == 0) )
+    printf("Split: continued from %s\n", split_file);
 
-  #pragma omp target device(1) map(to: a[0:width*height], b[0:width*height], width, height, stripe_height) \
-    map(from: c[0:width*height])
-  double_buf_mm(a, b, c, width, height, stripe_height);
-  bench_stop();
-  compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
+  double split_acc_ms = 0, split_host_ms = 0;
+  unsigned acc_rows = 0;
+  err = 0;
+  BENCH_REGION(region, "Host + PULP: Row split, %u-deep DMA pipeline, %s, copy-based"
+      MM_TYPE_TAG, depth, mode_names[split_mode]) {
+    dev_cache_map_to(&cache, 1, a, sizeof(mm_elem_t)*a_size, 0);
+    dev_cache_map_to(&cache, 1, b, sizeof(mm_elem_t)*b_size, 0);
+    acc_rows = mm_split_acc_rows(&split);
+    err |= mm_coexec(a, b, c, m, n, k, acc_rows, depth, split_mode, &split_acc_ms,
+      &split_host_ms, traffic_b);
+    mm_split_update(&split, acc_rows, split_acc_ms, m-acc_rows, split_host_ms);
+  }
+  if (err) {
+    printf("ERROR: mm_coexec() failed with %d (%u rows on PULP)!\n", err, acc_rows);
+    failed = 1;
+  }
+  else {
+    printf("Split: %u of %u rows on PULP (%.2f ms), %u on the host (%.2f ms), next ratio = %.3f\n",
+      acc_rows, m, split_acc_ms, m-acc_rows, split_host_ms, split.ratio);
+    compare_matrices(c, d, n, m);
+    if (acc_rows > 0)
+      mm_print_traffic(traffic_b, acc_rows, n, k);
+  }
+  memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+  if ( (split_file != NULL) && (mm_split_save(&split, split_file) != 0) )
+    printf("ERROR: Cannot write the split to %s!\n", split_file);
 
   /*
    * Make sure PULP is ready - speeds up the first target
@@ -297,13 +1064,29 @@ int main(int argc, char *argv[])
   }
   tmp_1 = tmp_2;
 
-  bench_start("PULP Execution: Parallel, double-buffered DMA, SVM");
-  #pragma omp target device(0) map(to: a[0:width*height], b[0:width*height], width, height, stripe_height) \
-    map(from: c[0:width*height])
-  double_buf_mm(a, b, c, width, height, stripe_height);
-  bench_stop();
-  compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
+  for (unsigned mode=MM_MODE_ROLES; mode<=MM_MODE_MOVER; mode++) {
+    err = 0;
+    BENCH_REGION(region, "PULP Execution: Parallel, %u-deep DMA pipeline, %s, SVM" MM_TYPE_TAG,
+        depth, mode_names[mode]) {
+      // A and B are read in place, there is nothing to cache
+      #pragma omp target device(0) \
+        map(to: a[0:a_size], b[0:b_size], m, n, k, tile_m, tile_n, tile_k, depth, mode) \
+        map(from: c[0:c_size]) map(tofrom: traffic_b[0:2], err)
+      err |= double_buf_mm(a, b, c, m, n, k, tile_m, tile_n, tile_k, depth, mode, traffic_b);
+    }
+    if (err) {
+      printf("ERROR: double_buf_mm() failed with %d (%s, SVM)!\n", err, mode_names[mode]);
+      failed = 1;
+    }
+    else {
+      compare_matrices(c, d, n, m);
+      mm_print_traffic(traffic_b, m, n, k);
+    }
+    memset((void *)c, 0, sizeof(mm_acc_t)*c_size);
+  }
+
+  dev_cache_print(&cache, "Device cache");
+  dev_cache_release_all(&cache);
 
   // free memory
   free(a);
@@ -311,5 +1094,5 @@ int main(int argc, char *argv[])
   free(c);
   free(d);
 
-  return 0;
+  return failed;
 }
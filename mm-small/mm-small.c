@@ -23,16 +23,368 @@
 #include <stdint.h>
 #include <errno.h>        // for error codes
 #include "bench.h"
+#include "dev-cache.h"
+#include "mm-host.h"
+#include "mm-types.h"
+#include "tile-stream.h"
+#include "verify.h"
 #include <hero-target.h>
 
-void compare_matrices(uint32_t* a, uint32_t* b, unsigned width, unsigned height)
+#ifndef MM_BATCH_L1_BUDGET_B
+  #define MM_BATCH_L1_BUDGET_B (192*1024)  // L1 memory available to the batched kernel
+#endif
+#define MM_BATCH_DEPTH 2                  // buffers per operand of the batched kernel
+
+#ifndef MM_TILED_L1_BUDGET_B
+  #define MM_TILED_L1_BUDGET_B (192*1024)  // L1 memory available to the tiled kernel
+#endif
+#ifndef MM_TILED_TILE_K
+  #define MM_TILED_TILE_K 64               // length of the k blocks of the tiled kernel
+#endif
+#define MM_TILED_DEPTH 2                  // buffers per operand of the tiled kernel
+
+#define MM_SMALL_WIDTH_MAX 140  // widest matrices the kernels keeping A, B and C in L1 run with
+
+// layouts of B in memory
+#define MM_B_ROW_MAJOR 0  // b[k*width+j]: transposed while it is loaded into L1
+#define MM_B_COL_MAJOR 1  // b[j*width+k], i.e., B^T in row-major order: used as it is
+
+void compare_matrices(mm_acc_t* a, mm_acc_t* b, unsigned width, unsigned height)
 {
-  for (unsigned i=0; i<width; i++) {
-    for (unsigned j=0; j<height; j++) {
-      if(a[i*width+j] != b[i*width+j] ) {
-        printf("ERROR: Result mismatch in Row %u, Column %u!\n", j, i);
-        exit(-1);
+  if (mm_verify(a, b, height, width, "Result") != 0)
+    exit(-1);
+}
+
+#pragma omp declare target
+
+/*
+ * Swap row `i` with column `i` right of the diagonal of a square matrix.  Calling it for all rows
+ * transposes the matrix in place, and different rows can be handled by different threads.
+ */
+static inline void transpose_row(mm_elem_t * const m, const unsigned width, const unsigned i)
+{
+  for (unsigned j=i+1; j<width; j++) {
+    const mm_elem_t tmp = m[i*width+j];
+    m[i*width+j] = m[j*width+i];
+    m[j*width+i] = tmp;
+  }
+}
+
+/*
+ * Multiply two matrices in L1 with DMA transfers, C = A * B, for B in either layout.  The inner
+ * product always runs over B^T with unit stride: a row-major B is transposed in L1 by all cores
+ * while A is still being transferred.  Returns -ENOMEM without computing anything if A, B and C do
+ * not fit into L1 together.
+ */
+int mm_dma(mm_elem_t * __restrict__ a, mm_elem_t * __restrict__ b, mm_acc_t * __restrict__ c,
+    unsigned width, unsigned b_layout)
+{
+  const unsigned size_b   = width*width*sizeof(mm_elem_t);
+  const unsigned size_c_b = width*width*sizeof(mm_acc_t);
+
+  mm_elem_t * a_local = (mm_elem_t *)hero_l1malloc(size_b);
+  mm_elem_t * b_local = (mm_elem_t *)hero_l1malloc(size_b);
+  mm_acc_t *  c_local = (mm_acc_t *)hero_l1malloc(size_c_b);
+  if ( (a_local == NULL) || (b_local == NULL) || (c_local == NULL) ) {
+    if (a_local) hero_l1free(a_local);
+    if (b_local) hero_l1free(b_local);
+    if (c_local) hero_l1free(c_local);
+    return -ENOMEM;
+  }
+
+  hero_dma_job_t dma_b = hero_dma_memcpy_async(b_local, b, size_b);
+  hero_dma_job_t dma_a = hero_dma_memcpy_async(a_local, a, size_b);
+  hero_dma_wait(dma_b);
+
+  #pragma omp parallel firstprivate(a_local, b_local, c_local, width, b_layout)
+  {
+    if (b_layout == MM_B_ROW_MAJOR) {
+      #pragma omp for schedule(static, 1) nowait
+      for (unsigned i=0; i<width; i++)
+        transpose_row(b_local, width, i);
+    }
+
+    #pragma omp master
+    hero_dma_wait(dma_a);
+    #pragma omp barrier
+
+    #pragma omp for collapse(2)
+    for (unsigned i=0; i<width; i++) {
+      for (unsigned j=0; j<width; j++) {
+        mm_acc_t sum = 0;
+        for (unsigned k=0; k<width; k++)
+          sum = sum + (mm_acc_t)a_local[i*width+k] * b_local[j*width+k];
+        c_local[i*width+j] = mm_output(sum);
+      }
+    }
+  } // parallel
+
+  hero_dma_memcpy(c, c_local, size_c_b);
+
+  hero_l1free(a_local);
+  hero_l1free(b_local);
+  hero_l1free(c_local);
+
+  return 0;
+}
+
+/*
+ * Multiply two matrices of any size with DMA streaming, C = A * B, for B in either layout.  C is
+ * computed in square tiles with the k blocks innermost, like in mm-large: the blocks of A and B are
+ * streamed through double-buffered L1 buffers with `common/tile-stream.h`, and every C tile is
+ * accumulated in L1 and written back while the next one is computed.  A column-major B is streamed
+ * as blocks of B^T; a row-major B is streamed column of blocks by column of blocks, and every
+ * block is transposed into a scratch buffer, so the inner products always run with unit stride.
+ */
+int mm_tiled(mm_elem_t * __restrict__ a, mm_elem_t * __restrict__ b, mm_acc_t * __restrict__ c,
+    unsigned width, unsigned b_layout)
+{
+  if (width == 0)
+    return 0;
+
+  // Largest tile_mn for tile_k: depth * (2 * tile_mn * tile_k + tile_mn^2) + tile_mn * tile_k
+  // elements must fit into the budget, the tile_mn^2 ones of C as accumulators.
+  const unsigned elem_b  = sizeof(mm_elem_t);
+  const unsigned acc_b   = sizeof(mm_acc_t);
+  const unsigned tile_k  = width < MM_TILED_TILE_K ? width : MM_TILED_TILE_K;
+  unsigned       tile_mn = width;
+  while ( (tile_mn > 0) && (MM_TILED_DEPTH*(2*tile_mn*tile_k*elem_b + tile_mn*tile_mn*acc_b) +
+          tile_mn*tile_k*elem_b > MM_TILED_L1_BUDGET_B) )
+    tile_mn--;
+  if (tile_mn == 0) {
+    printf("ERROR: The tiles do not fit into L1!\n");
+    return -ENOMEM;
+  }
+
+  const unsigned n_tiles_mn = (width + tile_mn - 1) / tile_mn;
+  const unsigned n_tiles_k  = (width + tile_k - 1) / tile_k;
+  const unsigned n_steps    = n_tiles_mn * n_tiles_mn * n_tiles_k;
+  const unsigned stride_b   = width*elem_b;
+  const unsigned stride_c_b = width*acc_b;
+
+  // A: row of blocks by row of blocks, every row once per C tile of a row of C tiles
+  // B^T: all blocks once per row of C tiles
+  ts_stream_t a_ts, b_ts, c_ts;
+  int err_a = ts_init(&a_ts, TS_IN, (void *)a, elem_b, width, width, stride_b,
+    tile_mn, tile_k, 0, MM_TILED_DEPTH);
+  int err_b = b_layout == MM_B_COL_MAJOR ?
+    ts_init(&b_ts, TS_IN, (void *)b, elem_b, width, width, stride_b,
+      tile_mn, tile_k, 0, MM_TILED_DEPTH) :
+    ts_init(&b_ts, TS_IN, (void *)b, elem_b, width, width, stride_b,
+      tile_k, tile_mn, 0, MM_TILED_DEPTH);
+  int err_c = ts_init(&c_ts, TS_OUT, (void *)c, acc_b, width, width, stride_c_b,
+    tile_mn, tile_mn, 0, MM_TILED_DEPTH);
+  mm_elem_t * bt_local = NULL;
+  if (b_layout == MM_B_ROW_MAJOR)
+    bt_local = (mm_elem_t *)hero_l1malloc(tile_mn*tile_k*elem_b);
+  if ( err_a || err_b || err_c || ((b_layout == MM_B_ROW_MAJOR) && (bt_local == NULL)) ) {
+    printf("ERROR: Memory allocation failed!\n");
+    if (!err_a) ts_free(&a_ts);
+    if (!err_b) ts_free(&b_ts);
+    if (!err_c) ts_free(&c_ts);
+    if (bt_local) hero_l1free(bt_local);
+    return -ENOMEM;
+  }
+  ts_set_reps(&a_ts, n_tiles_mn, 1);
+  if (b_layout == MM_B_ROW_MAJOR)
+    ts_set_order(&b_ts, TS_COL_MAJOR);
+  ts_set_reps(&b_ts, 1, n_tiles_mn);
+
+  ts_tile_t a_tile, b_tile, c_tile;
+
+  #pragma omp parallel shared(a_ts, b_ts, c_ts, a_tile, b_tile, c_tile)
+  {
+    for (unsigned step=0; step<n_steps; step++) {
+      const unsigned kb = step % n_tiles_k;
+
+      // write back the previous C tile once it is complete, and wait for the next blocks
+      #pragma omp single
+      {
+        if (kb == 0) {
+          ts_out_put(&c_ts);
+          ts_out_next(&c_ts, &c_tile);
+        }
+        ts_in_next(&a_ts, &a_tile);
+        ts_in_next(&b_ts, &b_tile);
+      }
+
+      const mm_elem_t * const a_local = (const mm_elem_t *)a_tile.buf;
+      mm_acc_t * const        c_local = (mm_acc_t *)c_tile.buf;
+      const unsigned         rows_m  = c_tile.rows;
+      const unsigned         rows_n  = c_tile.cols;
+      const unsigned         cols_k  = a_tile.cols;
+      const mm_elem_t *       bt      = (const mm_elem_t *)b_tile.buf;
+
+      if (b_layout == MM_B_ROW_MAJOR) {
+        // transpose the cols_k x rows_n block of B
+        const mm_elem_t * const b_local = (const mm_elem_t *)b_tile.buf;
+        #pragma omp for
+        for (unsigned j=0; j<rows_n; j++) {
+          for (unsigned k=0; k<cols_k; k++)
+            bt_local[j*tile_k+k] = b_local[k*tile_mn+j];
+        }
+        bt = bt_local;
+      }
+
+      #pragma omp for collapse(2)
+      for (unsigned i=0; i<rows_m; i++) {
+        for (unsigned j=0; j<rows_n; j++) {
+          mm_acc_t sum = 0;
+          for (unsigned k=0; k<cols_k; k++)
+            sum = sum + (mm_acc_t)a_local[i*tile_k+k] * bt[j*tile_k+k];
+          if (kb > 0)
+            sum += c_local[i*tile_mn+j];
+          c_local[i*tile_mn+j] = kb == n_tiles_k-1 ? mm_output(sum) : sum;
+        }
       }
+    } // step < n_steps
+  } // parallel
+
+  ts_out_put(&c_ts);
+  ts_out_flush(&c_ts);
+  ts_free(&a_ts);
+  ts_free(&b_ts);
+  ts_free(&c_ts);
+  if (bt_local) hero_l1free(bt_local);
+
+  return 0;
+}
+
+/*
+ * Multiply two matrices, C = A * B, for B in either layout.  If A, B and C fit into L1 together,
+ * they are multiplied in L1; otherwise, they are streamed through L1 in tiles.
+ */
+int mm_small(mm_elem_t * __restrict__ a, mm_elem_t * __restrict__ b, mm_acc_t * __restrict__ c,
+    unsigned width, unsigned b_layout)
+{
+  if (mm_dma(a, b, c, width, b_layout) == 0)
+    return 0;
+
+  return mm_tiled(a, b, c, width, b_layout);
+}
+
+/*
+ * Multiply a batch of `n_mats` matrices of `width x width` elements stored back to back,
+ * C_i = A_i * B_i.  The batch is streamed through L1 in groups of as many matrices as fit with
+ * `common/tile-stream.h`, and the rows of all matrices of a group are distributed over the cores,
+ * so also groups with fewer matrices than cores keep all of them busy.  Like in `mm_dma()`, a
+ * row-major B is transposed in L1, so the inner products run with unit stride.
+ */
+int mm_batch(mm_elem_t * __restrict__ a, mm_elem_t * __restrict__ b, mm_acc_t * __restrict__ c,
+    unsigned n_mats, unsigned width, unsigned b_layout)
+{
+  if (n_mats == 0)
+    return 0;
+
+  const unsigned mat_size = width*width;
+  unsigned group = MM_BATCH_L1_BUDGET_B /
+    (MM_BATCH_DEPTH * mat_size * (2*sizeof(mm_elem_t) + sizeof(mm_acc_t)));
+  if (group == 0) {
+    printf("ERROR: A %u x %u matrix does not fit into L1!\n", width, width);
+    return -ENOMEM;
+  }
+  if (group > n_mats)
+    group = n_mats;
+
+  // view the batches as n_mats*width x width arrays and stream groups of matrices
+  const unsigned rows     = n_mats*width;
+  const unsigned stride_b   = width*sizeof(mm_elem_t);
+  const unsigned stride_c_b = width*sizeof(mm_acc_t);
+  ts_stream_t a_ts, b_ts, c_ts;
+  int err_a = ts_init(&a_ts, TS_IN, (void *)a, sizeof(mm_elem_t), rows, width, stride_b,
+    group*width, width, 0, MM_BATCH_DEPTH);
+  int err_b = ts_init(&b_ts, TS_IN, (void *)b, sizeof(mm_elem_t), rows, width, stride_b,
+    group*width, width, 0, MM_BATCH_DEPTH);
+  int err_c = ts_init(&c_ts, TS_OUT, (void *)c, sizeof(mm_acc_t), rows, width, stride_c_b,
+    group*width, width, 0, MM_BATCH_DEPTH);
+  if (err_a || err_b || err_c) {
+    printf("ERROR: Memory allocation failed!\n");
+    if (!err_a) ts_free(&a_ts);
+    if (!err_b) ts_free(&b_ts);
+    if (!err_c) ts_free(&c_ts);
+    return -ENOMEM;
+  }
+
+  ts_tile_t a_tile, b_tile, c_tile;
+  int more = 1;
+
+  #pragma omp parallel shared(a_ts, b_ts, c_ts, a_tile, b_tile, c_tile, more)
+  {
+    while (1) {
+      // write back the previous group and wait for the next one
+      #pragma omp single
+      {
+        ts_out_put(&c_ts);
+        more = (ts_in_next(&a_ts, &a_tile) == 0) && (ts_in_next(&b_ts, &b_tile) == 0) &&
+          (ts_out_next(&c_ts, &c_tile) == 0);
+      }
+      if (!more)
+        break;
+
+      const mm_elem_t * const a_local = (const mm_elem_t *)a_tile.buf;
+      mm_elem_t * const       b_local = (mm_elem_t *)b_tile.buf;
+      mm_acc_t * const        c_local = (mm_acc_t *)c_tile.buf;
+      const unsigned         n_group = a_tile.rows / width;
+
+      if (b_layout == MM_B_ROW_MAJOR) {
+        #pragma omp for collapse(2)
+        for (unsigned mat=0; mat<n_group; mat++) {
+          for (unsigned i=0; i<width; i++)
+            transpose_row(&b_local[mat*mat_size], width, i);
+        }
+      }
+
+      #pragma omp for collapse(2)
+      for (unsigned mat=0; mat<n_group; mat++) {
+        for (unsigned i=0; i<width; i++) {
+          const mm_elem_t * const a_mat = &a_local[mat*mat_size];
+          const mm_elem_t * const b_mat = &b_local[mat*mat_size];
+          for (unsigned j=0; j<width; j++) {
+            mm_acc_t sum = 0;
+            for (unsigned k=0; k<width; k++)
+              sum = sum + (mm_acc_t)a_mat[i*width+k] * b_mat[j*width+k];
+            c_local[mat*mat_size+i*width+j] = mm_output(sum);
+          }
+        }
+      }
+    }
+  } // parallel
+
+  ts_out_flush(&c_ts);
+  ts_free(&a_ts);
+  ts_free(&b_ts);
+  ts_free(&c_ts);
+
+  return 0;
+}
+
+#pragma omp end declare target
+
+/*
+ * Keep the input matrices on the copy-based device across target regions, A in version
+ * `a_version`; B is never modified.  The SVM device reads them in place, so there is nothing to
+ * keep there.
+ */
+void cache_inputs(dev_cache_t* cache, mm_elem_t* a, unsigned a_version, mm_elem_t* b,
+    unsigned width, unsigned height)
+{
+  dev_cache_map_to(cache, BIGPULP_MEMCPY, a, sizeof(mm_elem_t)*width*height, a_version);
+  dev_cache_map_to(cache, BIGPULP_MEMCPY, b, sizeof(mm_elem_t)*width*height, 0);
+}
+
+/*
+ * Reverse the order of the `rows` rows of `row_b` bytes each of a matrix in place.
+ */
+void reverse_rows(void* m, unsigned rows, size_t row_b)
+{
+  uint8_t * const bytes = (uint8_t *)m;
+  for (unsigned i=0; i<rows/2; i++) {
+    uint8_t * const top    = &bytes[i*row_b];
+    uint8_t * const bottom = &bytes[(rows-1-i)*row_b];
+    for (size_t x=0; x<row_b; x++) {
+      const uint8_t tmp = top[x];
+      top[x]    = bottom[x];
+      bottom[x] = tmp;
     }
   }
 }
@@ -45,51 +397,76 @@ int main(int argc, char *argv[])
   if( argc > 1 ) {
     width = strtoul(argv[1], NULL, 0);
   }
-  if (width > 140) {
-    printf("WARNING: widths greater than 140 entries not supported, falling back to 128.\n");
-    width = 128;
-  }
   unsigned height = width;
 
+  // batch of small matrices
+  unsigned n_mats = 256;
+  unsigned batch_width = 16;
+  if( argc > 2 ) {
+    n_mats = strtoul(argv[2], NULL, 0);
+  }
+  if( argc > 3 ) {
+    batch_width = strtoul(argv[3], NULL, 0);
+  }
+
   // Allocate memory
-  uint32_t * a = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * b = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * c = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  uint32_t * d = (uint32_t *)malloc(sizeof(uint32_t)*width*height);
-  if ( (a == NULL) || (b == NULL) || (c == NULL) || (d == NULL) ) {
+  mm_elem_t * a = (mm_elem_t *)malloc(sizeof(mm_elem_t)*width*height);
+  mm_elem_t * b = (mm_elem_t *)malloc(sizeof(mm_elem_t)*width*height);
+  mm_acc_t * c = (mm_acc_t *)malloc(sizeof(mm_acc_t)*width*height);
+  mm_acc_t * d = (mm_acc_t *)malloc(sizeof(mm_acc_t)*width*height);
+  mm_elem_t * bt = (mm_elem_t *)malloc(sizeof(mm_elem_t)*width*height);
+  if ( (a == NULL) || (b == NULL) || (c == NULL) || (d == NULL) || (bt == NULL) ) {
     printf("ERROR: malloc() failed!\n");
     return -ENOMEM;
   }
   printf("width = %u, height = %u, a @ %p, b @ %p, c @ %p\n", width, height, a, b, c);
+  printf("Element type = %s, accumulator = %u B\n", MM_TYPE_NAME, (unsigned)sizeof(mm_acc_t));
 
   // Init matrices
   for (unsigned i=0; i<width; i++) {
     for (unsigned j=0; j<height; j++) {
-      a[i*width+j] = i*width+j;
-      b[i*width+j] = i == j ? 2 : 0;
+      a[i*width+j] = MM_TEST_VALUE(i*width+j);
+      b[i*width+j] = (i == j ? 2 : 0) + (i+2*j) % 5;
+      bt[j*width+i] = b[i*width+j];
     }
   }
-  memset((void *)c, 0, (size_t)(width*height));
-  memset((void *)d, 0, (size_t)(width*height));
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+  memset((void *)d, 0, sizeof(mm_acc_t)*width*height);
 
   /*
    * Execute on host
    */
 
-  bench_start("Host");
-  #pragma omp parallel firstprivate(a, b, d, width, height)
-  {
-    #pragma omp for collapse(2)
-    for (unsigned i=0; i<width; i++) {
-      for (unsigned j=0; j<height; j++) {
-        uint32_t sum = 0;
-        for (unsigned k=0; k<width; k++)
-          sum = sum + a[i*width+k] * b[k*width+j];
-        d[i*width+j] = sum;
+  bench_region_t region;
+  BENCH_REGION(region, "Host" MM_TYPE_TAG) {
+    #pragma omp parallel firstprivate(a, b, d, width, height)
+    {
+      #pragma omp for collapse(2)
+      for (unsigned i=0; i<width; i++) {
+        for (unsigned j=0; j<height; j++) {
+          mm_acc_t sum = 0;
+          for (unsigned k=0; k<width; k++)
+            sum = sum + (mm_acc_t)a[i*width+k] * b[k*width+j];
+          d[i*width+j] = mm_output(sum);
+        }
       }
     }
   }
-  bench_stop();
+
+  // bt holds B^T in row-major order, as the recursive kernel expects
+  BENCH_REGION(region, "Host: Recursive, parallel" MM_TYPE_TAG) {
+    mm_host(width, width, width, a, width, bt, width, c, width, 0, 0);
+  }
+  compare_matrices(c, d, width, height);
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+
+#if MM_HOST_STRASSEN
+  BENCH_REGION(region, "Host: Recursive, parallel, Strassen" MM_TYPE_TAG) {
+    mm_host(width, width, width, a, width, bt, width, c, width, 0, MM_HOST_STRASSEN_MIN);
+  }
+  compare_matrices(c, d, width, height);
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+#endif
 
   /*
    * Execute on PULP
@@ -109,74 +486,140 @@ int main(int argc, char *argv[])
   }
   tmp_1 = tmp_2;
 
-  bench_start("PULP: Single-threaded, copy-based, no DMA");
-  #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
-  {
-    for (unsigned i=0; i<width; i++) {
-      for (unsigned j=0; j<height; j++) {
-        uint32_t sum = 0;
-        for (unsigned k=0; k<width; k++)
-          sum = sum + a[i*width+k] * b[k*width+j];
-        c[i*width+j] = sum;
-      }
-    }
-  }
-  bench_stop();
-  compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
-
-  bench_start("PULP: Parallel, copy-based, no DMA");
-  #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
-  {
+  dev_cache_t cache;
+  dev_cache_init(&cache);
+  unsigned a_version = 0;   // incremented whenever A is modified
 
-    #pragma omp parallel for collapse(2) firstprivate(a, b, c, width, height)
+  BENCH_REGION(region, "PULP: Single-threaded, copy-based, no DMA" MM_TYPE_TAG) {
+    cache_inputs(&cache, a, a_version, b, width, height);
+    #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
+    {
       for (unsigned i=0; i<width; i++) {
         for (unsigned j=0; j<height; j++) {
-          uint32_t sum = 0;
+          mm_acc_t sum = 0;
           for (unsigned k=0; k<width; k++)
-            sum = sum + a[i*width+k] * b[k*width+j];
-          c[i*width+j] = sum;
+            sum = sum + (mm_acc_t)a[i*width+k] * b[k*width+j];
+          c[i*width+j] = mm_output(sum);
         }
       }
+    }
   }
-  bench_stop();
   compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
 
-  bench_start("PULP: Parallel, copy-based, DMA");
-  #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
-  {
-    uint32_t * a_local = (uint32_t *)hero_l1malloc(width*height*sizeof(uint32_t));
-    uint32_t * b_local = (uint32_t *)hero_l1malloc(width*height*sizeof(uint32_t));
-    uint32_t * c_local = (uint32_t *)hero_l1malloc(width*height*sizeof(uint32_t));
-    if ( (a_local == NULL) || (b_local == NULL) || (c_local == NULL) ) {
-      printf("ERROR: Memory allocation failed!\n");
-    }
+  BENCH_REGION(region, "PULP: Parallel, copy-based, no DMA" MM_TYPE_TAG) {
+    cache_inputs(&cache, a, a_version, b, width, height);
+    #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
+    {
 
-    hero_dma_job_t dma0 = hero_dma_memcpy_async(a_local, a, width*height*sizeof(uint32_t));
-    hero_dma_job_t dma1 = hero_dma_memcpy_async(b_local, b, width*height*sizeof(uint32_t));
-    hero_dma_wait(dma0);
-    hero_dma_wait(dma1);
+      #pragma omp parallel for collapse(2) firstprivate(a, b, c, width, height)
+        for (unsigned i=0; i<width; i++) {
+          for (unsigned j=0; j<height; j++) {
+            mm_acc_t sum = 0;
+            for (unsigned k=0; k<width; k++)
+              sum = sum + (mm_acc_t)a[i*width+k] * b[k*width+j];
+            c[i*width+j] = mm_output(sum);
+          }
+        }
+    }
+  }
+  compare_matrices(c, d, width, height);
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
 
-    #pragma omp parallel for collapse(2) firstprivate(a_local, b_local, c_local, width, height)
-      for (unsigned i=0; i<width; i++) {
-        for (unsigned j=0; j<height; j++) {
-          uint32_t sum = 0;
-          for (unsigned k=0; k<width; k++)
-            sum = sum + a_local[i*width+k] * b_local[k*width+j];
-          c_local[i*width+j] = sum;
+  // A, B and C must fit into L1 together.
+  if (width <= MM_SMALL_WIDTH_MAX) {
+    BENCH_REGION(region, "PULP: Parallel, copy-based, DMA" MM_TYPE_TAG) {
+      cache_inputs(&cache, a, a_version, b, width, height);
+      #pragma omp target device(BIGPULP_MEMCPY) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
+      {
+        mm_elem_t * a_local = (mm_elem_t *)hero_l1malloc(width*height*sizeof(mm_elem_t));
+        mm_elem_t * b_local = (mm_elem_t *)hero_l1malloc(width*height*sizeof(mm_elem_t));
+        mm_acc_t * c_local = (mm_acc_t *)hero_l1malloc(width*height*sizeof(mm_acc_t));
+        if ( (a_local == NULL) || (b_local == NULL) || (c_local == NULL) ) {
+          printf("ERROR: Memory allocation failed!\n");
         }
+
+        hero_dma_job_t dma0 = hero_dma_memcpy_async(a_local, a, width*height*sizeof(mm_elem_t));
+        hero_dma_job_t dma1 = hero_dma_memcpy_async(b_local, b, width*height*sizeof(mm_elem_t));
+        hero_dma_wait(dma0);
+        hero_dma_wait(dma1);
+
+        #pragma omp parallel for collapse(2) firstprivate(a_local, b_local, c_local, width, height)
+          for (unsigned i=0; i<width; i++) {
+            for (unsigned j=0; j<height; j++) {
+              mm_acc_t sum = 0;
+              for (unsigned k=0; k<width; k++)
+                sum = sum + (mm_acc_t)a_local[i*width+k] * b_local[k*width+j];
+              c_local[i*width+j] = mm_output(sum);
+            }
+          }
+
+        hero_dma_memcpy(c, c_local, width*height*sizeof(mm_acc_t));
+
+        hero_l1free(a_local);
+        hero_l1free(b_local);
+        hero_l1free(c_local);
       }
+    }
+    compare_matrices(c, d, width, height);
+    memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+  }
+
+  /*
+   * Unit-stride inner products: B is transposed while it is loaded into L1, or it is given in
+   * column-major order.  The matrices are multiplied in L1 if they fit and streamed through L1 in
+   * tiles otherwise.
+   */
+  const char * const b_layout_names[] = { "B row-major, transposed on load", "B column-major" };
+  mm_elem_t * const   b_layouts[]      = { b, bt };
+  int err    = 0;
+  int failed = 0;   // set if a kernel returns an error
 
-    hero_dma_memcpy(c, c_local, width*height*sizeof(uint32_t));
+  for (unsigned b_layout=MM_B_ROW_MAJOR; b_layout<=MM_B_COL_MAJOR; b_layout++) {
+    mm_elem_t * b_in = b_layouts[b_layout];
+    err = 0;
+    BENCH_REGION(region, "PULP: Parallel, copy-based, DMA, %s" MM_TYPE_TAG,
+        b_layout_names[b_layout]) {
+      cache_inputs(&cache, a, a_version, b_in, width, height);
+      #pragma omp target device(BIGPULP_MEMCPY) \
+        map(to: a[0:width*height], b_in[0:width*height], width, b_layout) \
+        map(from: c[0:width*height]) map(tofrom: err)
+      err |= mm_small(a, b_in, c, width, b_layout);
+    }
+    if (err) {
+      printf("ERROR: mm_small() failed with %d (%s)!\n", err, b_layout_names[b_layout]);
+      failed = 1;
+    }
+    else
+      compare_matrices(c, d, width, height);
+    memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+  }
 
-    hero_l1free(a_local);
-    hero_l1free(b_local);
-    hero_l1free(c_local);
+  /*
+   * Modified input: reversing the rows of A reverses the rows of C.  The new version of A replaces
+   * the copy cached on the device once, with `target update`; the other runs hit the cache.
+   */
+  reverse_rows(a, height, sizeof(mm_elem_t)*width);
+  a_version++;
+  err = 0;
+  BENCH_REGION(region, "PULP: Parallel, copy-based, DMA, modified A" MM_TYPE_TAG) {
+    cache_inputs(&cache, a, a_version, bt, width, height);
+    #pragma omp target device(BIGPULP_MEMCPY) \
+      map(to: a[0:width*height], bt[0:width*height], width) \
+      map(from: c[0:width*height]) map(tofrom: err)
+    err |= mm_small(a, bt, c, width, MM_B_COL_MAJOR);
   }
-  bench_stop();
-  compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
+  reverse_rows(a, height, sizeof(mm_elem_t)*width);
+  a_version++;
+  if (err) {
+    printf("ERROR: mm_small() failed with %d (modified A)!\n", err);
+    failed = 1;
+  }
+  else {
+    reverse_rows(c, height, sizeof(mm_acc_t)*width);
+    compare_matrices(c, d, width, height);
+  }
+  memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
 
   /*
    * Make sure PULP is ready - speeds up the first target
@@ -190,49 +633,130 @@ int main(int argc, char *argv[])
   }
   tmp_1 = tmp_2;
 
-  bench_start("PULP: Parallel, SVM, DMA");
-  #pragma omp target device(BIGPULP_SVM) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
-  {
-    unsigned width_local  = hero_tryread((unsigned int *)&width);
-    unsigned height_local = hero_tryread((unsigned int *)&height);
-
-    uint32_t * a_local = (uint32_t *)hero_l1malloc(width_local*height_local*sizeof(uint32_t));
-    uint32_t * b_local = (uint32_t *)hero_l1malloc(width_local*height_local*sizeof(uint32_t));
-    uint32_t * c_local = (uint32_t *)hero_l1malloc(width_local*height_local*sizeof(uint32_t));
-    if ( (a_local == NULL) || (b_local == NULL) || (c_local == NULL) ) {
-      printf("ERROR: Memory allocation failed!\n");
+  // A, B and C must fit into L1 together.
+  if (width <= MM_SMALL_WIDTH_MAX) {
+    BENCH_REGION(region, "PULP: Parallel, SVM, DMA" MM_TYPE_TAG) {
+      #pragma omp target device(BIGPULP_SVM) map(to: a[0:width*height], b[0:width*height], width, height) map(from: c[0:width*height])
+      {
+        unsigned width_local  = hero_tryread((unsigned int *)&width);
+        unsigned height_local = hero_tryread((unsigned int *)&height);
+
+        mm_elem_t * a_local = (mm_elem_t *)hero_l1malloc(width_local*height_local*sizeof(mm_elem_t));
+        mm_elem_t * b_local = (mm_elem_t *)hero_l1malloc(width_local*height_local*sizeof(mm_elem_t));
+        mm_acc_t * c_local = (mm_acc_t *)hero_l1malloc(width_local*height_local*sizeof(mm_acc_t));
+        if ( (a_local == NULL) || (b_local == NULL) || (c_local == NULL) ) {
+          printf("ERROR: Memory allocation failed!\n");
+        }
+
+        hero_dma_job_t dma0 = hero_dma_memcpy_async(a_local, a, width_local*height_local*sizeof(mm_elem_t));
+        hero_dma_job_t dma1 = hero_dma_memcpy_async(b_local, b, width_local*height_local*sizeof(mm_elem_t));
+        hero_dma_wait(dma0);
+        hero_dma_wait(dma1);
+
+        #pragma omp parallel for collapse(2) firstprivate(a_local, b_local, c_local, width_local, height_local)
+        for (unsigned i=0; i<width_local; i++) {
+          for (unsigned j=0; j<height_local; j++) {
+            mm_acc_t sum = 0;
+            for (unsigned k=0; k<width_local; k++)
+              sum = sum + (mm_acc_t)a_local[i*width_local+k] * b_local[k*width_local+j];
+            c_local[i*width_local+j] = mm_output(sum);
+          }
+        }
+
+        hero_dma_memcpy(c, c_local, width_local*height_local*sizeof(mm_acc_t));
+
+        hero_l1free(a_local);
+        hero_l1free(b_local);
+        hero_l1free(c_local);
+      } // target
     }
+    compare_matrices(c, d, width, height);
+    memset((void *)c, 0, sizeof(mm_acc_t)*width*height);
+  }
+
+  /*
+   * Batch of small matrices: one launch per matrix vs. one launch for the whole batch
+   */
+  const size_t batch_size = (size_t)n_mats*batch_width*batch_width;
+  const size_t mat_size   = (size_t)batch_width*batch_width;
+  mm_elem_t * a_batch = (mm_elem_t *)malloc(sizeof(mm_elem_t)*batch_size);
+  mm_elem_t * b_batch = (mm_elem_t *)malloc(sizeof(mm_elem_t)*batch_size);
+  mm_acc_t * c_batch = (mm_acc_t *)malloc(sizeof(mm_acc_t)*batch_size);
+  mm_acc_t * d_batch = (mm_acc_t *)malloc(sizeof(mm_acc_t)*batch_size);
+  if ( (a_batch == NULL) || (b_batch == NULL) || (c_batch == NULL) || (d_batch == NULL) ) {
+    printf("ERROR: malloc() failed!\n");
+    return -ENOMEM;
+  }
+  printf("Batch of %u matrices, width = height = %u\n", n_mats, batch_width);
+
+  for (size_t i=0; i<batch_size; i++) {
+    a_batch[i] = MM_TEST_VALUE(i);
+    b_batch[i] = i % 7;
+  }
 
-    hero_dma_job_t dma0 = hero_dma_memcpy_async(a_local, a, width_local*height_local*sizeof(uint32_t));
-    hero_dma_job_t dma1 = hero_dma_memcpy_async(b_local, b, width_local*height_local*sizeof(uint32_t));
-    hero_dma_wait(dma0);
-    hero_dma_wait(dma1);
-
-    #pragma omp parallel for collapse(2) firstprivate(a_local, b_local, c_local, width_local, height_local)
-    for (unsigned i=0; i<width_local; i++) {
-      for (unsigned j=0; j<height_local; j++) {
-        uint32_t sum = 0;
-        for (unsigned k=0; k<width_local; k++)
-          sum = sum + a_local[i*width_local+k] * b_local[k*width_local+j];
-        c_local[i*width_local+j] = sum;
+  BENCH_REGION(region, "Host: Batch" MM_TYPE_TAG) {
+    #pragma omp parallel for collapse(2) firstprivate(a_batch, b_batch, d_batch, batch_width)
+    for (unsigned mat=0; mat<n_mats; mat++) {
+      for (unsigned i=0; i<batch_width; i++) {
+        for (unsigned j=0; j<batch_width; j++) {
+          mm_acc_t sum = 0;
+          for (unsigned k=0; k<batch_width; k++)
+            sum = sum + (mm_acc_t)a_batch[mat*mat_size+i*batch_width+k] *
+              b_batch[mat*mat_size+k*batch_width+j];
+          d_batch[mat*mat_size+i*batch_width+j] = mm_output(sum);
+        }
       }
     }
+  }
 
-    hero_dma_memcpy(c, c_local, width_local*height_local*sizeof(uint32_t));
+  err = 0;
+  BENCH_REGION(region, "PULP: Batch, one launch per matrix, copy-based, DMA" MM_TYPE_TAG) {
+    for (unsigned mat=0; mat<n_mats; mat++) {
+      mm_elem_t * a_mat = &a_batch[mat*mat_size];
+      mm_elem_t * b_mat = &b_batch[mat*mat_size];
+      mm_acc_t * c_mat = &c_batch[mat*mat_size];
+      #pragma omp target device(BIGPULP_MEMCPY) \
+        map(to: a_mat[0:mat_size], b_mat[0:mat_size], batch_width) \
+        map(from: c_mat[0:mat_size]) map(tofrom: err)
+      err |= mm_batch(a_mat, b_mat, c_mat, 1, batch_width, MM_B_ROW_MAJOR);
+    }
+  }
+  if (err) {
+    printf("ERROR: mm_batch() failed with %d (one launch per matrix)!\n", err);
+    failed = 1;
+  }
+  else
+    compare_matrices(c_batch, d_batch, batch_width, n_mats*batch_width);
+  memset((void *)c_batch, 0, sizeof(mm_acc_t)*batch_size);
 
-    hero_l1free(a_local);
-    hero_l1free(b_local);
-    hero_l1free(c_local);
-  } // target
-  bench_stop();
-  compare_matrices(c, d, width, height);
-  memset((void *)c, 0, (size_t)(width*height));
+  err = 0;
+  BENCH_REGION(region, "PULP: Batch, single launch, copy-based, DMA streaming" MM_TYPE_TAG) {
+    #pragma omp target device(BIGPULP_MEMCPY) \
+      map(to: a_batch[0:batch_size], b_batch[0:batch_size], n_mats, batch_width) \
+      map(from: c_batch[0:batch_size]) map(tofrom: err)
+    err |= mm_batch(a_batch, b_batch, c_batch, n_mats, batch_width, MM_B_ROW_MAJOR);
+  }
+  if (err) {
+    printf("ERROR: mm_batch() failed with %d (single launch)!\n", err);
+    failed = 1;
+  }
+  else
+    compare_matrices(c_batch, d_batch, batch_width, n_mats*batch_width);
+
+  free(a_batch);
+  free(b_batch);
+  free(c_batch);
+  free(d_batch);
+
+  dev_cache_print(&cache, "Device cache");
+  dev_cache_release_all(&cache);
 
   // free memory
   free(a);
   free(b);
   free(c);
   free(d);
+  free(bt);
 
-  return 0;
+  return failed;
 }
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <hero-target.h>
 
+#include "bench.h"
 #include "macros.h"
 #include "sobel.h"
 #include "file_operations.h"
@@ -31,9 +32,9 @@
 int main(int argc, char *argv[]) {
     char *file_in,
          *file_out,
-         *file_out_h,
-         *file_out_v,
-         *file_gray;
+         *file_out_h = NULL,
+         *file_out_v = NULL,
+         *file_gray = NULL;
 
     byte *rgb,
          *gray,
@@ -122,8 +123,31 @@ int main(int argc, char *argv[]) {
     contour_img = malloc(sizeof(byte) * gray_size);
 
     omp_set_default_device(BIGPULP_MEMCPY);
-    #pragma omp target map(to: rgb[0:rgb_size], width, height) map(from: gray[0:gray_size], sobel_h_res[0:gray_size], sobel_v_res[0:gray_size], contour_img[0:gray_size])
-    sobelFilter(rgb, gray, sobel_h_res, sobel_v_res, contour_img, width, height);
+    bench_region_t region;
+    BENCH_REGION(region, "PULP: Sobel filter, copy-based") {
+        #pragma omp target map(to: rgb[0:rgb_size], width, height) map(from: gray[0:gray_size], sobel_h_res[0:gray_size], sobel_v_res[0:gray_size], contour_img[0:gray_size])
+        sobelFilter(rgb, gray, sobel_h_res, sobel_v_res, contour_img, width, height);
+    }
+
+    // Stream the image through L1 in stripes and compare with the copy-based results
+    byte *tiled_res = malloc(sizeof(byte) * gray_size * 4);
+    byte *tiled_gray = tiled_res,
+         *tiled_h = tiled_res + gray_size,
+         *tiled_v = tiled_res + 2*gray_size,
+         *tiled_contour = tiled_res + 3*gray_size;
+    int tiled_ret = 0;
+    BENCH_REGION(region, "PULP: Sobel filter, tiled DMA streaming") {
+        #pragma omp target map(to: rgb[0:rgb_size], width, height) map(from: tiled_gray[0:gray_size], tiled_h[0:gray_size], tiled_v[0:gray_size], tiled_contour[0:gray_size], tiled_ret)
+        tiled_ret = sobelFilterTiled(rgb, tiled_gray, tiled_h, tiled_v, tiled_contour, width, height);
+    }
+    if(tiled_ret >= 0
+       && (memcmp(tiled_gray, gray, gray_size) || memcmp(tiled_h, sobel_h_res, gray_size)
+           || memcmp(tiled_v, sobel_v_res, gray_size) || memcmp(tiled_contour, contour_img, gray_size))) {
+        printf("ERROR: Tiled results do not match the copy-based ones!\n");
+        free(tiled_res);
+        return 1;
+    }
+    free(tiled_res);
 
     // Write gray image
     if(gray_file) {
@@ -20,9 +20,16 @@
 #include <string.h>
 #pragma omp declare target
 #include <math.h>
+#include <hero-target.h>
+#include "tile-stream.h"
 #include "sobel.h"
 #include "macros.h"
 
+#ifndef SOBEL_L1_BUDGET_B
+  #define SOBEL_L1_BUDGET_B (128*1024)  // L1 memory available to sobelFilterTiled
+#endif
+#define SOBEL_DEPTH 2                   // buffers per stream in sobelFilterTiled
+
 /*
  * Transforms the rgb information of an image stored in buffer to it's gray
  * representation
@@ -129,4 +136,129 @@ int sobelFilter(byte *rgb, byte *gray, byte *sobel_h_res, byte *sobel_v_res, byt
     contour(sobel_h_res, sobel_v_res, gray_size, contour_img);
     return gray_size;
 }
+/*
+ * Make the operation memory for a pixel from the gray rows above, at and
+ * below it; rows outside of the image are NULL
+ */
+void makeOpMemRows(byte *above, byte *row, byte *below, int width, int col, byte *op_mem) {
+    int left = col == 0;
+    int right = col == width-1;
+
+    op_mem[0] = above && !left  ? above[col-1] : 0;
+    op_mem[1] = above           ? above[col]   : 0;
+    op_mem[2] = above && !right ? above[col+1] : 0;
+
+    op_mem[3] = !left           ? row[col-1]   : 0;
+    op_mem[4] = row[col];
+    op_mem[5] = !right          ? row[col+1]   : 0;
+
+    op_mem[6] = below && !left  ? below[col-1] : 0;
+    op_mem[7] = below           ? below[col]   : 0;
+    op_mem[8] = below && !right ? below[col+1] : 0;
+}
+
+/*
+ * Same as sobelFilter, but streams the image through the L1 memory in stripes
+ * of full rows with tile-stream.h, so the DMA transfers of the next stripe and
+ * the write back of the previous one overlap with the computation.  Every rgb
+ * stripe comes with one halo row above and below for the convolutions.
+ */
+int sobelFilterTiled(byte *rgb, byte *gray, byte *sobel_h_res, byte *sobel_v_res, byte *contour_img, int width, int height) {
+    int sobel_h[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1},
+        sobel_v[] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
+
+    // Stripe height: every row needs its rgb and output buffers plus a row
+    // of gray with halo, the halo rows come on top
+    int row_b = SOBEL_DEPTH*(3*width + 4*width) + width;
+    int halo_b = SOBEL_DEPTH*2*3*width + 2*width;
+    int stripe_rows = (SOBEL_L1_BUDGET_B - halo_b) / row_b;
+    if(stripe_rows > height)
+        stripe_rows = height;
+    if(halo_b >= SOBEL_L1_BUDGET_B || stripe_rows < 1) {
+        printf("ERROR: A stripe of width %d does not fit into L1!\n", width);
+        return -ENOMEM;
+    }
+
+    // Set up the streams: rgb in, gray, sobel_h, sobel_v and contour out
+    ts_stream_t in, out[4];
+    byte *out_ext[4] = {gray, sobel_h_res, sobel_v_res, contour_img};
+    int in_err = ts_init(&in, TS_IN, rgb, 3, height, width, 3*width, stripe_rows, width, 1, SOBEL_DEPTH);
+    int n_out = 0;
+    while(!in_err && n_out < 4 &&
+          ts_init(&out[n_out], TS_OUT, out_ext[n_out], 1, height, width, width, stripe_rows, width, 0, SOBEL_DEPTH) == 0)
+        n_out++;
+    byte *gray_l1 = n_out == 4 ? hero_l1malloc((stripe_rows+2)*width) : NULL;
+    if(gray_l1 == NULL) {
+        printf("ERROR: Memory allocation failed!\n");
+        if(!in_err)
+            ts_free(&in);
+        for(int o=0; o<n_out; o++)
+            ts_free(&out[o]);
+        return -ENOMEM;
+    }
+
+    ts_tile_t tile, out_tile[4];
+    int more = 1;
+
+    #pragma omp parallel
+    {
+        while(1) {
+            // Write back the previous stripe and wait for the next one
+            #pragma omp single
+            {
+                for(int o=0; o<4; o++)
+                    ts_out_put(&out[o]);
+                more = ts_in_next(&in, &tile) == 0;
+                for(int o=0; more && o<4; o++)
+                    ts_out_next(&out[o], &out_tile[o]);
+            }
+            if(!more)
+                break;
+
+            byte *rgb_l1 = (byte *)tile.buf;
+            byte *gray_out = (byte *)out_tile[0].buf;
+
+            // Gray representation of the stripe and its halo rows, computed
+            // like in rgbToGray
+            #pragma omp for
+            for(int r=-(int)tile.halo_above; r<(int)(tile.rows+tile.halo_below); r++) {
+                for(int c=0; c<width; c++) {
+                    byte *px = &rgb_l1[r*(int)tile.stride_b + 3*c];
+                    byte g = 0.30*px[0] + 0.59*px[1] + 0.11*px[2];
+                    gray_l1[(r+1)*width+c] = g;
+                    if(r >= 0 && r < (int)tile.rows)
+                        gray_out[r*width+c] = g;
+                }
+            }
+
+            // Sobel operations and contour of the stripe
+            #pragma omp for
+            for(int r=0; r<(int)tile.rows; r++) {
+                byte *row = &gray_l1[(r+1)*width];
+                byte *above = r > 0 || tile.halo_above ? row - width : NULL;
+                byte *below = r < (int)tile.rows-1 || tile.halo_below ? row + width : NULL;
+                byte *h_out = (byte *)out_tile[1].buf + r*width;
+                byte *v_out = (byte *)out_tile[2].buf + r*width;
+                byte *contour_out = (byte *)out_tile[3].buf + r*width;
+                byte op_mem[SOBEL_OP_SIZE];
+
+                for(int c=0; c<width; c++) {
+                    makeOpMemRows(above, row, below, width, c, op_mem);
+                    h_out[c] = (byte) abs(convolution(op_mem, sobel_h, SOBEL_OP_SIZE));
+                    v_out[c] = (byte) abs(convolution(op_mem, sobel_v, SOBEL_OP_SIZE));
+                    contour_out[c] = (byte) sqrt(pow(h_out[c], 2) + pow(v_out[c], 2));
+                }
+            }
+        }
+    } // parallel
+
+    for(int o=0; o<4; o++) {
+        ts_out_flush(&out[o]);
+        ts_free(&out[o]);
+    }
+    ts_free(&in);
+    hero_l1free(gray_l1);
+
+    return width*height;
+}
 #pragma omp end declare target